@@ -31,8 +31,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dirent.h>
+#include <string.h>
 #include <string>
 #include <sstream>
+#include <map>
+#include <algorithm>
 #include <stdio.h>
 #include <ctime>
 
@@ -410,6 +414,24 @@ string pkgAcqDiffIndex::Custom600Headers()
    return "\nIndex-File: true\nLast-Modified: " + TimeRFC1123(Buf.st_mtime);
 }
 									/*}}}*/
+// RemoveDiffChain - remove the patches collected for rred		/*{{{*/
+// ---------------------------------------------------------------------
+/* rred prefers a single $FinalFile.ed over the chain $FinalFile.ed.*.gz,
+   so neither leftover must be around if a new chain is collected */
+static void RemoveDiffChain(string const &FinalFile)
+{
+   unlink(string(FinalFile + ".ed").c_str());
+   string const Dir = flNotFile(FinalFile);
+   string const Chain = flNotDir(FinalFile) + ".ed.";
+   DIR *D = opendir(Dir.c_str());
+   if (D == NULL)
+      return;
+   for (struct dirent *Ent = readdir(D); Ent != NULL; Ent = readdir(D))
+      if (strncmp(Ent->d_name, Chain.c_str(), Chain.length()) == 0)
+	 unlink(string(Dir + Ent->d_name).c_str());
+   closedir(D);
+}
+									/*}}}*/
 bool pkgAcqDiffIndex::ParseDiffIndex(string IndexDiffFile)		/*{{{*/
 {
    if(Debug)
@@ -419,6 +441,7 @@ bool pkgAcqDiffIndex::ParseDiffIndex(string IndexDiffFile)		/*{{{*/
    pkgTagSection Tags;
    string ServerSha1;
    vector<DiffInfo> available_patches;
+   std::map<string, string> PatchSha1s;
    
    FileFd Fd(IndexDiffFile,FileFd::ReadOnly);
    pkgTagFile TF(&Fd);
@@ -492,6 +515,7 @@ bool pkgAcqDiffIndex::ParseDiffIndex(string IndexDiffFile)		/*{{{*/
 	    std::stringstream patches(Tags.FindS("SHA1-Patches"));
 	    while(patches >> d.sha1 >> size >> d.file)
 	    {
+	       PatchSha1s[d.file] = d.sha1;
 	       if (firstPatch == d.file)
 		  found = true;
 	       else if (found == false)
@@ -517,8 +541,20 @@ bool pkgAcqDiffIndex::ParseDiffIndex(string IndexDiffFile)		/*{{{*/
 	 string::size_type const last_space = Description.rfind(" ");
 	 if(last_space != string::npos)
 	    Description.erase(last_space, Description.size()-last_space);
-	 new pkgAcqIndexDiffs(Owner, RealURI, Description, Desc.ShortDesc,
-			      ExpectedHash, ServerSha1, available_patches);
+	 if (available_patches.empty() == true ||
+	     _config->FindB("Acquire::PDiffs::Merge", true) == false)
+	    new pkgAcqIndexDiffs(Owner, RealURI, Description, Desc.ShortDesc,
+				 ExpectedHash, ServerSha1, available_patches);
+	 else
+	 {
+	    // queue all patches at once, the last one to arrive applies them
+	    RemoveDiffChain(_config->FindDir("Dir::State::lists") + URItoFileName(RealURI));
+	    std::vector<pkgAcqIndexMergeDiffs*> *diffs = new std::vector<pkgAcqIndexMergeDiffs*>();
+	    for (vector<DiffInfo>::const_iterator P = available_patches.begin();
+		 P != available_patches.end(); ++P)
+	       diffs->push_back(new pkgAcqIndexMergeDiffs(Owner, RealURI, Description,
+			Desc.ShortDesc, ExpectedHash, *P, PatchSha1s[P->file], ServerSha1, diffs));
+	 }
 	 Complete = false;
 	 Status = StatDone;
 	 Dequeue();
@@ -769,6 +805,176 @@ void pkgAcqIndexDiffs::Done(string Message,unsigned long long Size,string Md5Has
    }
 }
 									/*}}}*/
+// AcqIndexMergeDiffs::AcqIndexMergeDiffs - Constructor		/*{{{*/
+// ---------------------------------------------------------------------
+/* One item is constructed for each patch and all of them are queued
+ * right away, so that they can be downloaded in a pipelined way.
+ */
+pkgAcqIndexMergeDiffs::pkgAcqIndexMergeDiffs(pkgAcquire *Owner,
+				   string const &URI, string const &URIDesc,
+				   string const &ShortDesc, HashString const &ExpectedHash,
+				   DiffInfo const &patch, string const &PatchSha1,
+				   string const &ServerSha1,
+				   std::vector<pkgAcqIndexMergeDiffs*> * const allPatches)
+   : Item(Owner), RealURI(URI), ExpectedHash(ExpectedHash),
+     patch(patch), PatchSha1(PatchSha1), ServerSha1(ServerSha1),
+     allPatches(allPatches), PatchNumber(allPatches->size()),
+     State(StateFetchDiff)
+{
+   Debug = _config->FindB("Debug::pkgAcquire::Diffs",false);
+
+   Description = URIDesc;
+   Desc.Owner = this;
+   Desc.ShortDesc = ShortDesc;
+
+   Desc.URI = string(RealURI) + ".diff/" + patch.file + ".gz";
+   Desc.Description = Description + " " + patch.file + string(".pdiff");
+   DestFile = _config->FindDir("Dir::State::lists") + "partial/";
+   DestFile += URItoFileName(RealURI + ".diff/" + patch.file);
+
+   if(Debug)
+      std::clog << "pkgAcqIndexMergeDiffs: " << Desc.URI << std::endl;
+
+   QueueURI(Desc);
+}
+									/*}}}*/
+// AcqIndexMergeDiffs::~AcqIndexMergeDiffs - Destructor		/*{{{*/
+// ---------------------------------------------------------------------
+/* The last of the related items takes the list of them with it */
+pkgAcqIndexMergeDiffs::~pkgAcqIndexMergeDiffs()
+{
+   allPatches->erase(std::remove(allPatches->begin(), allPatches->end(), this),
+		     allPatches->end());
+   if (allPatches->empty() == true)
+      delete allPatches;
+}
+									/*}}}*/
+void pkgAcqIndexMergeDiffs::Failed(string /*Message*/,pkgAcquire::MethodConfig * /*Cnf*/)/*{{{*/
+{
+   if(Debug)
+      std::clog << "pkgAcqIndexMergeDiffs failed: " << Desc.URI << std::endl;
+   Complete = false;
+   Status = StatDone;
+   Dequeue();
+
+   // check if we are the first to fail, otherwise we are done here
+   State = StateDoneDiff;
+   for (std::vector<pkgAcqIndexMergeDiffs*>::const_iterator I = allPatches->begin();
+	I != allPatches->end(); ++I)
+      if ((*I)->State == StateErrorDiff)
+	 return;
+
+   // first failure means we should fallback
+   State = StateErrorDiff;
+   if(Debug)
+      std::clog << "Falling back to normal index file acquire" << std::endl;
+   RemoveDiffChain(_config->FindDir("Dir::State::lists") + URItoFileName(RealURI));
+   new pkgAcqIndex(Owner, RealURI, Description, Desc.ShortDesc, ExpectedHash);
+}
+									/*}}}*/
+void pkgAcqIndexMergeDiffs::Done(string Message,unsigned long long Size,string Md5Hash,	/*{{{*/
+			    pkgAcquire::MethodConfig *Cnf)
+{
+   if(Debug)
+      std::clog << "pkgAcqIndexMergeDiffs::Done(): " << Desc.URI << std::endl;
+
+   Item::Done(Message,Size,Md5Hash,Cnf);
+
+   string const FinalFile = _config->FindDir("Dir::State::lists") + URItoFileName(RealURI);
+
+   if (State == StateFetchDiff)
+   {
+      // the patch has to be the one mentioned in the Index
+      if (PatchSha1.empty() == false)
+      {
+	 FileFd Fd(DestFile, FileFd::ReadOnly, FileFd::Gzip);
+	 SHA1Summation SHA1;
+	 SHA1.AddFD(Fd);
+	 if (PatchSha1 != SHA1.Result().Value())
+	 {
+	    if(Debug)
+	       std::clog << "Patch " << patch.file << " has SHA1 " << SHA1.Result().Value()
+			 << " instead of " << PatchSha1 << std::endl;
+	    unlink(DestFile.c_str());
+	    Failed("", NULL);
+	    return;
+	 }
+      }
+
+      // a failed sibling has already cleaned up and fallen back
+      State = StateDoneDiff;
+      for (std::vector<pkgAcqIndexMergeDiffs*>::const_iterator I = allPatches->begin();
+	    I != allPatches->end(); ++I)
+	 if ((*I)->State == StateErrorDiff)
+	 {
+	    unlink(DestFile.c_str());
+	    return;
+	 }
+
+      // rred applies the patches $FinalFile.ed.$number.gz in the order
+      // of their names, so the number is zero-padded
+      string PatchFile;
+      strprintf(PatchFile, "%s.ed.%04u.gz", FinalFile.c_str(), PatchNumber);
+      Rename(DestFile, PatchFile);
+
+      // check if this is the last completed diff
+      for (std::vector<pkgAcqIndexMergeDiffs*>::const_iterator I = allPatches->begin();
+	    I != allPatches->end(); ++I)
+	 if ((*I)->State != StateDoneDiff)
+	 {
+	    if(Debug)
+	       std::clog << "Not the last done diff in the batch: " << Desc.URI << std::endl;
+	    return;
+	 }
+
+      // this is the last completed diff, so we are ready to apply now
+      State = StateApplyDiff;
+
+      if(Debug)
+	 std::clog << "Sending to rred method: " << FinalFile << std::endl;
+
+      DestFile = _config->FindDir("Dir::State::lists") + "partial/";
+      DestFile += URItoFileName(RealURI);
+      Local = true;
+      Desc.URI = "rred:" + FinalFile;
+      QueueURI(Desc);
+      Mode = "rred";
+   }
+   // success in download/apply all diffs, clean up
+   else if (State == StateApplyDiff)
+   {
+      RemoveDiffChain(FinalFile);
+
+      // see if we really got the expected file
+      string const PatchedSha1 = LookupTag(Message, "SHA1-Hash");
+      if (PatchedSha1 != ServerSha1 ||
+	  (ExpectedHash.empty() == false && ExpectedHash.VerifyFile(DestFile) == false))
+      {
+	 if(Debug)
+	    std::clog << "Patched file has SHA1 " << PatchedSha1 << " instead of "
+		      << ServerSha1 << std::endl;
+	 unlink(DestFile.c_str());
+	 Failed("", NULL);
+	 return;
+      }
+
+      // move the result into place
+      if(Debug)
+	 std::clog << "Moving patched file in place: " << std::endl
+		   << DestFile << " -> " << FinalFile << std::endl;
+      Rename(DestFile, FinalFile);
+      chmod(FinalFile.c_str(), 0644);
+
+      // otherwise lists cleanup will eat the file
+      DestFile = FinalFile;
+
+      // all set and done
+      Complete = true;
+      if(Debug)
+	 std::clog << "allDone: " << DestFile << "\n" << std::endl;
+   }
+}
+									/*}}}*/
 // AcqIndex::AcqIndex - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* The package file is added to the queue and a second class is 
@@ -862,6 +1068,14 @@ string pkgAcqIndex::Custom600Headers()
    if (stat(Final.c_str(),&Buf) == 0)
       msg += "\nLast-Modified: " + TimeRFC1123(Buf.st_mtime);
 
+   /* Methods which can decompress gzip while they fetch the file save us
+      the extra run through the gzip method; the others ignore this */
+   if (Decompression == false &&
+       CompressionExtension.substr(0, CompressionExtension.find(' ')) == "gz" &&
+       _config->FindB("Acquire::GzipIndexes",false) == false &&
+       _config->FindB("Acquire::Streaming-Decompression",true) == true)
+      msg += "\nDecompress-Filename: " + DestFile + ".decomp";
+
    return msg;
 }
 									/*}}}*/
@@ -897,6 +1111,24 @@ void pkgAcqIndex::Done(string Message,unsigned long long Size,string Hash,
 {
    Item::Done(Message,Size,Hash,Cfg);
 
+   // The method decompressed the file already while fetching it
+   if (Decompression == false &&
+       LookupTag(Message,"Decompressed-Filename") == DestFile + ".decomp" &&
+       StringToBool(LookupTag(Message,"IMS-Hit"),false) == false)
+   {
+      Erase = (LookupTag(Message,"Filename") == DestFile);
+      Complete = true;
+      Decompression = true;
+      DestFile += ".decomp";
+      Hash = "";
+      if (ExpectedHash.empty() == false)
+      {
+	 string const Sum = LookupTag(Message,("Decompressed-" + ExpectedHash.HashType() + "-Hash").c_str());
+	 if (Sum.empty() == false)
+	    Hash = ExpectedHash.HashType() + ":" + Sum;
+      }
+   }
+
    if (Decompression == true)
    {
       if (_config->FindB("Debug::pkgAcquire::Auth", false))
@@ -423,7 +423,10 @@ class pkgAcqDiffIndex : public pkgAcquire::Item
  *  file or if one of the patches cannot be downloaded, falls back to
  *  downloading the entire package index file using pkgAcqIndex.
  *
- *  \sa pkgAcqDiffIndex, pkgAcqIndex
+ *  This is only used if Acquire::PDiffs::Merge is disabled, otherwise
+ *  the patches are fetched by pkgAcqIndexMergeDiffs.
+ *
+ *  \sa pkgAcqDiffIndex, pkgAcqIndexMergeDiffs, pkgAcqIndex
  */
 class pkgAcqIndexDiffs : public pkgAcquire::Item
 {
@@ -548,6 +551,126 @@ class pkgAcqIndexDiffs : public pkgAcquire::Item
 		    std::vector<DiffInfo> diffs=std::vector<DiffInfo>());
 };
 									/*}}}*/
+/** \brief An item that is responsible for fetching one of the patches	{{{
+ *  needed to bring a package index file up to date.
+ *
+ *  One item is created for each patch, so all patches are queued at
+ *  once and can be fetched in a pipelined way. Each patch is checked
+ *  against its SHA1 from the Index; the item finishing the last download
+ *  lets rred apply the complete chain in one go. If a patch can't be
+ *  fetched or applied, falls back to downloading the entire package
+ *  index file using pkgAcqIndex.
+ *
+ *  \sa pkgAcqDiffIndex, pkgAcqIndex
+ */
+class pkgAcqIndexMergeDiffs : public pkgAcquire::Item
+{
+   protected:
+
+   /** \brief If \b true, debugging output will be written to
+    *  std::clog.
+    */
+   bool Debug;
+
+   /** \brief A description of the item that is currently being
+    *  downloaded.
+    */
+   pkgAcquire::ItemDesc Desc;
+
+   /** \brief The URI of the package index file that is being
+    *  reconstructed.
+    */
+   std::string RealURI;
+
+   /** \brief The HashSum of the package index file that is being
+    *  reconstructed.
+    */
+   HashString ExpectedHash;
+
+   /** \brief description of the file being downloaded. */
+   std::string Description;
+
+   /** \brief information about the patch this item fetches */
+   DiffInfo const patch;
+
+   /** \brief The SHA1 of the uncompressed patch from the Index */
+   std::string const PatchSha1;
+
+   /** \brief The SHA1 the file has to have after applying all patches */
+   std::string const ServerSha1;
+
+   /** \brief list of all items fetching the patches for this file,
+    *  deleted together with the last of them
+    */
+   std::vector<pkgAcqIndexMergeDiffs*> * const allPatches;
+
+   /** \brief position of this patch in the chain, it is the number of
+    *  items which were in allPatches when this one was created
+    */
+   unsigned int const PatchNumber;
+
+   /** \brief The current status of this patch. */
+   enum DiffState
+     {
+	/** \brief The diff is currently being fetched. */
+	StateFetchDiff,
+
+	/** \brief The diff is currently being applied. */
+	StateApplyDiff,
+
+	/** \brief the work with this diff is done */
+	StateDoneDiff,
+
+	/** \brief something bad happened and fallback was triggered */
+	StateErrorDiff
+     } State;
+
+   public:
+   /** \brief Called when the patch file failed to be downloaded.
+    *
+    *  This method will fall back to downloading the whole index file
+    *  outright; its arguments are ignored.
+    */
+   virtual void Failed(std::string Message,pkgAcquire::MethodConfig *Cnf);
+
+   virtual void Done(std::string Message,unsigned long long Size,std::string Md5Hash,
+		     pkgAcquire::MethodConfig *Cnf);
+   virtual std::string DescURI() {return RealURI + "Index";};
+
+   /** \brief Create an index merge-diff item.
+    *
+    *  \param Owner The pkgAcquire object that owns this item.
+    *
+    *  \param URI The URI of the package index file being
+    *  reconstructed.
+    *
+    *  \param URIDesc A long description of this item.
+    *
+    *  \param ShortDesc A brief description of this item.
+    *
+    *  \param ExpectedHash The expected md5sum of the completely
+    *  reconstructed package index file; the index file will be tested
+    *  against this value when it is entirely reconstructed.
+    *
+    *  \param patch contains infos about the patch this item is supposed
+    *  to download which were read from the index
+    *
+    *  \param PatchSha1 The SHA1 of the uncompressed patch, may be empty.
+    *
+    *  \param ServerSha1 The SHA1 of the file after applying all patches.
+    *
+    *  \param allPatches contains all related items so that each item can
+    *  check if it was the last one to complete the download step; the
+    *  items have to be added in the order the patches are applied in
+    */
+   pkgAcqIndexMergeDiffs(pkgAcquire *Owner,std::string const &URI,std::string const &URIDesc,
+			 std::string const &ShortDesc, HashString const &ExpectedHash,
+			 DiffInfo const &patch, std::string const &PatchSha1,
+			 std::string const &ServerSha1,
+			 std::vector<pkgAcqIndexMergeDiffs*> * const allPatches);
+   virtual ~pkgAcqIndexMergeDiffs();
+};
+									/*}}}*/
 /** \brief An acquire item that is responsible for fetching an index	{{{
  *  file (e.g., Packages or Sources).
  *
@@ -25,12 +25,78 @@
 #include <apt-pkg/hashes.h>
 
 #include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
 #include <sys/signal.h>
 									/*}}}*/
 
 using namespace std;
 
+/* Once APT talked to us in binary frames (see FrameMessage) we answer in
+   frames, too: std::cout is redirected into this buffer, which sends each
+   complete message as a frame on a flush. */
+class FramingBuf : public std::streambuf
+{
+   string Text;
+
+   protected:
+   virtual int_type overflow(int_type C)
+   {
+      if (traits_type::eq_int_type(C, traits_type::eof()) == false)
+	 Text += traits_type::to_char_type(C);
+      return traits_type::not_eof(C);
+   }
+   virtual std::streamsize xsputn(char const *S, std::streamsize N)
+   {
+      Text.append(S, N);
+      return N;
+   }
+   virtual int sync()
+   {
+      string::size_type End;
+      while ((End = Text.find("\n\n")) != string::npos)
+      {
+	 string const Frame = FrameMessage(Text.substr(0, End));
+	 Text.erase(0, End + 2);
+	 char const *Data = Frame.c_str();
+	 for (size_t Left = Frame.length(); Left != 0;)
+	 {
+	    ssize_t const Res = write(STDOUT_FILENO, Data, Left);
+	    if (Res < 0 && errno == EINTR)
+	       continue;
+	    if (Res <= 0)
+	       return -1;
+	    Data += Res;
+	    Left -= Res;
+	 }
+      }
+      return 0;
+   }
+};
+static FramingBuf *Framing = 0;
+
+// Fields URIDoneDecompressed adds to the next 201 URI Done message
+static string DecompressedFields;
+
+static bool ReadMessagesFramed(vector<string> &List)
+{
+   bool Framed;
+   if (ReadMessages(STDIN_FILENO, List, Framed) == false)
+      return false;
+   if (Framed == true && Framing == 0)
+   {
+      std::cout.flush();
+      Framing = new FramingBuf;
+      std::cout.rdbuf(Framing);
+   }
+   return true;
+}
+
 // AcqMethod::pkgAcqMethod - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* This constructs the initialization text */
@@ -57,6 +123,8 @@ pkgAcqMethod::pkgAcqMethod(const char *Ver,unsigned long Flags)
    if ((Flags & Removable) == Removable)
       std::cout << "Removable: true\n";
 
+   std::cout << "Binary-Framing: true\n";
+
    std::cout << "\n" << std::flush;
 
    SetNonBlock(STDIN_FILENO,true);
@@ -210,7 +278,8 @@ void pkgAcqMethod::URIDone(FetchResult &Res, FetchResult *Alt)
 	 std::cout << "Alt-IMS-Hit: true\n";
    }
 
-   std::cout << "\n" << std::flush;
+   std::cout << DecompressedFields << "\n" << std::flush;
+   DecompressedFields.clear();
 
    // Dequeue
    FetchItem *Tmp = Queue;
@@ -220,15 +289,37 @@ void pkgAcqMethod::URIDone(FetchResult &Res, FetchResult *Alt)
       QueueBack = Queue;
 }
 									/*}}}*/
+// AcqMethod::URIDoneDecompressed - A URI was decompressed, too	/*{{{*/
+// ---------------------------------------------------------------------
+/* The method was asked with Decompress-Filename to decompress the file
+   while it fetched it. The result of this is reported with Decompressed-*
+   fields in addition to the usual ones. */
+void pkgAcqMethod::URIDoneDecompressed(FetchResult &Res,FetchResult const &Decompressed)
+{
+   std::ostringstream Fields;
+   Fields << "Decompressed-Filename: " << Decompressed.Filename << "\n"
+	  << "Decompressed-Size: " << Decompressed.Size << "\n";
+   if (Decompressed.MD5Sum.empty() == false)
+      Fields << "Decompressed-MD5Sum-Hash: " << Decompressed.MD5Sum << "\n";
+   if (Decompressed.SHA1Sum.empty() == false)
+      Fields << "Decompressed-SHA1-Hash: " << Decompressed.SHA1Sum << "\n";
+   if (Decompressed.SHA256Sum.empty() == false)
+      Fields << "Decompressed-SHA256-Hash: " << Decompressed.SHA256Sum << "\n";
+   if (Decompressed.SHA512Sum.empty() == false)
+      Fields << "Decompressed-SHA512-Hash: " << Decompressed.SHA512Sum << "\n";
+   DecompressedFields = Fields.str();
+   URIDone(Res);
+}
+									/*}}}*/
 // AcqMethod::MediaFail - Syncronous request for new media		/*{{{*/
 // ---------------------------------------------------------------------
 /* This sends a 403 Media Failure message to the APT and waits for it
    to be ackd */
 bool pkgAcqMethod::MediaFail(string Required,string Drive)
 {
-   fprintf(stdout, "403 Media Failure\nMedia: %s\nDrive: %s\n",
-	    Required.c_str(),Drive.c_str());
-   std::cout << "\n" << std::flush;
+   std::cout << "403 Media Failure\nMedia: " << Required << "\n"
+	     << "Drive: " << Drive << "\n"
+	     << "\n" << std::flush;
 
    vector<string> MyMessages;
    
@@ -239,7 +330,7 @@ bool pkgAcqMethod::MediaFail(string Required,string Drive)
       if (WaitFd(STDIN_FILENO) == false)
 	 return false;
       
-      if (ReadMessages(STDIN_FILENO,MyMessages) == false)
+      if (ReadMessagesFramed(MyMessages) == false)
 	 return false;
 
       string Message = MyMessages.front();
@@ -321,7 +412,7 @@ int pkgAcqMethod::Run(bool Single)
 	 if (Single == false)
 	    if (WaitFd(STDIN_FILENO) == false)
 	       break;
-	 if (ReadMessages(STDIN_FILENO,Messages) == false)
+	 if (ReadMessagesFramed(Messages) == false)
 	    break;
       }
             
@@ -358,6 +449,8 @@ int pkgAcqMethod::Run(bool Single)
 	       Tmp->LastModified = 0;
 	    Tmp->IndexFile = StringToBool(LookupTag(Message,"Index-File"),false);
 	    Tmp->FailIgnore = StringToBool(LookupTag(Message,"Fail-Ignore"),false);
+	    Tmp->ExpectedSize = strtoull(LookupTag(Message,"Expected-Size","0").c_str(),NULL,10);
+	    Tmp->DecompressFilename = LookupTag(Message,"Decompress-Filename");
 	    Tmp->Next = 0;
 	    
 	    // Append it to the list
@@ -389,13 +482,25 @@ void pkgAcqMethod::PrintStatus(char const * const header, const char* Format,
    string CurrentURI = "<UNKNOWN>";
    if (Queue != 0)
       CurrentURI = Queue->Uri;
-   if (UsedMirror.empty() == true)
-      fprintf(stdout, "%s\nURI: %s\nMessage: ",
-	      header, CurrentURI.c_str());
-   else
-      fprintf(stdout, "%s\nURI: %s\nUsedMirror: %s\nMessage: ",
-	      header, CurrentURI.c_str(), UsedMirror.c_str());
-   vfprintf(stdout,Format,args);
+   std::cout << header << "\nURI: " << CurrentURI << "\n";
+   if (UsedMirror.empty() == false)
+      std::cout << "UsedMirror: " << UsedMirror << "\n";
+
+   // the message goes through std::cout, as it might be framed
+   std::cout << "Message: ";
+   va_list Copy;
+   va_copy(Copy, args);
+   char Small[1024];
+   int const Length = vsnprintf(Small, sizeof(Small), Format, Copy);
+   va_end(Copy);
+   if (Length >= 0 && Length < (int) sizeof(Small))
+      std::cout << Small;
+   else if (Length >= 0)
+   {
+      vector<char> Big(Length + 1);
+      vsnprintf(&Big[0], Big.size(), Format, args);
+      std::cout << &Big[0];
+   }
    std::cout << "\n\n" << std::flush;
 }
 									/*}}}*/
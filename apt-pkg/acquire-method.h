@@ -21,6 +21,7 @@
 #define PKGLIB_ACQUIRE_METHOD_H
 
 #include <stdarg.h>
+#include <time.h>
 
 #include <string>
 #include <vector>
@@ -44,6 +45,8 @@ class pkgAcqMethod
       time_t LastModified;
       bool IndexFile;
       bool FailIgnore;
+      unsigned long long ExpectedSize;
+      std::string DecompressFilename;
    };
    
    struct FetchResult
@@ -81,6 +84,7 @@ class pkgAcqMethod
    virtual void Fail(std::string Why, bool Transient = false);
    virtual void URIStart(FetchResult &Res);
    virtual void URIDone(FetchResult &Res,FetchResult *Alt = 0);
+   void URIDoneDecompressed(FetchResult &Res,FetchResult const &Decompressed);
 
    bool MediaFail(std::string Required,std::string Drive);
    virtual void Exit() {};
@@ -19,6 +19,7 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
 #include <apt-pkg/strutl.h>
 
 #include <iostream>
@@ -26,17 +27,265 @@
 #include <fstream>
 
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
+#include <utime.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 #include <apti18n.h>
 									/*}}}*/
 
 using namespace std;
 
+/* A file: or copy: URI handled by the worker itself instead of a method
+   process (see Acquire::In-Process). It produces the same messages as the
+   file and copy methods do, but the file is hashed (and copied) in slices,
+   so that a big file doesn't stall the other workers of the Run() loop. */
+class LocalFetch
+{
+   string Uri;
+   string DestFile;
+   time_t LastModified;
+   bool Copy;
+   bool IMSHit;
+   struct stat Buf;
+   FileFd From;
+   FileFd To;
+   Hashes Hash;
+
+   bool Open(vector<string> &Messages);
+   bool Transfer(vector<string> &Messages);
+   string Result(char const * const Prefix, string const &Filename,
+		 struct stat const &St, bool const Hit, bool const WithHashes);
+
+   public:
+   /** \brief do the next slice of the work
+    *
+    *  \return \b true if the item is finished and its 201 URI Done or
+    *  400 URI Failure message was added to Messages
+    */
+   bool Step(vector<string> &Messages);
+
+   LocalFetch(string const &Message);
+   ~LocalFetch();
+};
+
+// The private data of a worker, behind its d pointer
+struct WorkerPrivate
+{
+   // The method understands binary frames, see Acquire::Binary-Framing
+   bool Framed;
+
+   // The method is run in-process, see LocalFetch
+   bool InProcess;
+   // Write end of the pipe which keeps InFd readable while there is work
+   int Wakeup;
+   bool Awake;
+   vector<string> Acquires;
+   LocalFetch *Fetch;
+
+   string Outgoing(string const &Message) const
+   {
+      return (Framed == true) ? FrameMessage(Message) : Message;
+   }
+
+   WorkerPrivate() : Framed(false), InProcess(false), Wakeup(-1), Awake(false), Fetch(0) {};
+   ~WorkerPrivate()
+   {
+      delete Fetch;
+      if (Wakeup != -1)
+	 close(Wakeup);
+   }
+};
+
+// LocalFetch::LocalFetch - Constructor					/*{{{*/
+// ---------------------------------------------------------------------
+/* Takes the 600 URI Acquire message the method would have got */
+LocalFetch::LocalFetch(string const &Message) : LastModified(0), Copy(false), IMSHit(false)
+{
+   Uri = LookupTag(Message,"URI");
+   DestFile = LookupTag(Message,"Filename");
+   if (RFC1123StrToTime(LookupTag(Message,"Last-Modified").c_str(),LastModified) == false)
+      LastModified = 0;
+}
+									/*}}}*/
+// LocalFetch::~LocalFetch - Destructor					/*{{{*/
+// ---------------------------------------------------------------------
+/* An unfinished copy is removed, the file method keeps nothing open */
+LocalFetch::~LocalFetch()
+{
+   if (To.IsOpen() == true)
+      To.OpFail();
+}
+									/*}}}*/
+// LocalFetch::Step - Do the next slice of the work			/*{{{*/
+// ---------------------------------------------------------------------
+/* Errors are reported as a 400 URI Failure like the methods would do */
+bool LocalFetch::Step(vector<string> &Messages)
+{
+   _error->PushToStack();
+   bool const Finished = (From.IsOpen() == false) ? Open(Messages) : Transfer(Messages);
+   if (_error->PendingError() == false)
+   {
+      _error->MergeWithStack();
+      return Finished;
+   }
+
+   string Err = "Undetermined Error";
+   _error->PopMessage(Err);
+   _error->RevertToStack();
+   for (string::iterator I = Err.begin(); I != Err.end(); ++I)
+      if (*I == '\r' || *I == '\n')
+	 *I = ' ';
+   if (To.IsOpen() == true)
+   {
+      To.OpFail();
+      To.Close();
+   }
+   Messages.push_back("400 URI Failure\nURI: " + Uri + "\nMessage: " + Err);
+   return true;
+}
+									/*}}}*/
+// LocalFetch::Open - Start working on the item				/*{{{*/
+// ---------------------------------------------------------------------
+/* This is what the Fetch() of the file and copy methods do before they
+   read the file. */
+bool LocalFetch::Open(vector<string> &Messages)
+{
+   URI const Get = Uri;
+   string File = Get.Path;
+   Copy = (Get.Access == "copy");
+
+   if (Copy == true)
+   {
+      if (stat(File.c_str(),&Buf) != 0)
+	 return _error->Errno("stat",_("Failed to stat"));
+
+      string Start = "200 URI Start\nURI: " + Uri;
+      if (Buf.st_size != 0)
+	 strprintf(Start, "%s\nSize: %llu", Start.c_str(), (unsigned long long) Buf.st_size);
+      if (Buf.st_mtime != 0)
+	 Start += "\nLast-Modified: " + TimeRFC1123(Buf.st_mtime);
+      Messages.push_back(Start);
+
+      if (From.Open(File,FileFd::ReadOnly) == false ||
+	  To.Open(DestFile,FileFd::WriteAtomic) == false)
+	 return false;
+      To.EraseOnFailure();
+
+#ifdef FICLONE
+      // share the blocks if the filesystem can, only the hashes are left then
+      if (ioctl(To.Fd(),FICLONE,From.Fd()) == 0)
+	 To.Close();
+#endif
+      return false;
+   }
+
+   if (Get.Host.empty() == false)
+      return _error->Error(_("Invalid URI, local URIS must not start with //"));
+
+   // See if the file exists
+   string Res;
+   if (stat(File.c_str(),&Buf) == 0)
+   {
+      IMSHit = (LastModified == Buf.st_mtime && LastModified != 0);
+      Res = Result("", File, Buf, IMSHit, false);
+   }
+
+   // See if we can compute a file without a .gz exentsion
+   string::size_type const Pos = File.rfind(".gz");
+   if (Pos + 3 == File.length())
+   {
+      struct stat Alt;
+      File = string(File,0,Pos);
+      if (stat(File.c_str(),&Alt) == 0)
+      {
+	 Messages.push_back("201 URI Done\nURI: " + Uri + Res +
+			    Result("Alt-", File, Alt, LastModified == Alt.st_mtime && LastModified != 0, false));
+	 return true;
+      }
+      File = Get.Path;
+   }
+
+   if (Res.empty() == true)
+      return _error->Error(_("File not found"));
+
+   DestFile = File;
+   From.Open(File,FileFd::ReadOnly);
+   return false;
+}
+									/*}}}*/
+// LocalFetch::Transfer - Hash and copy the next slice of the file	/*{{{*/
+// ---------------------------------------------------------------------
+/* The copy is hashed while it is written, the copy method instead read
+   the file a second time for it. */
+bool LocalFetch::Transfer(vector<string> &Messages)
+{
+   unsigned char Buffer[64*1024];
+   for (unsigned int Slice = 0; Slice < 16; ++Slice)
+   {
+      unsigned long long Actual = 0;
+      if (From.Read(Buffer,sizeof(Buffer),&Actual) == false)
+	 return false;
+      if (Actual == 0)
+      {
+	 From.Close();
+	 if (Copy == false)
+	 {
+	    Messages.push_back("201 URI Done\nURI: " + Uri + Result("", DestFile, Buf, IMSHit, true));
+	    return true;
+	 }
+	 if (To.IsOpen() == true && To.Close() == false)
+	    return false;
+
+	 // Transfer the modification times
+	 struct utimbuf TimeBuf;
+	 TimeBuf.actime = Buf.st_atime;
+	 TimeBuf.modtime = Buf.st_mtime;
+	 if (utime(DestFile.c_str(),&TimeBuf) != 0)
+	    return _error->Errno("utime",_("Failed to set modification time"));
+	 Messages.push_back("201 URI Done\nURI: " + Uri + Result("", DestFile, Buf, IMSHit, true));
+	 return true;
+      }
+      Hash.Add(Buffer,Actual);
+      if (To.IsOpen() == true && To.Write(Buffer,Actual) == false)
+	 return false;
+   }
+   return false;
+}
+									/*}}}*/
+// LocalFetch::Result - The fields of a FetchResult			/*{{{*/
+// ---------------------------------------------------------------------
+/* The hashes can only be given once the whole file was read */
+string LocalFetch::Result(char const * const Prefix, string const &Filename,
+			  struct stat const &St, bool const Hit, bool const WithHashes)
+{
+   string const P = Prefix;
+   string Res = "\n" + P + "Filename: " + Filename;
+   if (St.st_size != 0)
+      strprintf(Res, "%s\n%sSize: %llu", Res.c_str(), Prefix, (unsigned long long) St.st_size);
+   if (St.st_mtime != 0)
+      Res += "\n" + P + "Last-Modified: " + TimeRFC1123(St.st_mtime);
+   if (WithHashes == true)
+   {
+      string const MD5 = Hash.MD5.Result();
+      Res += "\nMD5-Hash: " + MD5 + "\nMD5Sum-Hash: " + MD5 +
+	     "\nSHA1-Hash: " + Hash.SHA1.Result().Value() +
+	     "\nSHA256-Hash: " + Hash.SHA256.Result().Value() +
+	     "\nSHA512-Hash: " + Hash.SHA512.Result().Value();
+   }
+   if (Hit == true)
+      Res += "\n" + P + "IMS-Hit: true";
+   return Res;
+}
+									/*}}}*/
+
 // Worker::Worker - Constructor for Queue startup			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -73,6 +322,7 @@ pkgAcquire::Worker::Worker(MethodConfig *Cnf)
 /* */
 void pkgAcquire::Worker::Construct()
 {
+   d = new WorkerPrivate;
    NextQueue = 0;
    NextAcquire = 0;
    Process = -1;
@@ -88,6 +338,7 @@ void pkgAcquire::Worker::Construct()
 /* */
 pkgAcquire::Worker::~Worker()
 {
+   delete static_cast<WorkerPrivate *>(d);
    close(InFd);
    close(OutFd);
    
@@ -103,9 +354,39 @@ pkgAcquire::Worker::~Worker()
 									/*}}}*/
 // Worker::Start - Start the worker process				/*{{{*/
 // ---------------------------------------------------------------------
-/* This forks the method and inits the communication channel */
+/* This forks the method and inits the communication channel. The file
+   and copy methods can be handled in-process instead, see LocalFetch. */
 bool pkgAcquire::Worker::Start()
 {
+   WorkerPrivate * const Priv = static_cast<WorkerPrivate *>(d);
+   if ((Access == "file" || Access == "copy") &&
+       _config->FindB("Acquire::In-Process",false) == true)
+   {
+      if (Debug == true)
+	 clog << "Handling method '" << Access << "' in-process" << endl;
+
+      int Pipes[2];
+      if (pipe(Pipes) != 0)
+	 return _error->Errno("pipe","Failed to create IPC pipe to subprocess");
+      for (int I = 0; I != 2; I++)
+      {
+	 SetCloseExec(Pipes[I],true);
+	 SetNonBlock(Pipes[I],true);
+      }
+      InFd = Pipes[0];
+      Priv->Wakeup = Pipes[1];
+      Priv->InProcess = true;
+      OutReady = false;
+      InReady = true;
+
+      /* the capabilities of the real methods, but as the items are
+         queued here anyway they can be handed in as a pipeline */
+      MessageQueue.push_back("100 Capabilities\nVersion: 1.0\nSingle-Instance: true\nPipeline: true");
+      if (Access == "file")
+	 MessageQueue.back().append("\nLocal-Only: true");
+      return RunMessages();
+   }
+
    // Get the method path
    string Method = _config->FindDir("Dir::Bin::Methods") + Access;
    if (FileExists(Method) == false)
@@ -172,6 +453,36 @@ bool pkgAcquire::Worker::Start()
 /* */
 bool pkgAcquire::Worker::ReadMessages()
 {
+   WorkerPrivate * const Priv = static_cast<WorkerPrivate *>(d);
+   if (Priv->InProcess == true)
+   {
+      /* small files are finished in one step, so do a few of them, but
+         return to the Run() loop as soon as a step used its whole slice */
+      for (unsigned int Done = 0; Done < 16; ++Done)
+      {
+	 if (Priv->Fetch == 0)
+	 {
+	    if (Priv->Acquires.empty() == true)
+	       break;
+	    Priv->Fetch = new LocalFetch(Priv->Acquires.front());
+	    Priv->Acquires.erase(Priv->Acquires.begin());
+	 }
+	 if (Priv->Fetch->Step(MessageQueue) == false)
+	    break;
+	 delete Priv->Fetch;
+	 Priv->Fetch = 0;
+      }
+
+      // nothing left to do, so InFd shouldn't be readable anymore
+      if (Priv->Fetch == 0 && Priv->Acquires.empty() == true)
+      {
+	 char Buffer[16];
+	 while (read(InFd,Buffer,sizeof(Buffer)) > 0);
+	 Priv->Awake = false;
+      }
+      return true;
+   }
+
    if (::ReadMessages(InFd,MessageQueue) == false)
       return MethodFailure();
    return true;
@@ -394,6 +705,9 @@ bool pkgAcquire::Worker::Capabilities(string Message)
    Config->LocalOnly = StringToBool(LookupTag(Message,"Local-Only"),false);
    Config->NeedsCleanup = StringToBool(LookupTag(Message,"Needs-Cleanup"),false);
    Config->Removable = StringToBool(LookupTag(Message,"Removable"),false);
+   static_cast<WorkerPrivate *>(d)->Framed =
+      StringToBool(LookupTag(Message,"Binary-Framing"),false) == true &&
+      _config->FindB("Acquire::Binary-Framing",false) == true;
 
    // Some debug text
    if (Debug == true)
@@ -405,7 +719,8 @@ bool pkgAcquire::Worker::Capabilities(string Message)
 	      " SendConfig:" << Config->SendConfig << 
 	      " LocalOnly: " << Config->LocalOnly << 
 	      " NeedsCleanup: " << Config->NeedsCleanup << 
-	      " Removable: " << Config->Removable << endl;
+	      " Removable: " << Config->Removable <<
+	      " BinaryFraming: " << static_cast<WorkerPrivate *>(d)->Framed << endl;
    }
    
    return true;
@@ -441,7 +756,7 @@ bool pkgAcquire::Worker::MediaChange(string Message)
       snprintf(S,sizeof(S),"603 Media Changed\nFailed: true\n\n");
       if (Debug == true)
 	 clog << " -> " << Access << ':' << QuoteString(S,"\n") << endl;
-      OutQueue += S;
+      OutQueue += static_cast<WorkerPrivate *>(d)->Outgoing(S);
       OutReady = true;
       return true;
    }
@@ -450,7 +765,7 @@ bool pkgAcquire::Worker::MediaChange(string Message)
    snprintf(S,sizeof(S),"603 Media Changed\n\n");
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(S,"\n") << endl;
-   OutQueue += S;
+   OutQueue += static_cast<WorkerPrivate *>(d)->Outgoing(S);
    OutReady = true;
    return true;
 }
@@ -496,7 +811,7 @@ bool pkgAcquire::Worker::SendConfiguration()
 
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(Message,"\n") << endl;
-   OutQueue += Message;
+   OutQueue += static_cast<WorkerPrivate *>(d)->Outgoing(Message);
    OutReady = true; 
    
    return true;
@@ -507,19 +822,36 @@ bool pkgAcquire::Worker::SendConfiguration()
 /* Send a URI Acquire message to the method */
 bool pkgAcquire::Worker::QueueItem(pkgAcquire::Queue::QItem *Item)
 {
-   if (OutFd == -1)
+   WorkerPrivate * const Priv = static_cast<WorkerPrivate *>(d);
+   if (OutFd == -1 && Priv->InProcess == false)
       return false;
    
    string Message = "600 URI Acquire\n";
    Message.reserve(300);
    Message += "URI: " + Item->URI;
    Message += "\nFilename: " + Item->Owner->DestFile;
+   if (Item->Owner->FileSize != 0)
+   {
+      char Size[50];
+      snprintf(Size,sizeof(Size),"\nExpected-Size: %llu",Item->Owner->FileSize);
+      Message += Size;
+   }
    Message += Item->Owner->Custom600Headers();
    Message += "\n\n";
    
    if (Debug == true)
       clog << " -> " << Access << ':' << QuoteString(Message,"\n") << endl;
-   OutQueue += Message;
+
+   // wake up the Run() loop, which does the work via ReadMessages()
+   if (Priv->InProcess == true)
+   {
+      Priv->Acquires.push_back(Message);
+      if (Priv->Awake == false && write(Priv->Wakeup,"",1) == 1)
+	 Priv->Awake = true;
+      return true;
+   }
+
+   OutQueue += Priv->Outgoing(Message);
    OutReady = true;
    
    return true;
@@ -22,13 +22,17 @@
 #include <apt-pkg/error.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/fdpoller.h>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <vector>
 #include <stdio.h>
 
 #include <dirent.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <errno.h>
 
 #include <apti18n.h>
@@ -36,6 +40,17 @@
 
 using namespace std;
 
+/* The method processes kept alive for later runs, see Acquire::Idle-Methods.
+   They own a copy of the configuration of their method as the one of the
+   pkgAcquire object which started them is gone with it. */
+struct IdleWorker
+{
+   string Queue;
+   pkgAcquire::Worker *Work;
+   pkgAcquire::MethodConfig *Config;
+};
+static vector<IdleWorker> IdleWorkers;
+
 // Acquire::pkgAcquire - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* We grab some runtime state from the configuration space */
@@ -133,6 +148,19 @@ void pkgAcquire::Shutdown()
    }   
 }
 									/*}}}*/
+// Acquire::StopIdleWorkers - Stop the methods kept for later runs	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgAcquire::StopIdleWorkers()
+{
+   for (vector<IdleWorker>::const_iterator I = IdleWorkers.begin(); I != IdleWorkers.end(); ++I)
+   {
+      delete I->Work;
+      delete I->Config;
+   }
+   IdleWorkers.clear();
+}
+									/*}}}*/
 // Acquire::Add - Add a new item					/*{{{*/
 // ---------------------------------------------------------------------
 /* This puts an item on the acquire list. This list is mainly for tracking
@@ -293,10 +321,22 @@ pkgAcquire::MethodConfig *pkgAcquire::GetConfig(string Access)
    Conf->Next = Configs;
    Configs = Conf;
 
-   // Create the worker to fetch the configuration
-   Worker Work(Conf);
-   if (Work.Start() == false)
-      return 0;
+   // An idle method of an earlier run can tell us the configuration
+   vector<IdleWorker>::const_iterator Idle = IdleWorkers.begin();
+   for (; Idle != IdleWorkers.end() && Idle->Config->Access != Access; ++Idle);
+   if (Idle != IdleWorkers.end())
+   {
+      MethodConfig * const Next = Conf->Next;
+      *Conf = *Idle->Config;
+      Conf->Next = Next;
+   }
+   else
+   {
+      // Create the worker to fetch the configuration
+      Worker Work(Conf);
+      if (Work.Start() == false)
+	 return 0;
+   }
 
    /* if a method uses DownloadLimit, we switch to SingleInstance mode */
    if(_config->FindI("Acquire::"+Access+"::Dl-Limit",0) > 0)
@@ -307,7 +347,8 @@ pkgAcquire::MethodConfig *pkgAcquire::GetConfig(string Access)
 									/*}}}*/
 // Acquire::SetFds - Deal with readable FDs				/*{{{*/
 // ---------------------------------------------------------------------
-/* Collect FDs that have activity monitors into the fd sets */
+/* Collect FDs that have activity monitors into the fd sets. Run() uses
+   an FdPoller instead, this is kept for users with their own select loop. */
 void pkgAcquire::SetFds(int &Fd,fd_set *RSet,fd_set *WSet)
 {
    for (Worker *I = Workers; I != 0; I = I->NextAcquire)
@@ -345,9 +386,11 @@ void pkgAcquire::RunFds(fd_set *RSet,fd_set *WSet)
 									/*}}}*/
 // Acquire::Run - Run the fetch sequence				/*{{{*/
 // ---------------------------------------------------------------------
-/* This runs the queues. It manages a select loop for all of the
+/* This runs the queues. It manages a poll loop for all of the
    Worker tasks. The workers interact with the queues and items to
-   manage the actual fetch. */
+   manage the actual fetch. The descriptors of the workers are watched
+   with an FdPoller (epoll if possible) as a select() loop doesn't scale
+   to a lot of workers and breaks for descriptors beyond FD_SETSIZE. */
 pkgAcquire::RunResult pkgAcquire::Run(int PulseIntervall)
 {
    Running = true;
@@ -361,39 +404,52 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseIntervall)
    bool WasCancelled = false;
 
    // Run till all things have been acquired
-   struct timeval tv;
-   tv.tv_sec = 0;
-   tv.tv_usec = PulseIntervall; 
+   FdPoller Poller;
+   struct timeval NextPulse;
+   gettimeofday(&NextPulse,0);
+   NextPulse.tv_sec += (NextPulse.tv_usec + PulseIntervall) / 1000000;
+   NextPulse.tv_usec = (NextPulse.tv_usec + PulseIntervall) % 1000000;
    while (ToFetch > 0)
    {
-      fd_set RFds;
-      fd_set WFds;
-      int Highest = 0;
-      FD_ZERO(&RFds);
-      FD_ZERO(&WFds);
-      SetFds(Highest,&RFds,&WFds);
-      
-      int Res;
-      do
+      /* The pid of the method tells the descriptors of a dead worker and
+         its replacement apart even if they got the same numbers */
+      for (Worker *I = Workers; I != 0; I = I->NextAcquire)
       {
-	 Res = select(Highest+1,&RFds,&WFds,0,&tv);
+	 if (I->InReady == true)
+	    Poller.Watch(I->InFd,FdPoller::Read,I->Process);
+	 if (I->OutReady == true)
+	    Poller.Watch(I->OutFd,FdPoller::Write,I->Process);
       }
-      while (Res < 0 && errno == EINTR);
-      
+
+      struct timeval Now;
+      gettimeofday(&Now,0);
+      long long const Remaining = (NextPulse.tv_sec - Now.tv_sec) * 1000000LL +
+				  (NextPulse.tv_usec - Now.tv_usec);
+      int const Res = Poller.Wait(Remaining <= 0 ? 0 : (Remaining + 999) / 1000);
       if (Res < 0)
       {
-	 _error->Errno("select","Select has failed");
+	 _error->Errno("poll","Poll has failed");
 	 break;
       }
-	     
-      RunFds(&RFds,&WFds);
+
+      /* Dispatch active FDs over to the proper workers. It is very important
+         that a worker never be erased while this is running! */
+      for (Worker *I = Workers; I != 0; I = I->NextAcquire)
+      {
+	 if (I->InFd >= 0 && (Poller.Ready(I->InFd) & FdPoller::Read) != 0)
+	    I->InFdReady();
+	 if (I->OutFd >= 0 && (Poller.Ready(I->OutFd) & FdPoller::Write) != 0)
+	    I->OutFdReady();
+      }
       if (_error->PendingError() == true)
 	 break;
       
       // Timeout, notify the log class
-      if (Res == 0 || (Log != 0 && Log->Update == true))
+      gettimeofday(&Now,0);
+      if (Res == 0 || timercmp(&Now,&NextPulse,>) || (Log != 0 && Log->Update == true))
       {
-	 tv.tv_usec = PulseIntervall;
+	 NextPulse.tv_sec = Now.tv_sec + (Now.tv_usec + PulseIntervall) / 1000000;
+	 NextPulse.tv_usec = (Now.tv_usec + PulseIntervall) % 1000000;
 	 for (Worker *I = Workers; I != 0; I = I->NextAcquire)
 	    I->Pulse();
 	 if (Log != 0 && Log->Pulse(this) == false)
@@ -598,6 +654,7 @@ bool pkgAcquire::Queue::Enqueue(ItemDesc &Item)
    QItem *Itm = new QItem;
    *Itm = Item;
    Itm->Next = 0;
+   Itm->Worker = 0;
    *I = Itm;
    
    Item.Owner->QueueCounter++;   
@@ -647,9 +704,7 @@ bool pkgAcquire::Queue::Startup()
       if (Cnf == 0)
 	 return false;
       
-      Workers = new Worker(this,Cnf,Owner->Log);
-      Owner->Add(Workers);
-      if (Workers->Start() == false)
+      if (StartWorker(Cnf) == 0)
 	 return false;
       
       /* When pipelining we commit 10 items. This needs to change when we
@@ -679,7 +734,8 @@ bool pkgAcquire::Queue::Shutdown(bool Final)
       {
 	 *Cur = Jnk->NextQueue;
 	 Owner->Remove(Jnk);
-	 delete Jnk;
+	 if (KeepWorker(Jnk) == false)
+	    delete Jnk;
       }
       else
 	 Cur = &(*Cur)->NextQueue;      
@@ -724,7 +780,10 @@ bool pkgAcquire::Queue::ItemDone(QItem *Itm)
 // Queue::Cycle - Queue new items into the method			/*{{{*/
 // ---------------------------------------------------------------------
 /* This locates a new idle item and sends it to the worker. If pipelining
-   is enabled then it keeps the pipe full. */
+   is enabled then it keeps the pipe full. With more than one connection
+   per host each item goes to the worker with the fewest items in flight
+   and more workers are started (up to Max-Connections-Per-Host) as long
+   as all existing ones are busy. */
 bool pkgAcquire::Queue::Cycle()
 {
    if (Items == 0 || Workers == 0)
@@ -732,10 +791,31 @@ bool pkgAcquire::Queue::Cycle()
 
    if (PipeDepth < 0)
       return _error->Error("Pipedepth failure");
-			   
+
+   std::vector<pkgAcquire::Worker *> Conns;
+   std::vector<unsigned long> Depth;
+   for (pkgAcquire::Worker *W = Workers; W != 0; W = W->NextQueue)
+   {
+      Conns.push_back(W);
+      Depth.push_back(0);
+   }
+   if (Conns.size() == 1)
+      Depth[0] = PipeDepth;
+   else
+      for (QItem *I = Items; I != 0; I = I->Next)
+      {
+	 if (I->Owner->Status != pkgAcquire::Item::StatFetching)
+	    continue;
+	 std::vector<pkgAcquire::Worker *>::const_iterator const C =
+	    std::find(Conns.begin(), Conns.end(), I->Worker);
+	 if (C != Conns.end())
+	    ++Depth[C - Conns.begin()];
+      }
+   unsigned long MaxConns = 0;
+
    // Look for a queable item
    QItem *I = Items;
-   while (PipeDepth < (signed)MaxPipeDepth)
+   while (true)
    {
       for (; I != 0; I = I->Next)
 	 if (I->Owner->Status == pkgAcquire::Item::StatIdle)
@@ -744,17 +824,148 @@ bool pkgAcquire::Queue::Cycle()
       // Nothing to do, queue is idle.
       if (I == 0)
 	 return true;
+
+      size_t Target = std::min_element(Depth.begin(), Depth.end()) - Depth.begin();
+      if (Depth[Target] != 0)
+      {
+	 if (MaxConns == 0)
+	    MaxConns = MaxConnections();
+	 if (Conns.size() < MaxConns)
+	 {
+	    pkgAcquire::Worker *W = StartWorker(Owner->GetConfig(URI(Name).Access));
+	    if (W == 0)
+	       return false;
+	    Target = Conns.size();
+	    Conns.push_back(W);
+	    Depth.push_back(0);
+	 }
+      }
+      if (Depth[Target] >= MaxPipeDepth)
+	 return true;
       
-      I->Worker = Workers;
+      I->Worker = Conns[Target];
       I->Owner->Status = pkgAcquire::Item::StatFetching;
       PipeDepth++;
-      if (Workers->QueueItem(I) == false)
+      Depth[Target]++;
+      if (I->Worker->QueueItem(I) == false)
 	 return false;
    }
    
    return true;
 }
 									/*}}}*/
+// Queue::MaxConnections - Number of workers this queue may use		/*{{{*/
+// ---------------------------------------------------------------------
+/* Only queues for a single host can open more connections to it, all
+   items of single instance methods go through one worker anyway. */
+unsigned long pkgAcquire::Queue::MaxConnections() const
+{
+   if (Owner->QueueMode != pkgAcquire::QueueHost || Workers == 0 ||
+       Workers->GetConf()->SingleInstance == true)
+      return 1;
+   URI const U(Name);
+   int const Max = _config->FindI(("Acquire::" + U.Access + "::Max-Connections-Per-Host").c_str(), 1);
+   return Max < 1 ? 1 : Max;
+}
+									/*}}}*/
+// Queue::StartWorker - Start a new or reuse an idle worker		/*{{{*/
+// ---------------------------------------------------------------------
+/* Idle workers whose method has died in between are dropped. A reused
+   worker gets the configuration again as it might have changed. */
+pkgAcquire::Worker *pkgAcquire::Queue::StartWorker(MethodConfig *Cnf)
+{
+   for (vector<IdleWorker>::iterator I = IdleWorkers.begin(); I != IdleWorkers.end();)
+   {
+      if (waitpid(I->Work->Process,0,WNOHANG) == 0)
+      {
+	 ++I;
+	 continue;
+      }
+      I->Work->Process = -1;
+      delete I->Work;
+      delete I->Config;
+      I = IdleWorkers.erase(I);
+   }
+
+   pkgAcquire::Worker *Work = 0;
+   vector<IdleWorker>::iterator Idle = IdleWorkers.end();
+   for (vector<IdleWorker>::iterator I = IdleWorkers.begin(); I != IdleWorkers.end(); ++I)
+      if (I->Work->Access == Cnf->Access && (Idle == IdleWorkers.end() || I->Queue == Name))
+	 Idle = I;
+
+   if (Idle != IdleWorkers.end())
+   {
+      Work = Idle->Work;
+      delete Idle->Config;
+      IdleWorkers.erase(Idle);
+
+      Work->OwnerQ = this;
+      Work->Config = Cnf;
+      Work->Log = Owner->Log;
+      Work->Debug = _config->FindB("Debug::pkgAcquire::Worker",false);
+      Work->NextQueue = 0;
+      if (Work->Debug == true)
+	 clog << "Reusing method '" << Work->Access << "' for " << Name << endl;
+   }
+   else
+      Work = new Worker(this,Cnf,Owner->Log);
+
+   Owner->Add(Work);
+   pkgAcquire::Worker **Last = &Workers;
+   while (*Last != 0)
+      Last = &(*Last)->NextQueue;
+   *Last = Work;
+
+   if (Work->Process > 0)
+      return Work->SendConfiguration() == true ? Work : 0;
+   return Work->Start() == true ? Work : 0;
+}
+									/*}}}*/
+// Queue::KeepWorker - Keep an idle worker for later runs		/*{{{*/
+// ---------------------------------------------------------------------
+/* Only workers which are really idle are kept: no items are assigned to
+   them and nothing is waiting to be sent. Methods which need cleanup or
+   deal with removable media are always stopped. */
+bool pkgAcquire::Queue::KeepWorker(pkgAcquire::Worker *Work)
+{
+   int const Max = _config->FindI("Acquire::Idle-Methods",0);
+   if (Max <= 0 || Work->Process <= 0 || Work->InFd == -1 || Work->OutFd == -1 ||
+       Work->CurrentItem != 0 || Work->OutQueue.empty() == false ||
+       Work->MessageQueue.empty() == false || Work->Config == 0 ||
+       Work->Config->NeedsCleanup == true || Work->Config->Removable == true)
+      return false;
+   for (QItem *I = Items; I != 0; I = I->Next)
+      if (I->Worker == Work)
+	 return false;
+
+   IdleWorker Idle;
+   Idle.Queue = Name;
+   Idle.Work = Work;
+   Idle.Config = new MethodConfig(*Work->Config);
+   Idle.Config->Next = 0;
+   Work->Config = Idle.Config;
+   Work->OwnerQ = 0;
+   Work->Log = 0;
+   Work->NextQueue = 0;
+   Work->NextAcquire = 0;
+   Work->Status.clear();
+   Work->CurrentSize = 0;
+   Work->TotalSize = 0;
+   Work->ResumePoint = 0;
+
+   if ((signed) IdleWorkers.size() >= Max)
+   {
+      delete IdleWorkers.front().Work;
+      delete IdleWorkers.front().Config;
+      IdleWorkers.erase(IdleWorkers.begin());
+   }
+   IdleWorkers.push_back(Idle);
+
+   if (Work->Debug == true)
+      clog << "Keeping method '" << Work->Access << "' of " << Name << " for later runs" << endl;
+   return true;
+}
+									/*}}}*/
 // Queue::Bump - Fetch any pending objects if we are idle		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is called when an item in multiple queues is dequeued */
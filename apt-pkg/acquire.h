@@ -209,7 +209,8 @@ class pkgAcquire
     *  block.
     *
     *  The default implementation inserts the file descriptors
-    *  corresponding to active downloads.
+    *  corresponding to active downloads. Run() doesn't use it anymore
+    *  as it watches the workers with an FdPoller.
     *
     *  \param[out] Fd The largest file descriptor in the generated sets.
     *
@@ -223,7 +224,8 @@ class pkgAcquire
 
    /** Handle input from and output to file descriptors which select()
     *  has determined are ready.  The default implementation
-    *  dispatches to all active downloads.
+    *  dispatches to all active downloads. Like SetFds() it isn't used
+    *  by Run() anymore.
     *
     *  \param RSet The set of file descriptors that are ready for
     *  input.
@@ -281,6 +283,11 @@ class pkgAcquire
     *  all download workers, and empty all queues.
     */
    void Shutdown();
+
+   /** \brief Terminate all method processes kept for later runs
+    *  because of Acquire::Idle-Methods.
+    */
+   static void StopIdleWorkers();
    
    /** \brief Get the first #Worker object.
     *
@@ -519,9 +526,40 @@ class pkgAcquire::Queue
    /** \brief Send idle items to the worker process.
     *
     *  Fills up the pipeline by inserting idle items into the worker's queue.
+    *  If all workers are busy and Acquire::<access>::Max-Connections-Per-Host
+    *  allows it another worker is started, so that the items are spread
+    *  over multiple connections to the host.
     */
    bool Cycle();
 
+   /** \return the number of workers (and so connections) this queue
+    *  is allowed to use.
+    */
+   unsigned long MaxConnections() const;
+
+   /** \brief Get another worker for this queue.
+    *
+    *  If Acquire::Idle-Methods allows it, an idle method process kept
+    *  from an earlier run (preferably one which talked to the same host)
+    *  is reused, otherwise a new one is started. The worker is added to
+    *  #Workers and to the pkgAcquire object.
+    *
+    *  \return the worker or \b NULL if it could not be started.
+    */
+   pkgAcquire::Worker *StartWorker(MethodConfig *Config);
+
+   /** \brief Keep an idle worker for later runs.
+    *
+    *  Up to Acquire::Idle-Methods workers without any items in flight
+    *  are kept alive (with their connections) after they were removed
+    *  from the queue, so that later runs (of any pkgAcquire object in
+    *  this process) don't have to start new method processes.
+    *
+    *  \return \b true if the worker was kept, otherwise it has to be
+    *  deleted by the caller.
+    */
+   bool KeepWorker(pkgAcquire::Worker *Work);
+
    /** \brief Check for items that could be enqueued.
     *
     *  Call this after an item placed in multiple queues has gone from
@@ -30,6 +30,8 @@
 #include <sys/types.h>
 #include <cstdlib>
 #include <algorithm>
+#include <functional>
+#include <vector>
 #include <iostream>
 #include <stdio.h>
 
@@ -758,6 +760,23 @@ bool pkgProblemResolver::Resolve(bool BrokenFix)
    return ResolveInternal(BrokenFix);
 }
 									/*}}}*/
+// ProblemResolver::NeedsResolving - Has ResolveInternal to look at it	/*{{{*/
+// ---------------------------------------------------------------------
+/* True if the package is broken or could be re-instated, all other
+   packages are skipped by the resolution pass anyway. */
+bool pkgProblemResolver::NeedsResolving(pkgCache::PkgIterator const &Pkg)
+{
+   if (Cache[Pkg].InstallVer == 0)
+      return false;
+   if (Cache[Pkg].InstBroken() == true)
+      return true;
+   return Cache[Pkg].CandidateVer != Cache[Pkg].InstallVer &&
+	  Pkg->CurrentVer != 0 &&
+	  (Flags[Pkg->ID] & PreInstalled) != 0 &&
+	  (Flags[Pkg->ID] & Protected) == 0 &&
+	  (Flags[Pkg->ID] & ReInstateTried) == 0;
+}
+									/*}}}*/
 // ProblemResolver::ResolveInternal - Run the resolution pass		/*{{{*/
 // ---------------------------------------------------------------------
 /* This routines works by calculating a score for each package. The score
@@ -833,6 +852,27 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
    if (Debug == true)
       clog << "Starting 2" << endl;
 
+   /* Only the packages which need resolving have something to do in a
+      pass. They are searched once, later only the packages whose state was
+      changed by the resolver are checked again and queued: in this pass if
+      they are still ahead in PList, otherwise in the next one. The queues
+      are heaps of positions in PList, so the order is still by score. */
+   std::vector<unsigned long> Position(Size);
+   std::vector<int> QueuedIn(Size, -1);
+   std::vector<unsigned long> Pass;
+   std::vector<unsigned long> NextPass;
+   for (pkgCache::Package **K = PList; K != PEnd; K++)
+   {
+      Position[(*K)->ID] = K - PList;
+      if (NeedsResolving(pkgCache::PkgIterator(Cache,*K)) == false)
+	 continue;
+      Pass.push_back(K - PList);
+      QueuedIn[(*K)->ID] = 0;
+   }
+   std::make_heap(Pass.begin(), Pass.end(), std::greater<unsigned long>());
+   std::vector<map_ptrloc> Changes;
+   Cache.RecordChanges(&Changes);
+
    /* Now consider all broken packages. For each broken package we either
       remove the package or fix it's problem. We do this once, it should
       not be possible for a loop to form (that is a < b < c and fixing b by
@@ -842,9 +882,36 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
    for (int Counter = 0; Counter != 10 && Change == true; Counter++)
    {
       Change = false;
-      for (pkgCache::Package **K = PList; K != PEnd; K++)
+      pkgCache::Package *Last = 0;
+      unsigned long Current = 0;
+      while (true)
       {
-	 pkgCache::PkgIterator I(Cache,*K);
+	 // the last package itself could still be broken
+	 if (Last != 0)
+	    Changes.push_back(Last->ID);
+	 for (std::vector<map_ptrloc>::const_iterator C = Changes.begin(); C != Changes.end(); ++C)
+	 {
+	    bool const Ahead = Last != 0 && Position[*C] > Current;
+	    int const In = Ahead == true ? Counter : Counter + 1;
+	    if (QueuedIn[*C] == In ||
+		NeedsResolving(pkgCache::PkgIterator(Cache,PList[Position[*C]])) == false)
+	       continue;
+	    QueuedIn[*C] = In;
+	    std::vector<unsigned long> &Queue = Ahead == true ? Pass : NextPass;
+	    Queue.push_back(Position[*C]);
+	    std::push_heap(Queue.begin(), Queue.end(), std::greater<unsigned long>());
+	 }
+	 Changes.clear();
+
+	 if (Pass.empty() == true)
+	    break;
+	 std::pop_heap(Pass.begin(), Pass.end(), std::greater<unsigned long>());
+	 Current = Pass.back();
+	 Pass.pop_back();
+	 Last = PList[Current];
+	 QueuedIn[Last->ID] = -1;
+
+	 pkgCache::PkgIterator I(Cache,Last);
 
 	 /* We attempt to install this and see if any breaks result,
 	    this takes care of some strange cases */
@@ -1173,7 +1240,9 @@ bool pkgProblemResolver::ResolveInternal(bool const BrokenFix)
 	    }      
 	 }
       }      
+      Pass.swap(NextPass);
    }
+   Cache.RecordChanges(0);
 
    if (Debug == true)
       clog << "Done" << endl;
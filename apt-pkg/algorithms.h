@@ -113,6 +113,7 @@ class pkgProblemResolver						/*{{{*/
    void MakeScores();
    bool DoUpgrade(pkgCache::PkgIterator Pkg);
 
+   bool NeedsResolving(pkgCache::PkgIterator const &Pkg);
    bool ResolveInternal(bool const BrokenFix = false);
    bool ResolveByKeepInternal();
    
@@ -0,0 +1,279 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   FdPoller - Wait for activity on a set of file descriptors
+
+   See fdpoller.h for the interface. Registrations in the epoll set are
+   only changed if the interest of a caller changes, so a loop watching
+   the same descriptors over and over again only pays for the wakeups.
+   The epoll data carries the descriptor together with a generation
+   counter, so events for a registration which was dropped in between
+   (or survived a close() in another process) can be ignored.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/fdpoller.h>
+#include <apt-pkg/fileutl.h>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+									/*}}}*/
+
+// FdPoller::FdPoller - Constructor					/*{{{*/
+// ---------------------------------------------------------------------
+/* If epoll can't be used we silently fall back to poll() */
+FdPoller::FdPoller(bool const UseEpoll) : Round(1), Generation(0), EpollFd(-1)
+{
+#ifdef __linux__
+   if (UseEpoll == true)
+   {
+      EpollFd = epoll_create(64);
+      if (EpollFd != -1)
+	 SetCloseExec(EpollFd, true);
+   }
+#endif
+}
+									/*}}}*/
+// FdPoller::~FdPoller - Destructor					/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+FdPoller::~FdPoller()
+{
+   if (EpollFd != -1)
+      close(EpollFd);
+}
+									/*}}}*/
+// FdPoller::Watch - Add a descriptor to the interest set		/*{{{*/
+// ---------------------------------------------------------------------
+/* The Events of multiple calls in the same round are merged. */
+void FdPoller::Watch(int const Fd, unsigned int const Events, unsigned long const Id)
+{
+   if (Fd < 0 || Events == 0)
+      return;
+   if ((unsigned int) Fd >= Fds.size())
+   {
+      Watched const Empty = { 0, 0, 0, 0, 0, 0, false };
+      Fds.resize(Fd + 1, Empty);
+   }
+
+   Watched &W = Fds[Fd];
+   if (W.Round == Round)
+   {
+      W.Events |= Events;
+      return;
+   }
+   if (W.Round == 0)
+      Active.push_back(Fd);
+   else if (W.Id != Id)
+      Unregister(Fd, W);
+   W.Id = Id;
+   W.Round = Round;
+   W.Events = Events;
+}
+									/*}}}*/
+// FdPoller::Forget - Remove a descriptor from the interest set		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void FdPoller::Forget(int const Fd)
+{
+   if (Fd < 0 || (unsigned int) Fd >= Fds.size())
+      return;
+   Watched &W = Fds[Fd];
+   Unregister(Fd, W);
+   if (W.Round == 0)
+      return;
+   W.Round = 0;
+   W.Revents = 0;
+   Active.erase(std::find(Active.begin(), Active.end(), Fd));
+}
+									/*}}}*/
+// FdPoller::Register - Bring the epoll set in line with the interest	/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns false if the descriptor can't be watched by epoll (EPERM for
+   regular files) - those are always ready. */
+bool FdPoller::Register(int const Fd, Watched &W)
+{
+#ifdef __linux__
+   struct epoll_event Event;
+   Event.events = 0;
+   if ((W.Events & Read) != 0)
+      Event.events |= EPOLLIN;
+   if ((W.Events & Write) != 0)
+      Event.events |= EPOLLOUT;
+
+   int Res = -1;
+   if (W.Registered != 0)
+   {
+      Event.data.u64 = ((unsigned long long) W.Generation << 32) | Fd;
+      Res = epoll_ctl(EpollFd, EPOLL_CTL_MOD, Fd, &Event);
+      // the descriptor was closed and got reused since we registered it
+      if (Res != 0 && errno != ENOENT)
+	 return false;
+   }
+   if (Res != 0)
+   {
+      W.Generation = ++Generation;
+      Event.data.u64 = ((unsigned long long) W.Generation << 32) | Fd;
+      Res = epoll_ctl(EpollFd, EPOLL_CTL_ADD, Fd, &Event);
+      if (Res != 0 && errno == EEXIST)
+	 Res = epoll_ctl(EpollFd, EPOLL_CTL_MOD, Fd, &Event);
+      if (Res != 0)
+	 return false;
+   }
+   W.Registered = W.Events;
+   return true;
+#else
+   return false;
+#endif
+}
+									/*}}}*/
+// FdPoller::Unregister - Remove a descriptor from the epoll set	/*{{{*/
+// ---------------------------------------------------------------------
+/* Errors are ignored as the descriptor might be closed already. */
+void FdPoller::Unregister(int const Fd, Watched &W)
+{
+#ifdef __linux__
+   if (W.Registered != 0)
+   {
+      struct epoll_event Event;
+      epoll_ctl(EpollFd, EPOLL_CTL_DEL, Fd, &Event);
+   }
+#endif
+   W.Registered = 0;
+   W.Unpollable = false;
+}
+									/*}}}*/
+// FdPoller::Wait - Wait for one of the watched descriptors		/*{{{*/
+// ---------------------------------------------------------------------
+/* Descriptors which weren't watched in this round are dropped first,
+   the survivors are (re)registered if their interest has changed. */
+int FdPoller::Wait(int Timeout)
+{
+   std::vector<int>::iterator Keep = Active.begin();
+   for (std::vector<int>::const_iterator A = Active.begin(); A != Active.end(); ++A)
+   {
+      Watched &W = Fds[*A];
+      W.Revents = 0;
+      if (W.Round != Round)
+      {
+	 Unregister(*A, W);
+	 W.Round = 0;
+	 continue;
+      }
+      *Keep++ = *A;
+   }
+   Active.erase(Keep, Active.end());
+
+   int Ready = 0;
+   if (EpollFd != -1)
+   {
+#ifdef __linux__
+      for (std::vector<int>::const_iterator A = Active.begin(); A != Active.end(); ++A)
+      {
+	 Watched &W = Fds[*A];
+	 if (W.Unpollable == false && W.Registered != W.Events &&
+	     Register(*A, W) == false)
+	 {
+	    if (errno != EPERM)
+	       return -1;
+	    W.Unpollable = true;
+	 }
+	 if (W.Unpollable == true)
+	 {
+	    W.Revents = W.Events;
+	    ++Ready;
+	 }
+      }
+      if (Ready != 0)
+	 Timeout = 0;
+
+      struct epoll_event Events[64];
+      int Res;
+      do
+	 Res = epoll_wait(EpollFd, Events, sizeof(Events) / sizeof(Events[0]), Timeout);
+      while (Res < 0 && errno == EINTR);
+      if (Res < 0)
+	 return -1;
+
+      for (int E = 0; E < Res; ++E)
+      {
+	 unsigned int const Fd = Events[E].data.u64 & 0xFFFFFFFF;
+	 unsigned int const Gen = Events[E].data.u64 >> 32;
+	 if (Fd >= Fds.size())
+	    continue;
+	 Watched &W = Fds[Fd];
+	 if (W.Round != Round || W.Registered == 0 || W.Generation != Gen)
+	    continue;
+	 unsigned int const Got = Events[E].events;
+	 if ((Got & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0)
+	    W.Revents |= (W.Events & FdPoller::Read);
+	 if ((Got & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0)
+	    W.Revents |= (W.Events & FdPoller::Write);
+	 if (W.Revents != 0)
+	    ++Ready;
+      }
+#endif
+   }
+   else
+   {
+      std::vector<struct pollfd> Polls;
+      Polls.reserve(Active.size());
+      for (std::vector<int>::const_iterator A = Active.begin(); A != Active.end(); ++A)
+      {
+	 struct pollfd P;
+	 P.fd = *A;
+	 P.events = 0;
+	 P.revents = 0;
+	 if ((Fds[*A].Events & Read) != 0)
+	    P.events |= POLLIN;
+	 if ((Fds[*A].Events & Write) != 0)
+	    P.events |= POLLOUT;
+	 Polls.push_back(P);
+      }
+
+      int Res;
+      do
+	 Res = poll(Polls.empty() ? NULL : &Polls[0], Polls.size(), Timeout);
+      while (Res < 0 && errno == EINTR);
+      if (Res < 0)
+	 return -1;
+
+      for (std::vector<struct pollfd>::const_iterator P = Polls.begin();
+	   Res != 0 && P != Polls.end(); ++P)
+      {
+	 if (P->revents == 0)
+	    continue;
+	 Watched &W = Fds[P->fd];
+	 if ((P->revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) != 0)
+	    W.Revents |= (W.Events & FdPoller::Read);
+	 if ((P->revents & (POLLOUT | POLLHUP | POLLERR | POLLNVAL)) != 0)
+	    W.Revents |= (W.Events & FdPoller::Write);
+	 if (W.Revents != 0)
+	    ++Ready;
+      }
+   }
+
+   ++Round;
+   return Ready;
+}
+									/*}}}*/
+// FdPoller::Ready - Events the descriptor was ready for		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+unsigned int FdPoller::Ready(int const Fd) const
+{
+   if (Fd < 0 || (unsigned int) Fd >= Fds.size())
+      return 0;
+   return Fds[Fd].Revents;
+}
+									/*}}}*/
@@ -0,0 +1,85 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   FdPoller - Wait for activity on a set of file descriptors
+
+   This replaces the select() loops of the acquire system and the
+   methods. On Linux the interest set is kept in the kernel via epoll,
+   so a wakeup costs only as much as there are active descriptors and
+   there is no FD_SETSIZE limit; everywhere else (or if epoll is not
+   available at runtime) poll() is used instead.
+
+   The interface is modelled after the select() loops it replaces: Before
+   each Wait() the caller announces all descriptors it is interested in
+   with Watch(). Descriptors which aren't announced again are dropped
+   from the interest set on the next Wait(). The Id given with a
+   descriptor identifies its owner: descriptor numbers are reused after
+   a close(), so an owner which changes without the caller noticing has
+   to be told apart by a different Id (e.g. the pid of a method).
+   Descriptors which can not be watched (regular files) are always
+   reported as ready, just like select() does.
+
+   ##################################################################### */
+									/*}}}*/
+#ifndef PKGLIB_FDPOLLER_H
+#define PKGLIB_FDPOLLER_H
+
+#include <vector>
+
+class FdPoller
+{
+   struct Watched
+   {
+      unsigned long Id;
+      unsigned long Round;
+      unsigned int Events;
+      unsigned int Registered;
+      unsigned int Revents;
+      unsigned int Generation;
+      bool Unpollable;
+   };
+   std::vector<Watched> Fds;
+   std::vector<int> Active;
+   unsigned long Round;
+   unsigned int Generation;
+   int EpollFd;
+
+   bool Register(int const Fd, Watched &W);
+   void Unregister(int const Fd, Watched &W);
+
+   public:
+   enum Events { Read = (1 << 0), Write = (1 << 1) };
+
+   /** \brief add the descriptor to the interest set for the next Wait()
+    *
+    *  \param Fd the descriptor to watch, negative ones are ignored
+    *  \param Events mask of Read and Write
+    *  \param Id identifies the owner of the descriptor
+    */
+   void Watch(int const Fd, unsigned int const Events, unsigned long const Id = 0);
+   /** \brief remove the descriptor from the interest set right away
+    *
+    *  This is only needed if the descriptor is closed while a copy of it
+    *  lives on in another process, as epoll would report events for it.
+    */
+   void Forget(int const Fd);
+   /** \brief wait for one of the watched descriptors to become ready
+    *
+    *  \param Timeout in milliseconds, -1 waits forever
+    *  \return number of ready descriptors, 0 on timeout and -1 on errors
+    *  with errno set (EINTR is handled internally)
+    */
+   int Wait(int const Timeout);
+   /** \brief the Events the descriptor was ready for in the last Wait() */
+   unsigned int Ready(int const Fd) const;
+
+   /** \return \b true if epoll is used, \b false for poll() */
+   bool UsesEpoll() const { return EpollFd != -1; };
+
+   /** \param UseEpoll \b false forces the poll() implementation */
+   FdPoller(bool const UseEpoll = true);
+   ~FdPoller();
+};
+
+#endif
@@ -38,6 +38,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <dirent.h>
 #include <signal.h>
 #include <errno.h>
@@ -606,41 +607,26 @@ void SetNonBlock(int Fd,bool Block)
 									/*}}}*/
 // WaitFd - Wait for a FD to become readable				/*{{{*/
 // ---------------------------------------------------------------------
-/* This waits for a FD to become readable using select. It is useful for
+/* This waits for a FD to become readable using poll. It is useful for
    applications making use of non-blocking sockets. The timeout is 
-   in seconds. */
+   in seconds. Unlike select() poll() has no problem with FDs beyond
+   FD_SETSIZE, which a process with a lot of workers can easily reach. */
 bool WaitFd(int Fd,bool write,unsigned long timeout)
 {
-   fd_set Set;
-   struct timeval tv;
-   FD_ZERO(&Set);
-   FD_SET(Fd,&Set);
-   tv.tv_sec = timeout;
-   tv.tv_usec = 0;
-   if (write == true) 
-   {      
-      int Res;
-      do
-      {
-	 Res = select(Fd+1,0,&Set,0,(timeout != 0?&tv:0));
-      }
-      while (Res < 0 && errno == EINTR);
-      
-      if (Res <= 0)
-	 return false;
-   } 
-   else 
+   struct pollfd Poll;
+   Poll.fd = Fd;
+   Poll.events = (write == true) ? POLLOUT : POLLIN;
+   Poll.revents = 0;
+
+   int Res;
+   do
    {
-      int Res;
-      do
-      {
-	 Res = select(Fd+1,&Set,0,0,(timeout != 0?&tv:0));
-      }
-      while (Res < 0 && errno == EINTR);
-      
-      if (Res <= 0)
-	 return false;
+      Res = poll(&Poll,1,(timeout != 0 ? timeout * 1000 : -1));
    }
+   while (Res < 0 && errno == EINTR);
+
+   if (Res <= 0 || (Poll.revents & POLLNVAL) != 0)
+      return false;
    
    return true;
 }
@@ -19,7 +19,14 @@
 #include <apt-pkg/macros.h>
 
 #include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <new>
 #include <string>
+#include <vector>
 #include <iostream>
 									/*}}}*/
 
@@ -105,47 +112,321 @@ std::string HashString::toStr() const
    return Type + std::string(":") + Hash;
 }
 
-// Hashes::AddFD - Add the contents of the FD				/*{{{*/
+// ReadBlock - Read the next block from a file				/*{{{*/
 // ---------------------------------------------------------------------
-/* */
-bool Hashes::AddFD(int const Fd,unsigned long long Size, bool const addMD5,
-		   bool const addSHA1, bool const addSHA256, bool const addSHA512)
+/* Actual is 0 at the end of the file */
+static bool ReadBlock(int const Fd, unsigned char * const Buf,
+		      unsigned long long const Size, unsigned long long &Actual)
 {
-   unsigned char Buf[64*64];
-   ssize_t Res = 0;
-   int ToEOF = (Size == 0);
-   while (Size != 0 || ToEOF)
+   ssize_t const Res = read(Fd, Buf, Size);
+   if (Res < 0)
+      return false;
+   Actual = Res;
+   return true;
+}
+static bool ReadBlock(FileFd &Fd, unsigned char * const Buf,
+		      unsigned long long const Size, unsigned long long &Actual)
+{
+   return Fd.Read(Buf, Size, &Actual);
+}
+static unsigned long long FileSizeOf(int const Fd)
+{
+   struct stat Buf;
+   if (fstat(Fd, &Buf) != 0 || S_ISREG(Buf.st_mode) == false)
+      return 0;
+   return Buf.st_size;
+}
+static unsigned long long FileSizeOf(FileFd &Fd)
+{
+   // the size on disk is good enough to decide if it is worth the trouble
+   return Fd.FileSize();
+}
+									/*}}}*/
+// HashSum - Access the digests of a Hashes object by number		/*{{{*/
+enum { HashMD5, HashSHA1, HashSHA256, HashSHA512 };
+static SummationImplementation &HashSum(Hashes &H, unsigned int const Sum)
+{
+   switch (Sum)
    {
-      unsigned long long n = sizeof(Buf);
-      if (!ToEOF) n = std::min(Size, n);
-      Res = read(Fd,Buf,n);
-      if (Res < 0 || (!ToEOF && Res != (ssize_t) n)) // error, or short read
-	 return false;
-      if (ToEOF && Res == 0) // EOF
-	 break;
-      Size -= Res;
-      if (addMD5 == true)
-	 MD5.Add(Buf,Res);
-      if (addSHA1 == true)
-	 SHA1.Add(Buf,Res);
-      if (addSHA256 == true)
-	 SHA256.Add(Buf,Res);
-      if (addSHA512 == true)
-	 SHA512.Add(Buf,Res);
+   case HashMD5: return H.MD5;
+   case HashSHA1: return H.SHA1;
+   case HashSHA256: return H.SHA256;
    }
-   return true;
+   return H.SHA512;
 }
-bool Hashes::AddFD(FileFd &Fd,unsigned long long Size, bool const addMD5,
+static void CopyHashSum(Hashes &To, Hashes const &From, unsigned int const Sum)
+{
+   switch (Sum)
+   {
+   case HashMD5: To.MD5 = From.MD5; break;
+   case HashSHA1: To.SHA1 = From.SHA1; break;
+   case HashSHA256: To.SHA256 = From.SHA256; break;
+   case HashSHA512: To.SHA512 = From.SHA512; break;
+   }
+}
+									/*}}}*/
+// HashWorkers - Compute the digests in child processes		/*{{{*/
+// ---------------------------------------------------------------------
+/* libapt-pkg doesn't use threads, so the digests which are computed in
+   parallel are handled by forked children. The file is read by the parent
+   into a ring of buffers shared with the children and each child feeds
+   every buffer into its digest. The parent tells the children about a new
+   buffer by sending its length over a socket (0 ends the data) and a child
+   acknowledges each buffer it is done with over another socket, so the
+   buffer can be reused by the parent. The end of the data is acknowledged
+   as well, after which the digest of the child is complete in a copy of
+   the Hashes object in the shared memory. Sockets are used instead of
+   pipes as they can be written without raising SIGPIPE in the process,
+   and the final acknowledgement tells the parent that a child succeeded
+   even if it can't wait for it, e.g. because SIGCHLD is ignored. */
+class HashWorkers
+{
+   static const unsigned int Slots = 8;
+   static const unsigned long long SlotSize = 64*1024;
+
+   struct Worker
+   {
+      pid_t Process;
+      int Data;
+      int Ack;
+      unsigned int Sum;
+   };
+   Worker Workers[4];
+   unsigned int WorkerCount;
+   void *Shared;
+   Hashes *Result;
+   unsigned long long Blocks;
+   unsigned long long Acked;
+
+   static bool ReadAll(int const Fd, void *To, size_t Size)
+   {
+      while (Size != 0)
+      {
+	 ssize_t const Res = read(Fd, To, Size);
+	 if (Res < 0 && errno == EINTR)
+	    continue;
+	 if (Res <= 0)
+	    return false;
+	 To = (char *)To + Res;
+	 Size -= Res;
+      }
+      return true;
+   }
+   static bool WriteAll(int const Fd, void const *From, size_t Size)
+   {
+      while (Size != 0)
+      {
+	 ssize_t const Res = send(Fd, From, Size, MSG_NOSIGNAL);
+	 if (Res < 0 && errno == EINTR)
+	    continue;
+	 if (Res <= 0)
+	    return false;
+	 From = (char const *)From + Res;
+	 Size -= Res;
+      }
+      return true;
+   }
+
+   unsigned char *Slot(unsigned long long const Block) const
+   {
+      return (unsigned char *)Shared + sizeof(Hashes) + (Block % Slots) * SlotSize;
+   }
+
+   void RunWorker(Worker const &W)
+   {
+      SummationImplementation &Sum = HashSum(*Result, W.Sum);
+      for (unsigned long long Block = 0;; ++Block)
+      {
+	 unsigned long long Len;
+	 if (ReadAll(W.Data, &Len, sizeof(Len)) == false)
+	    _exit(100);
+	 if (Len != 0)
+	    Sum.Add(Slot(Block), Len);
+	 if (WriteAll(W.Ack, "", 1) == false)
+	    _exit(100);
+	 if (Len == 0)
+	    _exit(0);
+      }
+   }
+
+   bool Stop(Hashes * const Owner)
+   {
+      bool Okay = (Owner != 0);
+      unsigned long long const End = 0;
+      for (unsigned int I = 0; I != WorkerCount; ++I)
+	 if (Owner != 0 && WriteAll(Workers[I].Data, &End, sizeof(End)) == false)
+	    Okay = false;
+      for (unsigned int I = 0; I != WorkerCount; ++I)
+      {
+	 // the acknowledgements of the last blocks and of the end
+	 bool Done = Okay;
+	 for (unsigned long long A = Acked; Done == true && A <= Blocks; ++A)
+	 {
+	    char Ack;
+	    Done = ReadAll(Workers[I].Ack, &Ack, 1);
+	 }
+	 close(Workers[I].Data);
+	 close(Workers[I].Ack);
+	 int Status = 0;
+	 pid_t Res;
+	 while ((Res = waitpid(Workers[I].Process, &Status, 0)) < 0 && errno == EINTR);
+	 // without a child to wait for the acknowledgements have to do
+	 if (Res == Workers[I].Process && (WIFEXITED(Status) == 0 || WEXITSTATUS(Status) != 0))
+	    Done = false;
+	 else if (Res != Workers[I].Process && errno != ECHILD)
+	    Done = false;
+	 if (Done == false)
+	    Okay = false;
+	 else
+	    CopyHashSum(*Owner, *Result, Workers[I].Sum);
+      }
+      WorkerCount = 0;
+      return Okay;
+   }
+
+   public:
+
+   /* Fork a child for each of the given digests, returns false if this
+      isn't possible, but without an error as the caller can go on
+      without them. */
+   bool Start(Hashes const &Owner, std::vector<unsigned int> const &Sums)
+   {
+      Shared = mmap(0, sizeof(Hashes) + Slots * SlotSize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (Shared == MAP_FAILED)
+      {
+	 Shared = 0;
+	 return false;
+      }
+      Result = new (Shared) Hashes(Owner);
+
+      for (std::vector<unsigned int>::const_iterator S = Sums.begin(); S != Sums.end(); ++S)
+      {
+	 int Data[2], Ack[2];
+	 if (socketpair(AF_UNIX, SOCK_STREAM, 0, Data) != 0)
+	    return Stop(0);
+	 if (socketpair(AF_UNIX, SOCK_STREAM, 0, Ack) != 0)
+	 {
+	    close(Data[0]);
+	    close(Data[1]);
+	    return Stop(0);
+	 }
+	 pid_t const Process = fork();
+	 if (Process < 0)
+	 {
+	    close(Data[0]);
+	    close(Data[1]);
+	    close(Ack[0]);
+	    close(Ack[1]);
+	    return Stop(0);
+	 }
+	 if (Process == 0)
+	 {
+	    // don't keep the pipes of the other children open
+	    for (unsigned int I = 0; I != WorkerCount; ++I)
+	    {
+	       close(Workers[I].Data);
+	       close(Workers[I].Ack);
+	    }
+	    close(Data[1]);
+	    close(Ack[0]);
+	    Worker const W = { 0, Data[0], Ack[1], *S };
+	    RunWorker(W);
+	 }
+	 close(Data[0]);
+	 close(Ack[1]);
+	 Worker const W = { Process, Data[1], Ack[0], *S };
+	 Workers[WorkerCount++] = W;
+      }
+      return true;
+   }
+
+   // Get the buffer for the next block, waits until the children are done with it
+   unsigned char *Buffer(unsigned long long &Size)
+   {
+      if (Blocks >= Slots)
+	 for (unsigned int I = 0; I != WorkerCount; ++I)
+	 {
+	    char Ack;
+	    if (ReadAll(Workers[I].Ack, &Ack, 1) == false)
+	       return 0;
+	 }
+      if (Blocks >= Slots)
+	 ++Acked;
+      Size = SlotSize;
+      return Slot(Blocks);
+   }
+
+   // Pass the block in the buffer on to the children
+   bool Commit(unsigned long long const Size)
+   {
+      for (unsigned int I = 0; I != WorkerCount; ++I)
+	 if (WriteAll(Workers[I].Data, &Size, sizeof(Size)) == false)
+	    return false;
+      ++Blocks;
+      return true;
+   }
+
+   // Wait for the children and store their digests in the Owner
+   bool Finish(Hashes &Owner)
+   {
+      return Stop(&Owner);
+   }
+
+   HashWorkers() : WorkerCount(0), Shared(0), Result(0), Blocks(0), Acked(0) {};
+   ~HashWorkers()
+   {
+      if (WorkerCount != 0)
+	 Stop(0);
+      if (Shared != 0)
+      {
+	 Result->~Hashes();
+	 munmap(Shared, sizeof(Hashes) + Slots * SlotSize);
+      }
+   }
+};
+									/*}}}*/
+// HashFD - Add the contents of the FD to the Hashes			/*{{{*/
+// ---------------------------------------------------------------------
+/* If more than one digest is requested for a file of at least 4 MiB and
+   APT::Hashes::Parallel is enabled all but the first digest are computed
+   by HashWorkers in parallel to the reading and the first digest. If the
+   children can't be started everything is computed here as usual. */
+template<class FD>
+static bool HashFD(Hashes &H, FD &Fd, unsigned long long Size, bool const addMD5,
 		   bool const addSHA1, bool const addSHA256, bool const addSHA512)
 {
-   unsigned char Buf[64*64];
+   std::vector<unsigned int> Sums;
+   if (addMD5 == true)
+      Sums.push_back(HashMD5);
+   if (addSHA1 == true)
+      Sums.push_back(HashSHA1);
+   if (addSHA256 == true)
+      Sums.push_back(HashSHA256);
+   if (addSHA512 == true)
+      Sums.push_back(HashSHA512);
    bool const ToEOF = (Size == 0);
+
+   HashWorkers Workers;
+   bool Parallel = false;
+   if (Sums.size() > 1 && _config->FindB("APT::Hashes::Parallel", false) == true &&
+       (ToEOF == true ? FileSizeOf(Fd) : Size) >= 4*1024*1024 &&
+       Workers.Start(H, std::vector<unsigned int>(Sums.begin() + 1, Sums.end())) == true)
+   {
+      Parallel = true;
+      Sums.resize(1);
+   }
+
+   unsigned char Local[64*64];
    while (Size != 0 || ToEOF)
    {
-      unsigned long long n = sizeof(Buf);
+      unsigned long long n = sizeof(Local);
+      unsigned char *Buf = Local;
+      if (Parallel == true && (Buf = Workers.Buffer(n)) == 0)
+	 return false;
       if (!ToEOF) n = std::min(Size, n);
       unsigned long long a = 0;
-      if (Fd.Read(Buf, n, &a) == false) // error
+      if (ReadBlock(Fd, Buf, n, a) == false) // error
 	 return false;
       if (ToEOF == false)
       {
@@ -155,15 +436,27 @@ bool Hashes::AddFD(FileFd &Fd,unsigned long long Size, bool const addMD5,
       else if (a == 0) // EOF
 	 break;
       Size -= a;
-      if (addMD5 == true)
-	 MD5.Add(Buf, a);
-      if (addSHA1 == true)
-	 SHA1.Add(Buf, a);
-      if (addSHA256 == true)
-	 SHA256.Add(Buf, a);
-      if (addSHA512 == true)
-	 SHA512.Add(Buf, a);
+      if (Parallel == true && Workers.Commit(a) == false)
+	 return false;
+      for (std::vector<unsigned int>::const_iterator S = Sums.begin(); S != Sums.end(); ++S)
+	 HashSum(H, *S).Add(Buf, a);
    }
+   if (Parallel == true)
+      return Workers.Finish(H);
    return true;
 }
 									/*}}}*/
+// Hashes::AddFD - Add the contents of the FD				/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool Hashes::AddFD(int const Fd,unsigned long long Size, bool const addMD5,
+		   bool const addSHA1, bool const addSHA256, bool const addSHA512)
+{
+   return HashFD(*this, Fd, Size, addMD5, addSHA1, addSHA256, addSHA512);
+}
+bool Hashes::AddFD(FileFd &Fd,unsigned long long Size, bool const addMD5,
+		   bool const addSHA1, bool const addSHA256, bool const addSHA512)
+{
+   return HashFD(*this, Fd, Size, addMD5, addSHA1, addSHA256, addSHA512);
+}
+									/*}}}*/
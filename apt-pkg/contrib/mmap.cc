@@ -409,6 +409,20 @@ unsigned long DynamicMMap::WriteString(const char *String,
    return Result;
 }
 									/*}}}*/
+// DynamicMMap::Truncate - Drop everything allocated after Size	/*{{{*/
+// ---------------------------------------------------------------------
+/* The space is cleared and handed out again by the next allocations.
+   The pools are not touched, so the caller has to make sure that they
+   don't refer to the dropped space anymore. */
+bool DynamicMMap::Truncate(unsigned long long const Size)
+{
+   if (Size > iSize)
+      return _error->Error("Can't truncate the MMap to %llu bytes as it has only %llu", Size, iSize);
+   memset((char *)Base + Size, 0, iSize - Size);
+   iSize = Size;
+   return true;
+}
+									/*}}}*/
 // DynamicMMap::Grow - Grow the mmap					/*{{{*/
 // ---------------------------------------------------------------------
 /* This method is a wrapper around different methods to (try to) grow
@@ -108,6 +108,7 @@ class DynamicMMap : public MMap
    unsigned long WriteString(const char *String,unsigned long Len = (unsigned long)-1);
    inline unsigned long WriteString(const std::string &S) {return WriteString(S.c_str(),S.length());};
    void UsePools(Pool &P,unsigned int Count) {Pools = &P; PoolCount = Count;};
+   bool Truncate(unsigned long long const Size);
    
    DynamicMMap(FileFd &F,unsigned long Flags,unsigned long const &WorkSpace = 2*1024*1024,
 	       unsigned long const &Grow = 1024*1024, unsigned long const &Limit = 0);
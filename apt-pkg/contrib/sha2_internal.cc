@@ -55,7 +55,10 @@
  *
  *   #define SHA2_UNROLL_TRANSFORM
  *
+ * APT uses the unrolled version as it is considerably faster for SHA-512
+ * and for SHA-256 on CPUs without the SHA extensions (see below).
  */
+#define SHA2_UNROLL_TRANSFORM
 
 
 /*** SHA-256/384/512 Machine Architecture Definitions *****************/
@@ -518,6 +521,111 @@ static void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+/*
+ * HARDWARE ACCELERATION NOTE:
+ *
+ * Complete blocks are handed to SHA256_Blocks, which points to the
+ * portable SHA256_Transform above or - if the CPU supports the x86 SHA
+ * extensions - to SHA256_Transform_SHANI.  The choice is made on the
+ * first use by asking the CPU, so the library still runs on every CPU
+ * of the architecture.  Define SHA2_NO_SHANI to build without it.
+ */
+static void SHA256_Blocks_Generic(SHA256_CTX* context, const sha2_byte *data, size_t blocks) {
+	while (blocks-- != 0) {
+		SHA256_Transform(context, (sha2_word32*)data);
+		data += SHA256_BLOCK_LENGTH;
+	}
+}
+
+#if !defined(SHA2_NO_SHANI) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SHA2_USE_SHANI 1
+#include <immintrin.h>
+#include <cpuid.h>
+
+/* One group of four rounds, the message schedule for the next groups
+   is computed on the fly in W[0..3] */
+#define ROUND256_SHANI(g, W0, W1, W2, W3) \
+	if (g < 4) \
+		W0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * g)), MASK); \
+	MSG = _mm_add_epi32(W0, _mm_loadu_si128((const __m128i*)&K256[4 * g])); \
+	STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG); \
+	if (g >= 3 && g <= 14) { \
+		W1 = _mm_add_epi32(W1, _mm_alignr_epi8(W0, W3, 4)); \
+		W1 = _mm_sha256msg2_epu32(W1, W0); \
+	} \
+	MSG = _mm_shuffle_epi32(MSG, 0x0E); \
+	STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG); \
+	if (g >= 1 && g <= 12) \
+		W3 = _mm_sha256msg1_epu32(W3, W0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void SHA256_Transform_SHANI(SHA256_CTX* context, const sha2_byte *data, size_t blocks) {
+	const __m128i	MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i		STATE0, STATE1, MSG, TMP, W0, W1, W2, W3, ABEF, CDGH;
+
+	/* The instructions want the state as ABEF and CDGH */
+	TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&context->state[0]), 0xB1);
+	STATE1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&context->state[4]), 0x1B);
+	STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+	W0 = W1 = W2 = W3 = _mm_setzero_si128();
+
+	for (; blocks != 0; --blocks, data += SHA256_BLOCK_LENGTH) {
+		ABEF = STATE0;
+		CDGH = STATE1;
+		ROUND256_SHANI(0, W0, W1, W2, W3);
+		ROUND256_SHANI(1, W1, W2, W3, W0);
+		ROUND256_SHANI(2, W2, W3, W0, W1);
+		ROUND256_SHANI(3, W3, W0, W1, W2);
+		ROUND256_SHANI(4, W0, W1, W2, W3);
+		ROUND256_SHANI(5, W1, W2, W3, W0);
+		ROUND256_SHANI(6, W2, W3, W0, W1);
+		ROUND256_SHANI(7, W3, W0, W1, W2);
+		ROUND256_SHANI(8, W0, W1, W2, W3);
+		ROUND256_SHANI(9, W1, W2, W3, W0);
+		ROUND256_SHANI(10, W2, W3, W0, W1);
+		ROUND256_SHANI(11, W3, W0, W1, W2);
+		ROUND256_SHANI(12, W0, W1, W2, W3);
+		ROUND256_SHANI(13, W1, W2, W3, W0);
+		ROUND256_SHANI(14, W2, W3, W0, W1);
+		ROUND256_SHANI(15, W3, W0, W1, W2);
+		STATE0 = _mm_add_epi32(STATE0, ABEF);
+		STATE1 = _mm_add_epi32(STATE1, CDGH);
+	}
+
+	/* And back to ABCD and EFGH */
+	TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+	_mm_storeu_si128((__m128i*)&context->state[0], _mm_blend_epi16(TMP, STATE1, 0xF0));
+	_mm_storeu_si128((__m128i*)&context->state[4], _mm_alignr_epi8(STATE1, TMP, 8));
+}
+
+static int sha2_cpu_has_shani(void) {
+	unsigned int	eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 ||
+	    (ecx & (1 << 9)) == 0 || (ecx & (1 << 19)) == 0)	/* SSSE3, SSE4.1 */
+		return 0;
+	if (__get_cpuid_max(0, 0) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 29)) != 0;				/* SHA */
+}
+#endif /* SHA2_USE_SHANI */
+
+static void SHA256_Blocks_Detect(SHA256_CTX*, const sha2_byte*, size_t);
+static void (*SHA256_Blocks)(SHA256_CTX*, const sha2_byte*, size_t) = SHA256_Blocks_Detect;
+
+static void SHA256_Blocks_Detect(SHA256_CTX* context, const sha2_byte *data, size_t blocks) {
+	SHA256_Blocks = SHA256_Blocks_Generic;
+#ifdef SHA2_USE_SHANI
+	if (sha2_cpu_has_shani() != 0)
+		SHA256_Blocks = SHA256_Transform_SHANI;
+#endif
+	SHA256_Blocks(context, data, blocks);
+}
+
 void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 	unsigned int	freespace, usedspace;
 
@@ -540,7 +648,7 @@ void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 			context->bitcount += freespace << 3;
 			len -= freespace;
 			data += freespace;
-			SHA256_Transform(context, (sha2_word32*)context->buffer);
+			SHA256_Blocks(context, context->buffer, 1);
 		} else {
 			/* The buffer is not yet full */
 			MEMCPY_BCOPY(&context->buffer[usedspace], data, len);
@@ -550,12 +658,13 @@ void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 			return;
 		}
 	}
-	while (len >= SHA256_BLOCK_LENGTH) {
+	if (len >= SHA256_BLOCK_LENGTH) {
 		/* Process as many complete blocks as we can */
-		SHA256_Transform(context, (sha2_word32*)data);
-		context->bitcount += SHA256_BLOCK_LENGTH << 3;
-		len -= SHA256_BLOCK_LENGTH;
-		data += SHA256_BLOCK_LENGTH;
+		size_t const blocks = len / SHA256_BLOCK_LENGTH;
+		SHA256_Blocks(context, data, blocks);
+		context->bitcount += (sha2_word64)blocks * SHA256_BLOCK_LENGTH << 3;
+		len -= blocks * SHA256_BLOCK_LENGTH;
+		data += blocks * SHA256_BLOCK_LENGTH;
 	}
 	if (len > 0) {
 		/* There's left-overs, so save 'em */
@@ -592,7 +701,7 @@ void SHA256_Final(sha2_byte digest[], SHA256_CTX* context) {
 					MEMSET_BZERO(&context->buffer[usedspace], SHA256_BLOCK_LENGTH - usedspace);
 				}
 				/* Do second-to-last transform: */
-				SHA256_Transform(context, (sha2_word32*)context->buffer);
+				SHA256_Blocks(context, context->buffer, 1);
 
 				/* And set-up for the last transform: */
 				MEMSET_BZERO(context->buffer, SHA256_SHORT_BLOCK_LENGTH);
@@ -613,7 +722,7 @@ void SHA256_Final(sha2_byte digest[], SHA256_CTX* context) {
 		*(bitcount.l) = context->bitcount;
 
 		/* Final transform: */
-		SHA256_Transform(context, (sha2_word32*)context->buffer);
+		SHA256_Blocks(context, context->buffer, 1);
 
 #if BYTE_ORDER == LITTLE_ENDIAN
 		{
@@ -709,30 +709,80 @@ string TimeRFC1123(time_t Date)
 									/*}}}*/
 // ReadMessages - Read messages from the FD				/*{{{*/
 // ---------------------------------------------------------------------
-/* This pulls full messages from the input FD into the message buffer. 
-   It assumes that messages will not pause during transit so no
-   fancy buffering is used.
+/* This pulls full messages from the input FD into the message buffer.
+   It assumes that messages will not pause during transit, so it reads
+   blocks from the input until the last message in it is complete.
 
-   In particular: this reads blocks from the input until it believes
-   that it's run out of input text.  Each block is terminated by a
-   double newline ('\n' followed by '\n').  As noted below, there is a
-   bug in this code: it assumes that all the blocks have been read if
-   it doesn't see additional text in the buffer after the last one is
-   parsed, which will cause it to lose blocks if the last block
-   coincides with the end of the buffer.
- */
+   Messages are either text blocks terminated by a double newline ('\n'
+   followed by '\n') or binary frames as created by FrameMessage, which
+   are converted back into the text form. Framed is set to true if a
+   binary frame was read. */
 bool ReadMessages(int Fd, vector<string> &List)
+{
+   bool Framed;
+   return ReadMessages(Fd, List, Framed);
+}
+
+/* Binary frames start with a byte text messages can't start with (they
+   begin with the message number), followed by the length of the frame.
+   The frame holds the first line of the message and then the fields,
+   each as name and value. All strings are prefixed with their length,
+   numbers are in network byte order. */
+static char const MessageFrameMark = '\x1e';
+
+static void FrameNumber(string &Frame, unsigned long const Number, unsigned int const Bytes)
+{
+   for (unsigned int I = Bytes; I > 0; --I)
+      Frame += (char) ((Number >> ((I - 1) * 8)) & 0xff);
+}
+static bool UnframeNumber(char const *&Data, char const * const End,
+			  unsigned int const Bytes, unsigned long &Number)
+{
+   if ((unsigned long) (End - Data) < Bytes)
+      return false;
+   Number = 0;
+   for (unsigned int I = 0; I < Bytes; ++I, ++Data)
+      Number = (Number << 8) | (unsigned char) *Data;
+   return true;
+}
+static bool UnframeString(char const *&Data, char const * const End,
+			  unsigned int const Bytes, string &Text)
+{
+   unsigned long Length;
+   if (UnframeNumber(Data, End, Bytes, Length) == false ||
+       (unsigned long) (End - Data) < Length)
+      return false;
+   Text.assign(Data, Length);
+   Data += Length;
+   return true;
+}
+static bool UnframeMessage(char const *Data, char const * const End, string &Message)
+{
+   if (UnframeString(Data, End, 2, Message) == false)
+      return false;
+   string Name, Value;
+   while (Data != End)
+   {
+      if (UnframeString(Data, End, 1, Name) == false ||
+	  UnframeString(Data, End, 4, Value) == false)
+	 return false;
+      Message.append("\n").append(Name).append(":");
+      if (Value.empty() == false && Value[0] != '\n')
+	 Message.append(" ");
+      Message.append(Value);
+   }
+   return true;
+}
+bool ReadMessages(int Fd, vector<string> &List, bool &Framed)
 {
    char Buffer[64000];
-   char *End = Buffer;
-   // Represents any left-over from the previous iteration of the
-   // parse loop.  (i.e., if a message is split across the end
-   // of the buffer, it goes here)
-   string PartialMessage;
-   
+   // The messages (or parts of them) which were read, but not yet parsed
+   string Pending;
+   Framed = false;
+
    while (1)
    {
-      int Res = read(Fd,End,sizeof(Buffer) - (End-Buffer));
+      int Res = read(Fd,Buffer,sizeof(Buffer));
       if (Res < 0 && errno == EINTR)
 	 continue;
       
@@ -741,59 +791,112 @@ bool ReadMessages(int Fd, vector<string> &List)
 	 return false;
       
       // No data
-      if (Res < 0 && errno == EAGAIN)
+      if (Res < 0 && errno == EAGAIN && Pending.empty() == true)
 	 return true;
-      if (Res < 0)
+      if (Res < 0 && errno != EAGAIN)
 	 return false;
-			      
-      End += Res;
-      
-      // Look for the end of the message
-      for (char *I = Buffer; I + 1 < End; I++)
+      if (Res > 0)
+	 Pending.append(Buffer, Res);
+
+      // Pull out all complete messages
+      string::size_type Start = 0;
+      while (Start < Pending.length())
       {
-	 if (I[0] != '\n' || I[1] != '\n')
+	 if (Pending[Start] == MessageFrameMark)
+	 {
+	    char const *Data = Pending.data() + Start + 1;
+	    char const * const End = Pending.data() + Pending.length();
+	    unsigned long Length;
+	    if (UnframeNumber(Data, End, 4, Length) == false ||
+		(unsigned long) (End - Data) < Length)
+	       break;
+	    string Message;
+	    if (UnframeMessage(Data, Data + Length, Message) == false)
+	       return _error->Error("Received a malformed message frame");
+	    List.push_back(Message);
+	    Framed = true;
+	    Start = Data + Length - Pending.data();
 	    continue;
-	 
-	 // Pull the message out
-	 string Message(Buffer,I-Buffer);
-	 PartialMessage += Message;
+	 }
 
-	 // Fix up the buffer
-	 for (; I < End && *I == '\n'; I++);
-	 End -= I-Buffer;	 
-	 memmove(Buffer,I,End-Buffer);
-	 I = Buffer;
-	 
-	 List.push_back(PartialMessage);
-	 PartialMessage.clear();
+	 string::size_type const End = Pending.find("\n\n", Start);
+	 if (End == string::npos)
+	    break;
+	 List.push_back(Pending.substr(Start, End - Start));
+	 Start = Pending.find_first_not_of('\n', End);
+	 if (Start == string::npos)
+	    Start = Pending.length();
       }
-      if (End != Buffer)
-	{
-	  // If there's text left in the buffer, store it
-	  // in PartialMessage and throw the rest of the buffer
-	  // away.  This allows us to handle messages that
-	  // are longer than the static buffer size.
-	  PartialMessage += string(Buffer, End);
-	  End = Buffer;
-	}
-      else
-	{
-	  // BUG ALERT: if a message block happens to end at a
-	  // multiple of 64000 characters, this will cause it to
-	  // terminate early, leading to a badly formed block and
-	  // probably crashing the method.  However, this is the only
-	  // way we have to find the end of the message block.  I have
-	  // an idea of how to fix this, but it will require changes
-	  // to the protocol (essentially to mark the beginning and
-	  // end of the block).
-	  //
-	  //  -- dburrows 2008-04-02
-	  return true;
-	}
+      Pending.erase(0, Start);
+      if (Pending.empty() == true)
+	 return true;
 
       if (WaitFd(Fd) == false)
 	 return false;
-   }   
+   }
+}
+									/*}}}*/
+// FrameMessage - Convert a text message into a binary frame		/*{{{*/
+// ---------------------------------------------------------------------
+/* Lines starting with a space continue the value of the previous field.
+   Trailing newlines of the message are ignored. */
+string FrameMessage(string const &Message)
+{
+   string::size_type Last = Message.find_last_not_of('\n');
+   string const Text = (Last == string::npos) ? string() : Message.substr(0, Last + 1);
+
+   string Frame;
+   Frame.reserve(Text.length() + 64);
+   string::size_type Start = Text.find('\n');
+   string const Header = Text.substr(0, std::min(Start, (string::size_type) 0xffff));
+   FrameNumber(Frame, Header.length(), 2);
+   Frame.append(Header);
+
+   string Name, Value;
+   bool HaveField = false;
+   while (Start != string::npos)
+   {
+      ++Start;
+      string::size_type const End = Text.find('\n', Start);
+      string const Line = Text.substr(Start, End == string::npos ? string::npos : End - Start);
+      Start = End;
+
+      if (HaveField == true && Line.empty() == false && (Line[0] == ' ' || Line[0] == '\t'))
+      {
+	 Value.append("\n").append(Line);
+	 continue;
+      }
+      if (HaveField == true)
+      {
+	 FrameNumber(Frame, Name.length(), 1);
+	 Frame.append(Name);
+	 FrameNumber(Frame, Value.length(), 4);
+	 Frame.append(Value);
+      }
+
+      string::size_type const Colon = Line.find(':');
+      Name = Line.substr(0, std::min(Colon, (string::size_type) 255));
+      Value.clear();
+      if (Colon != string::npos)
+      {
+	 string::size_type V = Colon + 1;
+	 if (V < Line.length() && Line[V] == ' ')
+	    ++V;
+	 Value = Line.substr(V);
+      }
+      HaveField = true;
+   }
+   if (HaveField == true)
+   {
+      FrameNumber(Frame, Name.length(), 1);
+      Frame.append(Name);
+      FrameNumber(Frame, Value.length(), 4);
+      Frame.append(Value);
+   }
+
+   string Framed(1, MessageFrameMark);
+   FrameNumber(Framed, Frame.length(), 4);
+   return Framed.append(Frame);
 }
 									/*}}}*/
 // MonthConv - Converts a month string into a number			/*{{{*/
@@ -301,6 +301,14 @@ unsigned long debPackagesIndex::Size() const
    return size;
 }
 									/*}}}*/
+// PackagesIndex::IndexFileName - Return the file merged into the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+string debPackagesIndex::IndexFileName() const
+{
+   return IndexFile("Packages");
+}
+									/*}}}*/
 // PackagesIndex::Merge - Load the index file into a cache		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -499,6 +507,14 @@ unsigned long debTranslationsIndex::Size() const
    return size;
 }
 									/*}}}*/
+// TranslationsIndex::IndexFileName - Return the file merged into the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+string debTranslationsIndex::IndexFileName() const
+{
+   return IndexFile(Language);
+}
+									/*}}}*/
 // TranslationsIndex::Merge - Load the index file into a cache		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
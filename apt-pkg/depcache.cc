@@ -29,8 +29,13 @@
 #include <iostream>
 #include <sstream>
 #include <set>
+#include <vector>
 
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -57,6 +62,97 @@ ConfigValueInSubTree(const char* SubTree, const char *needle)
    return false;
 }
 									/*}}}*/
+// VersionMemo - Remember the results of version comparisons		/*{{{*/
+// ---------------------------------------------------------------------
+/* CheckDep compares the same versions over and over again: on every
+   Update of a dependency, and for the now, install and candidate version
+   of the target package, which are usually the same. The result only
+   depends on the two version strings and the operator, so it is kept in
+   an open addressed hash table keyed by the offsets of the strings in the
+   cache. As the versions of a group are ranked by the generator, this
+   is mostly needed for the versions of provides. */
+class VersionMemo
+{
+   struct Entry
+   {
+      map_ptrloc Version;	// 0 marks an empty slot
+      map_ptrloc Target;
+      unsigned char Op;
+      bool Result;
+   };
+   std::vector<Entry> Table;
+   unsigned long Used;
+
+   unsigned long Slot(map_ptrloc const Version, unsigned char const Op,
+		      map_ptrloc const Target) const
+   {
+      unsigned long const Hash = (Version * 0x9E3779B1UL) ^ (Target * 0x85EBCA6BUL) ^ Op;
+      return (Hash ^ (Hash >> 15)) & (Table.size() - 1);
+   }
+
+   void Grow()
+   {
+      std::vector<Entry> Old(Table.size() * 2);
+      Old.swap(Table);
+      for (std::vector<Entry>::const_iterator E = Old.begin(); E != Old.end(); ++E)
+      {
+	 if (E->Version == 0)
+	    continue;
+	 unsigned long S = Slot(E->Version, E->Op, E->Target);
+	 while (Table[S].Version != 0)
+	    S = (S + 1) & (Table.size() - 1);
+	 Table[S] = *E;
+      }
+   }
+
+   public:
+   unsigned long long Hits;
+   unsigned long long Misses;
+
+   bool CheckDep(pkgVersioningSystem &VS, char const * const StrP,
+		 map_ptrloc const Version, unsigned char const Op, map_ptrloc const Target)
+   {
+      // unversioned deps and provides are answered right away
+      if (Version == 0 || Target == 0)
+	 return VS.CheckDep(Version == 0 ? 0 : StrP + Version, Op, Target == 0 ? 0 : StrP + Target);
+
+      unsigned long S = Slot(Version, Op, Target);
+      for (; Table[S].Version != 0; S = (S + 1) & (Table.size() - 1))
+      {
+	 Entry const &E = Table[S];
+	 if (E.Version == Version && E.Target == Target && E.Op == Op)
+	 {
+	    ++Hits;
+	    return E.Result;
+	 }
+      }
+
+      ++Misses;
+      Entry &E = Table[S];
+      E.Version = Version;
+      E.Target = Target;
+      E.Op = Op;
+      E.Result = VS.CheckDep(StrP + Version, Op, StrP + Target);
+      bool const Result = E.Result;
+      if (++Used * 2 >= Table.size())
+	 Grow();
+      return Result;
+   }
+
+   VersionMemo() : Table(4096), Used(0), Hits(0), Misses(0) {};
+};
+									/*}}}*/
+// DepCache::Private - State besides the PkgState and DepState arrays	/*{{{*/
+// ---------------------------------------------------------------------
+/* Changes is set up by RecordChanges */
+struct pkgDepCache::Private
+{
+   VersionMemo Memo;
+   std::vector<map_ptrloc> *Changes;
+
+   Private() : Changes(0) {};
+};
+									/*}}}*/
 pkgDepCache::ActionGroup::ActionGroup(pkgDepCache &cache) :		/*{{{*/
   cache(cache), released(false)
 {
@@ -90,7 +186,7 @@ pkgDepCache::ActionGroup::~ActionGroup()
 // ---------------------------------------------------------------------
 /* */
 pkgDepCache::pkgDepCache(pkgCache *pCache,Policy *Plcy) :
-  group_level(0), Cache(pCache), PkgState(0), DepState(0)
+  group_level(0), Cache(pCache), PkgState(0), DepState(0), d(new Private)
 {
    DebugMarker = _config->FindB("Debug::pkgDepCache::Marker", false);
    DebugAutoInstall = _config->FindB("Debug::pkgDepCache::AutoInstall", false);
@@ -108,6 +204,15 @@ pkgDepCache::~pkgDepCache()
    delete [] PkgState;
    delete [] DepState;
    delete delLocalPolicy;
+
+   if (_config->FindB("Debug::pkgDepCache::VersionMemo", false) == true)
+   {
+      unsigned long long const Hits = d->Memo.Hits;
+      unsigned long long const All = Hits + d->Memo.Misses;
+      std::clog << "Version comparisons: " << All << " checked, " << Hits << " remembered ("
+		<< (All == 0 ? 0 : Hits * 100 / All) << "%)" << std::endl;
+   }
+   delete d;
 }
 									/*}}}*/
 // DepCache::Init - Generate the initial extra structures.		/*{{{*/
@@ -333,6 +438,18 @@ bool pkgDepCache::writeStateFile(OpProgress *prog, bool InstalledOnly)	/*{{{*/
    return true;
 }
 									/*}}}*/
+// Satisfies - Check a version of the target package against a dep	/*{{{*/
+// ---------------------------------------------------------------------
+/* Ranked versions are compared as integers, the rest is remembered */
+static bool Satisfies(VersionMemo &Memo, pkgCache::DepIterator const &Dep,
+		      pkgCache::Version * const Ver)
+{
+   pkgCache &Cache = *Dep.Cache();
+   if (Ver->Rank != 0 && Dep->TargetRank != 0)
+      return Dep.IsSatisfied(pkgCache::VerIterator(Cache, Ver));
+   return Memo.CheckDep(*Cache.VS, Cache.StrP, Ver->VerStr, Dep->CompareOp, Dep->Version);
+}
+									/*}}}*/
 // DepCache::CheckDep - Checks a single dependency			/*{{{*/
 // ---------------------------------------------------------------------
 /* This first checks the dependency against the main target package and
@@ -346,23 +463,21 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
    /* Check simple depends. A depends -should- never self match but 
       we allow it anyhow because dpkg does. Technically it is a packaging
       bug. Conflicts may never self match */
+   VersionMemo &Memo = d->Memo;
    if (Dep.TargetPkg() != Dep.ParentPkg() || Dep.IsNegative() == false)
    {
       PkgIterator Pkg = Dep.TargetPkg();
       // Check the base package
       if (Type == NowVersion && Pkg->CurrentVer != 0)
-	 if (VS().CheckDep(Pkg.CurrentVer().VerStr(),Dep->CompareOp,
-				 Dep.TargetVer()) == true)
+	 if (Satisfies(Memo,Dep,Pkg.CurrentVer()) == true)
 	    return true;
       
       if (Type == InstallVersion && PkgState[Pkg->ID].InstallVer != 0)
-	 if (VS().CheckDep(PkgState[Pkg->ID].InstVerIter(*this).VerStr(),
-				 Dep->CompareOp,Dep.TargetVer()) == true)
+	 if (Satisfies(Memo,Dep,PkgState[Pkg->ID].InstallVer) == true)
 	    return true;
       
       if (Type == CandidateVersion && PkgState[Pkg->ID].CandidateVer != 0)
-	 if (VS().CheckDep(PkgState[Pkg->ID].CandidateVerIter(*this).VerStr(),
-				 Dep->CompareOp,Dep.TargetVer()) == true)
+	 if (Satisfies(Memo,Dep,PkgState[Pkg->ID].CandidateVer) == true)
 	    return true;
    }
    
@@ -398,7 +513,7 @@ bool pkgDepCache::CheckDep(DepIterator Dep,int Type,PkgIterator &Res)
       }
       
       // Compare the versions.
-      if (VS().CheckDep(P.ProvideVersion(),Dep->CompareOp,Dep.TargetVer()) == true)
+      if (Memo.CheckDep(VS(),Cache->StrP,P->ProvideVersion,Dep->CompareOp,Dep->Version) == true)
       {
 	 Res = P.OwnerPkg();
 	 return true;
@@ -664,40 +779,28 @@ void pkgDepCache::Update(OpProgress *Prog)
    iInstCount = 0;
    iKeepCount = 0;
    iBrokenCount = 0;
+   iPolicyBrokenCount = 0;
    iBadCount = 0;
 
+   // Big caches get the states of their dependencies from child processes
+   bool const Parallel = ParallelDependencyStates();
+   std::vector<map_ptrloc> * const Changes = d->Changes;
+
    // Perform the depends pass
    int Done = 0;
    for (PkgIterator I = PkgBegin(); I.end() != true; ++I, ++Done)
    {
       if (Prog != 0 && Done%20 == 0)
 	 Prog->Progress(Done);
-      for (VerIterator V = I.VersionList(); V.end() != true; ++V)
-      {
-	 unsigned char Group = 0;
-
-	 for (DepIterator D = V.DependsList(); D.end() != true; ++D)
-	 {
-	    // Build the dependency state.
-	    unsigned char &State = DepState[D->ID];
-	    State = DependencyState(D);
-
-	    // Add to the group if we are within an or..
-	    Group |= State;
-	    State |= Group << 3;
-	    if ((D->CompareOp & Dep::Or) != Dep::Or)
-	       Group = 0;
-
-	    // Invert for Conflicts
-	    if (D.IsNegative() == true)
-	       State = ~State;
-	 }
-      }
+      if (Parallel == false)
+	 BuildDependencyStates(I,DepState);
 
       // Compute the package dependency state and size additions
       AddSizes(I);
       UpdateVerState(I);
       AddStates(I);
+      if (Changes != 0)
+	 Changes->push_back(I->ID);
    }
 
    if (Prog != 0)
@@ -706,12 +809,109 @@ void pkgDepCache::Update(OpProgress *Prog)
    readStateFile(Prog);
 }
 									/*}}}*/
+// DepCache::BuildDependencyStates - Compute the states of all deps of a package/*{{{*/
+// ---------------------------------------------------------------------
+/* The states of the dependencies of all versions of the package are
+   stored in States, which is indexed by the ID of the dependency. */
+void pkgDepCache::BuildDependencyStates(PkgIterator const &Pkg,unsigned char * const States)
+{
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; ++V)
+   {
+      unsigned char Group = 0;
+
+      for (DepIterator D = V.DependsList(); D.end() != true; ++D)
+      {
+	 // Build the dependency state.
+	 unsigned char &State = States[D->ID];
+	 State = DependencyState(D);
+
+	 // Add to the group if we are within an or..
+	 Group |= State;
+	 State |= Group << 3;
+	 if ((D->CompareOp & Dep::Or) != Dep::Or)
+	    Group = 0;
+
+	 // Invert for Conflicts
+	 if (D.IsNegative() == true)
+	    State = ~State;
+      }
+   }
+}
+									/*}}}*/
+// DepCache::ParallelDependencyStates - Compute all DepStates in children/*{{{*/
+// ---------------------------------------------------------------------
+/* The state of a dependency only depends on the versions chosen for the
+   packages, so the packages can be split by their ID into ranges which are
+   handled independently. libapt-pkg has no threads, so the ranges are
+   given to forked children (the parent keeps the first one) which write
+   the states into memory shared with the parent. Nothing else a child
+   does is seen by the parent, the sizes and counters are still added up
+   by the parent afterwards. A range whose child failed is computed again
+   by the parent. The children allocate memory, which can deadlock after a
+   fork in a program with threads, so this is only done if requested.
+   Returns false if the caller has to compute the states itself, e.g.
+   because the cache is too small to be worth the forks. */
+bool pkgDepCache::ParallelDependencyStates()
+{
+   unsigned long const Packages = Head().PackageCount;
+   unsigned long const Deps = Head().DependsCount;
+   unsigned long Workers = std::max(1, _config->FindI("APT::DepCache::Workers", 1));
+   // a child should have a bit more to do than what a fork costs
+   unsigned long const MinDepends = std::max(1, _config->FindI("APT::DepCache::Worker-Min-Depends", 20000));
+   Workers = std::min(Workers, Deps / MinDepends);
+   if (Workers < 2 || Packages < Workers)
+      return false;
+
+   unsigned char * const Shared = (unsigned char *) mmap(0, Deps, PROT_READ | PROT_WRITE,
+							 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (Shared == MAP_FAILED)
+      return false;
+
+   std::vector<pid_t> Children(Workers, -1);
+   for (unsigned long W = Workers - 1; W != 0; --W)
+   {
+      Children[W] = fork();
+      if (Children[W] != 0)
+	 continue;
+      unsigned long const First = W * Packages / Workers;
+      unsigned long const Last = (W + 1) * Packages / Workers;
+      for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+	 if (I->ID >= First && I->ID < Last)
+	    BuildDependencyStates(I,Shared);
+      _exit(0);
+   }
+
+   // our own range and those of the children which failed
+   for (unsigned long W = 0; W != Workers; ++W)
+   {
+      if (Children[W] > 0)
+      {
+	 int Status = 0;
+	 pid_t Res;
+	 while ((Res = waitpid(Children[W], &Status, 0)) < 0 && errno == EINTR);
+	 if (Res == Children[W] && WIFEXITED(Status) != 0 && WEXITSTATUS(Status) == 0)
+	    continue;
+      }
+      unsigned long const First = W * Packages / Workers;
+      unsigned long const Last = (W + 1) * Packages / Workers;
+      for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+	 if (I->ID >= First && I->ID < Last)
+	    BuildDependencyStates(I,Shared);
+   }
+
+   memcpy(DepState, Shared, Deps);
+   munmap(Shared, Deps);
+   return true;
+}
+									/*}}}*/
 // DepCache::Update - Update the deps list of a package	   		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is a helper for update that only does the dep portion of the scan. 
    It is mainly meant to scan reverse dependencies. */
 void pkgDepCache::Update(DepIterator D)
 {
+   std::vector<map_ptrloc> * const Changes = d->Changes;
+
    // Update the reverse deps
    for (;D.end() != true; ++D)
    {      
@@ -726,6 +926,38 @@ void pkgDepCache::Update(DepIterator D)
       BuildGroupOrs(D.ParentVer());
       UpdateVerState(D.ParentPkg());
       AddStates(D.ParentPkg());
+      if (Changes != 0)
+	 Changes->push_back(D.ParentPkg()->ID);
+   }
+}
+									/*}}}*/
+// DepCache::QueueReverseDepends - Update a list of reverse deps	/*{{{*/
+// ---------------------------------------------------------------------
+/* Like Update(DepIterator), but the versions owning the dependencies are
+   not rebuilt right away. Only the versions with a dependency which really
+   changed its state are queued in Dirty, the states of all others would
+   be computed again to the same result. */
+void pkgDepCache::QueueReverseDepends(DepIterator D,std::vector<Version *> &Dirty)
+{
+   for (;D.end() != true; ++D)
+   {
+      unsigned char &State = DepState[D->ID];
+      unsigned char const New = DependencyState(D);
+
+      // Conflicts are stored inverted
+      if (D.IsNegative() == true)
+      {
+	 if ((~State & 0x7) == New)
+	    continue;
+	 State = ~New;
+      }
+      else
+      {
+	 if ((State & 0x7) == New)
+	    continue;
+	 State = New;
+      }
+      Dirty.push_back(D.ParentVer());
    }
 }
 									/*}}}*/
@@ -739,21 +971,60 @@ void pkgDepCache::Update(PkgIterator const &Pkg)
    RemoveStates(Pkg);
    UpdateVerState(Pkg);
    AddStates(Pkg);
+   std::vector<map_ptrloc> * const Changes = d->Changes;
+   if (Changes != 0)
+      Changes->push_back(Pkg->ID);
    
    // Update the reverse deps
-   Update(Pkg.RevDependsList());
+   std::vector<Version *> Dirty;
+   QueueReverseDepends(Pkg.RevDependsList(), Dirty);
 
    // Update the provides map for the current ver
    if (Pkg->CurrentVer != 0)
       for (PrvIterator P = Pkg.CurrentVer().ProvidesList(); 
 	   P.end() != true; ++P)
-	 Update(P.ParentPkg().RevDependsList());
+	 QueueReverseDepends(P.ParentPkg().RevDependsList(), Dirty);
 
    // Update the provides map for the candidate ver
    if (PkgState[Pkg->ID].CandidateVer != 0)
       for (PrvIterator P = PkgState[Pkg->ID].CandidateVerIter(*this).ProvidesList();
 	   P.end() != true; ++P)
-	 Update(P.ParentPkg().RevDependsList());
+	 QueueReverseDepends(P.ParentPkg().RevDependsList(), Dirty);
+
+   if (Dirty.empty() == true)
+      return;
+
+   /* Rebuild each version with changed dependencies and each of their
+      packages only once, even if many of their dependencies changed */
+   std::sort(Dirty.begin(), Dirty.end());
+   Dirty.erase(std::unique(Dirty.begin(), Dirty.end()), Dirty.end());
+   std::vector<Package *> Parents;
+   Parents.reserve(Dirty.size());
+   for (std::vector<Version *>::const_iterator V = Dirty.begin(); V != Dirty.end(); ++V)
+   {
+      VerIterator Ver(*Cache, *V);
+      BuildGroupOrs(Ver);
+      Parents.push_back(Ver.ParentPkg());
+   }
+   std::sort(Parents.begin(), Parents.end());
+   Parents.erase(std::unique(Parents.begin(), Parents.end()), Parents.end());
+   for (std::vector<Package *>::const_iterator P = Parents.begin(); P != Parents.end(); ++P)
+   {
+      PkgIterator Parent(*Cache, *P);
+      RemoveStates(Parent);
+      UpdateVerState(Parent);
+      AddStates(Parent);
+      if (Changes != 0)
+	 Changes->push_back(Parent->ID);
+   }
+}
+									/*}}}*/
+// DepCache::RecordChanges - Log the packages whose state changes	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void pkgDepCache::RecordChanges(std::vector<map_ptrloc> * const Changes)
+{
+   d->Changes = Changes;
 }
 									/*}}}*/
 // DepCache::MarkKeep - Put the package in the keep state		/*{{{*/
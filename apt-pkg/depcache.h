@@ -495,12 +495,24 @@ class pkgDepCache : protected pkgCache::Namespace
    // Generate all state information
    void Update(OpProgress *Prog = 0);
 
+   /** Append the ID of every package whose state is computed again from
+    *  now on to Changes, until this is called again with \b 0.
+    *  IDs can be appended more than once. */
+   void RecordChanges(std::vector<map_ptrloc> * const Changes);
+
    pkgDepCache(pkgCache *Cache,Policy *Plcy = 0);
    virtual ~pkgDepCache();
 
    private:
+   /** \brief remembered version comparisons and the recorded changes */
+   struct Private;
+   Private * const d;
+
    bool IsModeChangeOk(ModeList const mode, PkgIterator const &Pkg,
 			unsigned long const Depth, bool const FromUser);
+   void BuildDependencyStates(PkgIterator const &Pkg,unsigned char * const States);
+   bool ParallelDependencyStates();
+   void QueueReverseDepends(DepIterator D,std::vector<Version *> &Dirty);
 };
 
 #endif
@@ -35,6 +35,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -51,8 +52,8 @@ pkgCache::Header::Header()
    
    /* Whenever the structures change the major version should be bumped,
       whenever the generator changes the minor version should be bumped. */
-   MajorVersion = 8;
-   MinorVersion = 0;
+   MajorVersion = 13;
+   MinorVersion = 1;
    Dirty = false;
    
    HeaderSz = sizeof(pkgCache::Header);
@@ -82,8 +83,10 @@ pkgCache::Header::Header()
    StringList = 0;
    VerSysName = 0;
    Architecture = 0;
-   memset(PkgHashTable,0,sizeof(PkgHashTable));
-   memset(GrpHashTable,0,sizeof(GrpHashTable));
+   HashTableSize = 0;
+   PkgHashTableStart = 0;
+   GrpHashTableStart = 0;
+   Checkpoints = 0;
    memset(Pools,0,sizeof(Pools));
 
    CacheFileSize = 0;
@@ -175,23 +178,30 @@ bool pkgCache::ReMap(bool const &Errorchecks)
 									/*}}}*/
 // Cache::Hash - Hash a string						/*{{{*/
 // ---------------------------------------------------------------------
-/* This is used to generate the hash entries for the HashTable. With my
-   package list from bo this function gets 94% table usage on a 512 item
-   table (480 used items) */
+/* This is used to generate the hash entries for the HashTable. It is a
+   FNV-1a hash over the lowercase name with a final mixing step, so that
+   also the low bits used for the (power of two sized) table are good. */
+static inline unsigned long FinishHash(uint32_t Hash, map_ptrloc const Size)
+{
+   Hash ^= Hash >> 16;
+   Hash *= 0x85ebca6b;
+   Hash ^= Hash >> 13;
+   return Hash & (Size - 1);
+}
 unsigned long pkgCache::sHash(const string &Str) const
 {
-   unsigned long Hash = 0;
+   uint32_t Hash = 2166136261U;
    for (string::const_iterator I = Str.begin(); I != Str.end(); ++I)
-      Hash = 5*Hash + tolower_ascii(*I);
-   return Hash % _count(HeaderP->PkgHashTable);
+      Hash = (Hash ^ tolower_ascii(*I)) * 16777619U;
+   return FinishHash(Hash, HeaderP->HashTableSize);
 }
 
 unsigned long pkgCache::sHash(const char *Str) const
 {
-   unsigned long Hash = 0;
+   uint32_t Hash = 2166136261U;
    for (const char *I = Str; *I != 0; ++I)
-      Hash = 5*Hash + tolower_ascii(*I);
-   return Hash % _count(HeaderP->PkgHashTable);
+      Hash = (Hash ^ tolower_ascii(*I)) * 16777619U;
+   return FinishHash(Hash, HeaderP->HashTableSize);
 }
 
 									/*}}}*/
@@ -203,7 +213,7 @@ unsigned long pkgCache::sHash(const char *Str) const
 pkgCache::PkgIterator pkgCache::SingleArchFindPkg(const string &Name)
 {
    // Look at the hash bucket
-   Package *Pkg = PkgP + HeaderP->PkgHashTable[Hash(Name)];
+   Package *Pkg = PkgP + HeaderP->PkgHashTable()[Hash(Name)];
    for (; Pkg != PkgP; Pkg = PkgP + Pkg->NextPackage)
    {
       if (Pkg->Name != 0 && StrP[Pkg->Name] == Name[0] &&
@@ -263,7 +273,7 @@ pkgCache::GrpIterator pkgCache::FindGrp(const string &Name) {
 		return GrpIterator(*this,0);
 
 	// Look at the hash bucket for the group
-	Group *Grp = GrpP + HeaderP->GrpHashTable[sHash(Name)];
+	Group *Grp = GrpP + HeaderP->GrpHashTable()[sHash(Name)];
 	for (; Grp != GrpP; Grp = GrpP + Grp->Next) {
 		if (Grp->Name != 0 && StrP[Grp->Name] == Name[0] &&
 		    stringcasecmp(Name, StrP + Grp->Name) == 0)
@@ -408,10 +418,10 @@ void pkgCache::GrpIterator::operator ++(int)
       S = Owner->GrpP + S->Next;
 
    // Follow the hash table
-   while (S == Owner->GrpP && (HashIndex+1) < (signed)_count(Owner->HeaderP->GrpHashTable))
+   while (S == Owner->GrpP && (HashIndex+1) < (signed)Owner->HeaderP->HashTableSize)
    {
       HashIndex++;
-      S = Owner->GrpP + Owner->HeaderP->GrpHashTable[HashIndex];
+      S = Owner->GrpP + Owner->HeaderP->GrpHashTable()[HashIndex];
    }
 };
 									/*}}}*/
@@ -425,10 +435,10 @@ void pkgCache::PkgIterator::operator ++(int)
       S = Owner->PkgP + S->NextPackage;
 
    // Follow the hash table
-   while (S == Owner->PkgP && (HashIndex+1) < (signed)_count(Owner->HeaderP->PkgHashTable))
+   while (S == Owner->PkgP && (HashIndex+1) < (signed)Owner->HeaderP->HashTableSize)
    {
       HashIndex++;
-      S = Owner->PkgP + Owner->HeaderP->PkgHashTable[HashIndex];
+      S = Owner->PkgP + Owner->HeaderP->PkgHashTable()[HashIndex];
    }
 };
 									/*}}}*/
@@ -601,6 +611,28 @@ bool pkgCache::DepIterator::SmartTargetPkg(PkgIterator &Result) const
    return false;
 }
 									/*}}}*/
+// DepIterator::IsSatisfied - Check a version against the dependency	/*{{{*/
+// ---------------------------------------------------------------------
+/* Versions of the target group have a rank in the cache, so they can be
+   checked without parsing the version strings */
+bool pkgCache::DepIterator::IsSatisfied(VerIterator const &Ver) const
+{
+   if (Ver->Rank == 0 || S->TargetRank == 0 ||
+       Ver.ParentPkg()->Group != TargetPkg()->Group)
+      return Owner->VS->CheckDep(Ver.VerStr(),S->CompareOp,TargetVer());
+
+   switch (S->CompareOp & 0x0F)
+   {
+      case Dep::LessEq: return Ver->Rank <= S->TargetRank;
+      case Dep::GreaterEq: return Ver->Rank >= S->TargetRank;
+      case Dep::Less: return Ver->Rank < S->TargetRank;
+      case Dep::Greater: return Ver->Rank > S->TargetRank;
+      case Dep::Equals: return Ver->Rank == S->TargetRank;
+      case Dep::NotEquals: return Ver->Rank != S->TargetRank;
+   }
+   return false;
+}
+									/*}}}*/
 // DepIterator::AllTargets - Returns the set of all possible targets	/*{{{*/
 // ---------------------------------------------------------------------
 /* This is a more useful version of TargetPkg() that follows versioned
@@ -622,7 +654,7 @@ pkgCache::Version **pkgCache::DepIterator::AllTargets() const
 	 if (IsIgnorable(I.ParentPkg()) == true)
 	    continue;
 
-	 if (Owner->VS->CheckDep(I.VerStr(),S->CompareOp,TargetVer()) == false)
+	 if (IsSatisfied(I) == false)
 	    continue;
 
 	 Size++;
@@ -745,6 +777,10 @@ int pkgCache::VerIterator::CompareVer(const VerIterator &B) const
       return -1;
    if (B.end() == true)
       return 1;
+
+   // Versions with the same rank are in the list in insertion order
+   if (S->Rank != 0 && B->Rank != 0 && S->Rank != B->Rank)
+      return S->Rank < B->Rank ? -1 : 1;
        
    /* Start at A and look for B. If B is found then A > B otherwise
       B was before A so A < B */
@@ -56,7 +56,7 @@
      Package *PkgList = (Package *)Map;
      Header *Head = (Header *)Map;
      char *Strings = (char *)Map;
-     cout << (Strings + PkgList[Head->HashTable[0]]->Name) << endl;
+     cout << (Strings + PkgList[Head->PkgHashTable()[0]]->Name) << endl;
    </example>
    Notice the lack of casting or multiplication. The net result is to return
    the name of the first package in the first hash bucket, without error
@@ -180,7 +180,7 @@ class pkgCache								/*{{{*/
    inline MMap &GetMap() {return Map;};
    inline void *DataEnd() {return ((unsigned char *)Map.Data()) + Map.Size();};
       
-   // String hashing function (512 range)
+   // String hashing function (range is Header::HashTableSize)
    inline unsigned long Hash(const std::string &S) const {return sHash(S);};
    inline unsigned long Hash(const char *S) const {return sHash(S);};
 
@@ -311,13 +311,26 @@ struct pkgCache::Header
        In the PkgHashTable is it possible that multiple packages have the same name -
        these packages are stored as a sequence in the list.
 
+       The tables are stored in the map, their size is a power of two chosen
+       by the generator depending on the number of package names.
+
        Beware: The Hashmethod assumes that the hash table sizes are equal */
-   map_ptrloc PkgHashTable[2*1048];
-   map_ptrloc GrpHashTable[2*1048];
+   map_ptrloc HashTableSize;
+   map_ptrloc PkgHashTableStart;
+   map_ptrloc GrpHashTableStart;
+   inline map_ptrloc* PkgHashTable() const {return (map_ptrloc*)((char*)this + PkgHashTableStart);};
+   inline map_ptrloc* GrpHashTable() const {return (map_ptrloc*)((char*)this + GrpHashTableStart);};
 
    /** \brief Size of the complete cache file */
    unsigned long  CacheFileSize;
 
+   /** \brief Offset of the checkpoint recorded before the last index file was merged
+
+       The generator records the state of the cache before each index file is
+       merged, so that a changed file and all files merged after it can be removed
+       from the cache again instead of building the cache from scratch. */
+   map_ptrloc Checkpoints;
+
    bool CheckSizes(Header &Against) const;
    Header();
 };
@@ -328,7 +341,7 @@ struct pkgCache::Header
     On or more packages with the same name form a group, so we have
     a simple way to access a package built for different architectures
     Group exists in a singly linked list of group records starting at
-    the hash index of the name in the pkgCache::Header::GrpHashTable */
+    the hash index of the name in the pkgCache::Header::GrpHashTable() */
 struct pkgCache::Group
 {
    /** \brief Name of the group */
@@ -351,7 +364,7 @@ struct pkgCache::Group
 
     There can be any number of versions of a given package.
     Package exists in a singly linked list of package records starting at
-    the hash index of the name in the pkgCache::Header::PkgHashTable
+    the hash index of the name in the pkgCache::Header::PkgHashTable()
 
     A package can be created for every architecture so package names are
     not unique, but it is garanteed that packages with the same name
@@ -554,6 +567,13 @@ struct pkgCache::Version
    unsigned int ID;
    /** \brief parsed priority value */
    unsigned char Priority;
+   /** \brief sort rank of this version in its group
+
+       All versions of the packages in a group and the versions their
+       reverse dependencies are applied against are ranked by the
+       generator, so that versions of the same group can be compared
+       as integers. 0 if the rank is unknown - compare the strings then. */
+   unsigned short Rank;
 };
 									/*}}}*/
 // Description structure						/*{{{*/
@@ -613,6 +633,10 @@ struct pkgCache::Dependency
 
        If the high bit is set then it is a logical OR with the previous record. */
    unsigned char CompareOp;
+   /** \brief rank of the Version string in the group of the target package
+
+       Comparable with pkgCache::Version::Rank, 0 if unknown. */
+   unsigned short TargetRank;
 };
 									/*}}}*/
 // Provides structure							/*{{{*/
@@ -27,11 +27,13 @@
 #include <apt-pkg/metaindex.h>
 #include <apt-pkg/fileutl.h>
 
+#include <algorithm>
 #include <vector>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdio.h>
+#include <fcntl.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -43,6 +45,112 @@ bool IsDuplicateDescription(pkgCache::DescIterator Desc,
 
 using std::string;
 
+// CacheGenerator::Checkpoint - State of the cache before a file	/*{{{*/
+// ---------------------------------------------------------------------
+/* Only the parts of the header changed by merging a file are kept.
+   Everything merged after the checkpoint was allocated behind MapSize or
+   in the free part of a pool, so this is enough to decide if a structure
+   belongs to the removed files. */
+struct pkgCacheGenerator::Checkpoint
+{
+   map_ptrloc Next;		// Checkpoint
+   map_ptrloc Changes;		// PackageChange
+   unsigned long long MapSize;
+
+   unsigned long GroupCount;
+   unsigned long PackageCount;
+   unsigned long VersionCount;
+   unsigned long DescriptionCount;
+   unsigned long DependsCount;
+   unsigned long PackageFileCount;
+   unsigned long VerFileCount;
+   unsigned long DescFileCount;
+   unsigned long ProvidesCount;
+   map_ptrloc FileList;		// PackageFile
+   unsigned long MaxVerFileSize;
+   unsigned long MaxDescFileSize;
+   DynamicMMap::Pool Pools[9];
+   map_ptrloc HashTableSize;
+   map_ptrloc PkgHashTableStart;
+   map_ptrloc GrpHashTableStart;
+
+   void Save(pkgCache::Header const &Head)
+   {
+      Next = Head.Checkpoints;
+      GroupCount = Head.GroupCount;
+      PackageCount = Head.PackageCount;
+      VersionCount = Head.VersionCount;
+      DescriptionCount = Head.DescriptionCount;
+      DependsCount = Head.DependsCount;
+      PackageFileCount = Head.PackageFileCount;
+      VerFileCount = Head.VerFileCount;
+      DescFileCount = Head.DescFileCount;
+      ProvidesCount = Head.ProvidesCount;
+      FileList = Head.FileList;
+      MaxVerFileSize = Head.MaxVerFileSize;
+      MaxDescFileSize = Head.MaxDescFileSize;
+      memcpy(Pools, Head.Pools, sizeof(Pools));
+      HashTableSize = Head.HashTableSize;
+      PkgHashTableStart = Head.PkgHashTableStart;
+      GrpHashTableStart = Head.GrpHashTableStart;
+   }
+
+   void Restore(pkgCache::Header &Head) const
+   {
+      Head.Checkpoints = Next;
+      Head.GroupCount = GroupCount;
+      Head.PackageCount = PackageCount;
+      Head.VersionCount = VersionCount;
+      Head.DescriptionCount = DescriptionCount;
+      Head.DependsCount = DependsCount;
+      Head.PackageFileCount = PackageFileCount;
+      Head.VerFileCount = VerFileCount;
+      Head.DescFileCount = DescFileCount;
+      Head.ProvidesCount = ProvidesCount;
+      Head.FileList = FileList;
+      Head.MaxVerFileSize = MaxVerFileSize;
+      Head.MaxDescFileSize = MaxDescFileSize;
+      memcpy(Head.Pools, Pools, sizeof(Pools));
+      Head.HashTableSize = HashTableSize;
+      Head.PkgHashTableStart = PkgHashTableStart;
+      Head.GrpHashTableStart = GrpHashTableStart;
+   }
+
+   bool IsNew(map_ptrloc const Index, unsigned long const Size) const
+   {
+      unsigned long long const Offset = (unsigned long long)Index * Size;
+      if (Offset >= MapSize)
+	 return true;
+      for (unsigned int I = 0; I != _count(Pools); ++I)
+	 if (Pools[I].ItemSize == Size && Offset >= Pools[I].Start &&
+	     Offset < Pools[I].Start + Pools[I].Count * Size)
+	    return true;
+      return false;
+   }
+
+   // Drop the structures newer than the checkpoint from a list
+   template<class T>
+   void RemoveNew(T * const Base, map_ptrloc &List, map_ptrloc T::*Next) const
+   {
+      map_ptrloc *Last = &List;
+      for (map_ptrloc I = List; I != 0; I = Base[I].*Next)
+      {
+	 if (IsNew(I, sizeof(T)) == true)
+	    continue;
+	 *Last = I;
+	 Last = &(Base[I].*Next);
+      }
+      *Last = 0;
+   }
+};
+struct pkgCacheGenerator::PackageChange
+{
+   map_ptrloc Next;		// PackageChange
+   map_ptrloc Package;		// Package
+   map_ptrloc Section;		// StringItem
+   unsigned long Flags;
+};
+									/*}}}*/
 // CacheGenerator::pkgCacheGenerator - Constructor			/*{{{*/
 // ---------------------------------------------------------------------
 /* We set the dirty flag and make sure that is written to the disk */
@@ -73,6 +181,8 @@ pkgCacheGenerator::pkgCacheGenerator(DynamicMMap *pMap,OpProgress *Prog) :
       Cache.HeaderP->Architecture = idxArchitecture;
       if (unlikely(idxVerSysName == 0 || idxArchitecture == 0))
 	 return;
+      if (unlikely(ResizeHashTables(2048) == false))
+	 return;
       Cache.ReMap();
    }
    else
@@ -99,6 +209,7 @@ pkgCacheGenerator::~pkgCacheGenerator()
 {
    if (_error->PendingError() == true)
       return;
+   RankVersions();
    if (Map.Sync() == false)
       return;
    
@@ -107,6 +218,87 @@ pkgCacheGenerator::~pkgCacheGenerator()
    Map.Sync(0,sizeof(pkgCache::Header));
 }
 									/*}}}*/
+// CacheGenerator::RankVersions - Give the versions of a group a rank	/*{{{*/
+// ---------------------------------------------------------------------
+/* The versions of all packages in a group and the versions the reverse
+   dependencies of these packages are applied against are sorted; equal
+   versions share a rank. Versions of the same group (and dependencies on
+   them) can then be compared as integers, which is what the depcache and
+   the resolver do most of the time. Empty versions and groups with more
+   versions than a rank can hold get rank 0: compare the strings then.
+   The ranks are recomputed for the complete cache, so the values in a
+   reused source cache do not matter. */
+struct RankItem
+{
+   char const *Version;
+   unsigned short *Rank;
+   RankItem(char const * const Version, unsigned short * const Rank) :
+	 Version(Version), Rank(Rank) {};
+   bool operator <(RankItem const &Other) const
+	 { return strcmp(Version, Other.Version) < 0; };
+};
+struct RankVersionCompare
+{
+   pkgVersioningSystem * const VS;
+   std::vector<RankItem> const &Items;
+   RankVersionCompare(pkgVersioningSystem * const VS, std::vector<RankItem> const &Items) :
+	 VS(VS), Items(Items) {};
+   bool operator ()(size_t const A, size_t const B) const
+	 { return VS->CmpVersion(Items[A].Version, Items[B].Version) < 0; };
+};
+void pkgCacheGenerator::RankVersions()
+{
+   std::vector<RankItem> Items;
+   // index of the first item of each distinct version string
+   std::vector<size_t> Distinct;
+   for (pkgCache::GrpIterator G = Cache.GrpBegin(); G.end() == false; ++G)
+   {
+      Items.clear();
+      for (pkgCache::PkgIterator P = G.PackageList(); P.end() == false; P = G.NextPkg(P))
+      {
+	 for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+	 {
+	    V->Rank = 0;
+	    if (V->VerStr != 0 && *V.VerStr() != '\0')
+	       Items.push_back(RankItem(V.VerStr(), &V->Rank));
+	 }
+	 for (pkgCache::DepIterator D = P.RevDependsList(); D.end() == false; ++D)
+	 {
+	    D->TargetRank = 0;
+	    if (D->Version != 0 && *D.TargetVer() != '\0')
+	       Items.push_back(RankItem(D.TargetVer(), &D->TargetRank));
+	 }
+      }
+      if (Items.empty() == true)
+	 continue;
+
+      /* Most dependencies carry one of a handful of strings, so sort the
+	 duplicates together cheaply first and only parse the distinct ones */
+      std::sort(Items.begin(), Items.end());
+      Distinct.clear();
+      for (size_t I = 0; I != Items.size(); ++I)
+	 if (I == 0 || strcmp(Items[I - 1].Version, Items[I].Version) != 0)
+	    Distinct.push_back(I);
+      std::sort(Distinct.begin(), Distinct.end(), RankVersionCompare(Cache.VS, Items));
+
+      unsigned long Rank = 0;
+      for (std::vector<size_t>::const_iterator D = Distinct.begin(); D != Distinct.end(); ++D)
+      {
+	 if (D == Distinct.begin() ||
+	     Cache.VS->CmpVersion(Items[*(D - 1)].Version, Items[*D].Version) != 0)
+	    ++Rank;
+	 if (Rank > 0xFFFF)
+	    break;
+	 for (size_t I = *D; I != Items.size() &&
+	       strcmp(Items[I].Version, Items[*D].Version) == 0; ++I)
+	    *Items[I].Rank = Rank;
+      }
+      if (Rank > 0xFFFF)
+	 for (std::vector<RankItem>::const_iterator I = Items.begin(); I != Items.end(); ++I)
+	    *I->Rank = 0;
+   }
+}
+									/*}}}*/
 void pkgCacheGenerator::ReMap(void const * const oldMap, void const * const newMap) {/*{{{*/
    if (oldMap == newMap)
       return;
@@ -171,6 +363,64 @@ map_ptrloc pkgCacheGenerator::AllocateInMap(const unsigned long &size) {/*{{{*/
    return index;
 }
 									/*}}}*/
+// CacheGenerator::ResizeHashTables - (Re)create the hash tables	/*{{{*/
+// ---------------------------------------------------------------------
+/* New tables of the given size are allocated in the map and all groups
+   and packages in the old tables are moved over to them. The old tables
+   remain as unused space in the map, but as the size is doubled each
+   time this is never more than the size of the final tables. */
+bool pkgCacheGenerator::ResizeHashTables(map_ptrloc const Size)
+{
+   void const * const oldMap = Map.Data();
+   unsigned long const Tables = Map.RawAllocate(2 * Size * sizeof(map_ptrloc), sizeof(map_ptrloc));
+   if (unlikely(Tables == 0))
+      return false;
+   ReMap(oldMap, Map.Data());
+   memset((char *)Map.Data() + Tables, 0, 2 * Size * sizeof(map_ptrloc));
+
+   pkgCache::Header * const Head = Cache.HeaderP;
+   map_ptrloc const OldSize = Head->HashTableSize;
+   map_ptrloc const * const OldGrpTable = Head->GrpHashTable();
+   Head->HashTableSize = Size;
+   Head->GrpHashTableStart = Tables;
+   Head->PkgHashTableStart = Tables + Size * sizeof(map_ptrloc);
+
+   for (map_ptrloc I = 0; I < OldSize; ++I)
+   {
+      map_ptrloc Group = OldGrpTable[I];
+      while (Group != 0)
+      {
+	 map_ptrloc const Next = Cache.GrpP[Group].Next;
+	 LinkGroupInHashTables(Group);
+	 Group = Next;
+      }
+   }
+
+   if (_config->FindB("Debug::pkgCacheGen", false) == true)
+      std::clog << "Resized hash tables from " << OldSize << " to " << Size
+		<< " buckets for " << Head->GroupCount << " groups" << std::endl;
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::LinkGroupInHashTables - Insert a group and its packages/*{{{*/
+// ---------------------------------------------------------------------
+/* The packages of a group are a sequence in the package list, so it
+   is enough to link the last package of the group to the bucket */
+void pkgCacheGenerator::LinkGroupInHashTables(map_ptrloc const Group)
+{
+   pkgCache::Group * const Grp = Cache.GrpP + Group;
+   unsigned long const Hash = Cache.Hash(Cache.StrP + Grp->Name);
+   map_ptrloc * const GrpTable = Cache.HeaderP->GrpHashTable();
+   map_ptrloc * const PkgTable = Cache.HeaderP->PkgHashTable();
+   Grp->Next = GrpTable[Hash];
+   GrpTable[Hash] = Group;
+   if (Grp->FirstPackage != 0)
+   {
+      Cache.PkgP[Grp->LastPackage].NextPackage = PkgTable[Hash];
+      PkgTable[Hash] = Grp->FirstPackage;
+   }
+}
+									/*}}}*/
 // CacheGenerator::MergeList - Merge the package list			/*{{{*/
 // ---------------------------------------------------------------------
 /* This provides the generation of the entries in the cache. Each loop
@@ -273,7 +523,7 @@ bool pkgCacheGenerator::MergeListPackage(ListParser &List, pkgCache::PkgIterator
    // (for deb this package processing is in fact a no-op)
    pkgCache::VerIterator Ver(Cache);
    Dynamic<pkgCache::VerIterator> DynVer(Ver);
-   if (List.UsePackage(Pkg, Ver) == false)
+   if (UsePackage(List, Pkg, Ver) == false)
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
 			   Pkg.Name(), "UsePackage", 1);
 
@@ -351,7 +601,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
       /* We already have a version for this item, record that we saw it */
       if (Res == 0 && Ver.end() == false && Ver->Hash == Hash)
       {
-	 if (List.UsePackage(Pkg,Ver) == false)
+	 if (UsePackage(List,Pkg,Ver) == false)
 	    return _error->Error(_("Error occurred while processing %s (%s%d)"),
 				 Pkg.Name(), "UsePackage", 2);
 
@@ -386,7 +636,7 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
 			   Pkg.Name(), "NewVersion", 2);
 
-   if (unlikely(List.UsePackage(Pkg,Ver) == false))
+   if (unlikely(UsePackage(List,Pkg,Ver) == false))
       return _error->Error(_("Error occurred while processing %s (%s%d)"),
 			   Pkg.Name(), "UsePackage", 3);
 
@@ -469,6 +719,42 @@ bool pkgCacheGenerator::MergeListVersion(ListParser &List, pkgCache::PkgIterator
 }
 									/*}}}*/
 									/*}}}*/
+// CacheGenerator::UsePackage - Let the parser fill in the package	/*{{{*/
+// ---------------------------------------------------------------------
+/* Section and flags of packages which were already in the cache before
+   the current file was selected are recorded if the parser changes them,
+   so that RemoveIndexFiles can restore them. */
+bool pkgCacheGenerator::UsePackage(ListParser &List, pkgCache::PkgIterator &Pkg,
+				   pkgCache::VerIterator &Ver)
+{
+   map_ptrloc const Section = Pkg->Section;
+   unsigned long const Flags = Pkg->Flags;
+   if (List.UsePackage(Pkg, Ver) == false)
+      return false;
+
+   map_ptrloc const Last = Cache.HeaderP->Checkpoints;
+   if ((Section == Pkg->Section && Flags == Pkg->Flags) || Last == 0 || CurrentFile == 0)
+      return true;
+   if (Pkg->ID >= ((Checkpoint *)((char *)Map.Data() + Last))->PackageCount)
+      return true;
+
+   map_ptrloc const Package = Pkg.Index();
+   void const * const oldMap = Map.Data();
+   map_ptrloc const idxChange = Map.RawAllocate(sizeof(PackageChange), sizeof(map_ptrloc));
+   if (unlikely(idxChange == 0))
+      return false;
+   ReMap(oldMap, Map.Data());
+
+   PackageChange * const Change = (PackageChange *)((char *)Map.Data() + idxChange);
+   Checkpoint * const C = (Checkpoint *)((char *)Map.Data() + Last);
+   Change->Package = Package;
+   Change->Section = Section;
+   Change->Flags = Flags;
+   Change->Next = C->Changes;
+   C->Changes = idxChange;
+   return true;
+}
+									/*}}}*/
 // CacheGenerator::MergeFileProvides - Merge file provides   		/*{{{*/
 // ---------------------------------------------------------------------
 /* If we found any file depends while parsing the main list we need to 
@@ -542,10 +828,14 @@ bool pkgCacheGenerator::NewGroup(pkgCache::GrpIterator &Grp, const string &Name)
 
    // Insert it into the hash table
    unsigned long const Hash = Cache.Hash(Name);
-   Grp->Next = Cache.HeaderP->GrpHashTable[Hash];
-   Cache.HeaderP->GrpHashTable[Hash] = Group;
+   Grp->Next = Cache.HeaderP->GrpHashTable()[Hash];
+   Cache.HeaderP->GrpHashTable()[Hash] = Group;
 
    Grp->ID = Cache.HeaderP->GroupCount++;
+
+   // Keep the hash chains short by growing the tables with the names
+   if (Cache.HeaderP->GroupCount > Cache.HeaderP->HashTableSize)
+      return ResizeHashTables(2 * Cache.HeaderP->HashTableSize);
    return true;
 }
 									/*}}}*/
@@ -574,8 +864,8 @@ bool pkgCacheGenerator::NewPackage(pkgCache::PkgIterator &Pkg,const string &Name
    {
       // Insert it into the hash table
       unsigned long const Hash = Cache.Hash(Name);
-      Pkg->NextPackage = Cache.HeaderP->PkgHashTable[Hash];
-      Cache.HeaderP->PkgHashTable[Hash] = Package;
+      Pkg->NextPackage = Cache.HeaderP->PkgHashTable()[Hash];
+      Cache.HeaderP->PkgHashTable()[Hash] = Package;
       Grp->FirstPackage = Package;
    }
    else // Group the Packages together
@@ -928,6 +1218,146 @@ bool pkgCacheGenerator::ListParser::NewProvides(pkgCache::VerIterator &Ver,
    return true;
 }
 									/*}}}*/
+// CacheGenerator::AddCheckpoint - Record the state of the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool pkgCacheGenerator::AddCheckpoint()
+{
+   unsigned long long const MapSize = Map.Size();
+   void const * const oldMap = Map.Data();
+   map_ptrloc const idxCheckpoint = Map.RawAllocate(sizeof(Checkpoint), sizeof(unsigned long long));
+   if (unlikely(idxCheckpoint == 0))
+      return false;
+   ReMap(oldMap, Map.Data());
+
+   Checkpoint * const C = (Checkpoint *)((char *)Map.Data() + idxCheckpoint);
+   C->Save(*Cache.HeaderP);
+   C->MapSize = MapSize;
+   C->Changes = 0;
+   Cache.HeaderP->Checkpoints = idxCheckpoint;
+   return true;
+}
+									/*}}}*/
+// CacheGenerator::RemoveIndexFiles - Remove files from the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* The cache is brought back to the state before the file with the given
+   ID was merged, so this file and all files merged after it are removed.
+   The structures of the kept files are unlinked from everything which was
+   added later on, the changes recorded for their packages are undone and
+   the map is truncated to its size at the checkpoint. */
+bool pkgCacheGenerator::RemoveIndexFiles(unsigned long const ID)
+{
+   pkgCache::Header * const Head = Cache.HeaderP;
+   if (ID == Head->PackageFileCount)
+      return true;
+
+   map_ptrloc idxCheckpoint = Head->Checkpoints;
+   for (; idxCheckpoint != 0; idxCheckpoint = ((Checkpoint *)((char *)Map.Data() + idxCheckpoint))->Next)
+      if (((Checkpoint *)((char *)Map.Data() + idxCheckpoint))->PackageFileCount <= ID)
+	 break;
+   if (idxCheckpoint == 0 ||
+       ((Checkpoint *)((char *)Map.Data() + idxCheckpoint))->PackageFileCount != ID)
+      return _error->Error("Can't remove the index files from the cache as it has no checkpoint for them");
+   Checkpoint const C = *(Checkpoint *)((char *)Map.Data() + idxCheckpoint);
+
+   // Restore the packages changed by the removed files, oldest change last
+   for (map_ptrloc I = Head->Checkpoints; I != C.Next;)
+   {
+      Checkpoint const * const Newer = (Checkpoint *)((char *)Map.Data() + I);
+      for (map_ptrloc J = Newer->Changes; J != 0;)
+      {
+	 PackageChange const * const Change = (PackageChange *)((char *)Map.Data() + J);
+	 Cache.PkgP[Change->Package].Section = Change->Section;
+	 Cache.PkgP[Change->Package].Flags = Change->Flags;
+	 J = Change->Next;
+      }
+      I = Newer->Next;
+   }
+
+   // Collect the groups we keep and drop the new packages from them
+   std::vector<map_ptrloc> Groups;
+   Groups.reserve(C.GroupCount);
+   for (map_ptrloc I = 0; I != Head->HashTableSize; ++I)
+      for (map_ptrloc G = Head->GrpHashTable()[I]; G != 0; G = Cache.GrpP[G].Next)
+	 if (C.IsNew(G, sizeof(pkgCache::Group)) == false)
+	    Groups.push_back(G);
+   for (std::vector<map_ptrloc>::const_iterator G = Groups.begin(); G != Groups.end(); ++G)
+   {
+      pkgCache::Group * const Grp = Cache.GrpP + *G;
+      map_ptrloc First = 0;
+      map_ptrloc Last = 0;
+      for (map_ptrloc P = Grp->FirstPackage; P != 0; P = Cache.PkgP[P].NextPackage)
+      {
+	 if (C.IsNew(P, sizeof(pkgCache::Package)) == false)
+	 {
+	    if (Last == 0)
+	       First = P;
+	    else
+	       Cache.PkgP[Last].NextPackage = P;
+	    Last = P;
+	 }
+	 if (P == Grp->LastPackage)
+	    break;
+      }
+      Grp->FirstPackage = First;
+      Grp->LastPackage = Last;
+   }
+
+   // Unlink everything new from the packages, versions and descriptions we keep
+   for (std::vector<map_ptrloc>::const_iterator G = Groups.begin(); G != Groups.end(); ++G)
+   {
+      pkgCache::Group const * const Grp = Cache.GrpP + *G;
+      for (map_ptrloc P = Grp->FirstPackage; P != 0; P = Cache.PkgP[P].NextPackage)
+      {
+	 pkgCache::Package * const Pkg = Cache.PkgP + P;
+	 C.RemoveNew(Cache.VerP, Pkg->VersionList, &pkgCache::Version::NextVer);
+	 C.RemoveNew(Cache.DepP, Pkg->RevDepends, &pkgCache::Dependency::NextRevDepends);
+	 C.RemoveNew(Cache.ProvideP, Pkg->ProvidesList, &pkgCache::Provides::NextProvides);
+	 for (map_ptrloc V = Pkg->VersionList; V != 0; V = Cache.VerP[V].NextVer)
+	 {
+	    pkgCache::Version * const Ver = Cache.VerP + V;
+	    C.RemoveNew(Cache.VerFileP, Ver->FileList, &pkgCache::VerFile::NextFile);
+	    C.RemoveNew(Cache.DepP, Ver->DependsList, &pkgCache::Dependency::NextDepends);
+	    C.RemoveNew(Cache.ProvideP, Ver->ProvidesList, &pkgCache::Provides::NextPkgProv);
+	    // descriptions can be shared between versions, which does no harm here
+	    C.RemoveNew(Cache.DescP, Ver->DescriptionList, &pkgCache::Description::NextDesc);
+	    for (map_ptrloc D = Ver->DescriptionList; D != 0; D = Cache.DescP[D].NextDesc)
+	       C.RemoveNew(Cache.DescFileP, Cache.DescP[D].FileList, &pkgCache::DescFile::NextFile);
+	 }
+	 if (P == Grp->LastPackage)
+	    break;
+      }
+   }
+   map_ptrloc StringList = Head->StringList;
+   C.RemoveNew(Cache.StringItemP, StringList, &pkgCache::StringItem::NextItem);
+
+   // Go back to the old header and drop the space used by the removed files
+   C.Restore(*Head);
+   Head->StringList = StringList;
+   if (Map.Truncate(C.MapSize) == false)
+      return false;
+   memset(UniqHash, 0, sizeof(UniqHash));
+   CurrentFile = 0;
+
+   // new structures are expected to be zeroed, but the pools hand out old ones
+   for (unsigned int I = 0; I != _count(Head->Pools); ++I)
+      if (Head->Pools[I].ItemSize != 0 && Head->Pools[I].Count != 0)
+	 memset((char *)Map.Data() + Head->Pools[I].Start, 0,
+		Head->Pools[I].Count * Head->Pools[I].ItemSize);
+
+   /* The tables might have been resized in the meantime, so we use the
+      tables of the checkpoint and fill them again */
+   memset(Head->GrpHashTable(), 0, Head->HashTableSize * sizeof(map_ptrloc));
+   memset(Head->PkgHashTable(), 0, Head->HashTableSize * sizeof(map_ptrloc));
+   for (std::vector<map_ptrloc>::const_reverse_iterator G = Groups.rbegin(); G != Groups.rend(); ++G)
+      LinkGroupInHashTables(*G);
+
+   if (_config->FindB("Debug::pkgCacheGen", false) == true)
+      std::clog << "Removed index files from ID " << ID << " on from the cache, "
+		<< Head->PackageFileCount << " files and " << Map.Size() << " bytes left" << std::endl;
+   return true;
+}
+									/*}}}*/
 // CacheGenerator::SelectFile - Select the current file being parsed	/*{{{*/
 // ---------------------------------------------------------------------
 /* This is used to select which file is to be associated with all newly
@@ -936,6 +1366,10 @@ bool pkgCacheGenerator::SelectFile(const string &File,const string &Site,
 				   const pkgIndexFile &Index,
 				   unsigned long Flags)
 {
+   // Remember the state before the file, so that it can be removed again
+   if (unlikely(AddCheckpoint() == false))
+      return false;
+
    // Get some space for the structure
    map_ptrloc const idxFile = AllocateInMap(sizeof(*CurrentFile));
    if (unlikely(idxFile == 0))
@@ -1125,6 +1559,55 @@ static bool CheckValidity(const string &CacheFile,
    return true;
 }
 									/*}}}*/
+// FindReusableFiles - Find the index files which can be kept in a cache/*{{{*/
+// ---------------------------------------------------------------------
+/* The index files are merged in order, so all files before the first one
+   which changed, was added or removed can be kept in the cache while the
+   others have to be merged again. Start is moved to the first index file
+   which needs to be merged and the number of files to keep is returned. */
+static unsigned long FindReusableFiles(const string &CacheFile,
+				       FileIterator &Start, FileIterator End)
+{
+   bool const Debug = _config->FindB("Debug::pkgCacheGen", false);
+   if (CacheFile.empty() == true || FileExists(CacheFile) == false)
+      return 0;
+
+   FileFd CacheF(CacheFile,FileFd::ReadOnly);
+   SPtr<MMap> Map = new MMap(CacheF,0);
+   pkgCache Cache(Map);
+   if (_error->PendingError() == true || Map->Size() == 0)
+   {
+      _error->Discard();
+      return 0;
+   }
+
+   unsigned long Keep = 0;
+   FileIterator I = Start;
+   for (; I != End; ++I)
+   {
+      if ((*I)->HasPackages() == false || (*I)->Exists() == false)
+	 continue;
+      pkgCache::PkgFileIterator const File = (*I)->FindInCache(Cache);
+      // duplicated entries are skipped by BuildCache anyway
+      if (File.end() == true || File->ID > Keep)
+	 break;
+      if (File->ID == Keep)
+	 ++Keep;
+   }
+
+   if (_error->PendingError() == true)
+   {
+      _error->Discard();
+      return 0;
+   }
+   if (Debug == true)
+      std::clog << "Can keep " << Keep << " of " << Cache.HeaderP->PackageFileCount
+		<< " index files from " << CacheFile << std::endl;
+   if (Keep != 0)
+      Start = I;
+   return Keep;
+}
+									/*}}}*/
 // ComputeSize - Compute the total size of a bunch of files		/*{{{*/
 // ---------------------------------------------------------------------
 /* Size is kind of an abstract notion that is only used for the progress
@@ -1141,6 +1624,44 @@ static unsigned long ComputeSize(FileIterator Start,FileIterator End)
    return TotalSize;
 }
 									/*}}}*/
+// ReadAheadFile - Ask the kernel to read a file in the background	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+static void ReadAheadFile(std::string const &File)
+{
+   int const Fd = open(File.c_str(), O_RDONLY);
+   if (Fd < 0)
+      return;
+#ifdef POSIX_FADV_WILLNEED
+   posix_fadvise(Fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+   close(Fd);
+}
+									/*}}}*/
+// ReadAheadIndexFiles - Start reading the lists before merging them	/*{{{*/
+// ---------------------------------------------------------------------
+/* The lists are merged into the map one after the other to get a stable
+   cache, and handing the parsed records from other processes to the merge
+   would cost about as much as parsing them again. What we can do is to let
+   the kernel fetch the lists which are going to be merged from the disk in
+   parallel while we are busy parsing the first ones - the parsing itself
+   stays sequential. */
+static void ReadAheadIndexFiles(FileIterator Start, FileIterator const End)
+{
+   if (_config->FindB("APT::Cache-ReadAhead", true) == false)
+      return;
+
+   for (; Start != End; ++Start)
+   {
+      if ((*Start)->HasPackages() == false)
+	 continue;
+      string const File = (*Start)->IndexFileName();
+      if (File.empty() == true)
+	 continue;
+      ReadAheadFile(File);
+   }
+}
+									/*}}}*/
 // BuildCache - Merge the list of index files into the cache		/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -1194,6 +1715,19 @@ static bool BuildCache(pkgCacheGenerator &Gen,
    return true;
 }
 									/*}}}*/
+// LoadCacheFile - Copy a cache file into an empty map			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+static bool LoadCacheFile(DynamicMMap &Map, string const &CacheFile)
+{
+   FileFd CacheF(CacheFile,FileFd::ReadOnly);
+   unsigned long const alloc = Map.RawAllocate(CacheF.Size());
+   if ((alloc == 0 && _error->PendingError())
+	 || CacheF.Read((unsigned char *)Map.Data() + alloc, CacheF.Size()) == false)
+      return false;
+   return true;
+}
+									/*}}}*/
 // CacheGenerator::CreateDynamicMMap - load an mmap with configuration options	/*{{{*/
 DynamicMMap* pkgCacheGenerator::CreateDynamicMMap(FileFd *CacheF, unsigned long Flags) {
    unsigned long const MapStart = _config->FindI("APT::Cache-Start", 24*1024*1024);
@@ -1333,11 +1867,7 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
       if (Debug == true)
 	 std::clog << "srcpkgcache.bin is valid - populate MMap with it." << std::endl;
       // Preload the map with the source cache
-      FileFd SCacheF(SrcCacheFile,FileFd::ReadOnly);
-      unsigned long const alloc = Map->RawAllocate(SCacheF.Size());
-      if ((alloc == 0 && _error->PendingError())
-		|| SCacheF.Read((unsigned char *)Map->Data() + alloc,
-				SCacheF.Size()) == false)
+      if (LoadCacheFile(*Map, SrcCacheFile) == false)
 	 return false;
 
       TotalSize = ComputeSize(Files.begin()+EndOfSource,Files.end());
@@ -1352,16 +1882,32 @@ bool pkgCacheGenerator::MakeStatusCache(pkgSourceList &List,OpProgress *Progress
    }
    else
    {
-      if (Debug == true)
+      /* Keep the unchanged files of the old source cache and only merge
+         the files after them again */
+      FileIterator SourceStart = Files.begin();
+      unsigned long Reusable = 0;
+      if (_config->FindB("APT::Cache-Incremental", true) == true)
+	 Reusable = FindReusableFiles(SrcCacheFile, SourceStart, Files.begin()+EndOfSource);
+      if (Reusable != 0)
+      {
+	 if (Debug == true)
+	    std::clog << "srcpkgcache.bin is NOT valid - update it" << std::endl;
+	 if (LoadCacheFile(*Map, SrcCacheFile) == false)
+	    return false;
+      }
+      else if (Debug == true)
 	 std::clog << "srcpkgcache.bin is NOT valid - rebuild" << std::endl;
-      TotalSize = ComputeSize(Files.begin(),Files.end());
+      ReadAheadIndexFiles(SourceStart,Files.begin()+EndOfSource);
+      TotalSize = ComputeSize(SourceStart,Files.end());
       
       // Build the source cache
       pkgCacheGenerator Gen(Map.Get(),Progress);
       if (_error->PendingError() == true)
 	 return false;
+      if (Reusable != 0 && Gen.RemoveIndexFiles(Reusable) == false)
+	 return false;
       if (BuildCache(Gen,Progress,CurrentSize,TotalSize,
-		     Files.begin(),Files.begin()+EndOfSource) == false)
+		     SourceStart,Files.begin()+EndOfSource) == false)
 	 return false;
       
       // Write it back
@@ -40,6 +40,14 @@ class pkgCacheGenerator							/*{{{*/
    map_ptrloc WriteStringInMap(const char *String);
    map_ptrloc WriteStringInMap(const char *String, const unsigned long &Len);
    map_ptrloc AllocateInMap(const unsigned long &size);
+   bool ResizeHashTables(map_ptrloc const Size);
+   void LinkGroupInHashTables(map_ptrloc const Group);
+
+   struct Checkpoint;
+   struct PackageChange;
+   bool AddCheckpoint();
+   bool RemoveIndexFiles(unsigned long const ID);
+   void RankVersions();
 
    public:
    
@@ -112,6 +120,7 @@ class pkgCacheGenerator							/*{{{*/
    bool MergeListPackage(ListParser &List, pkgCache::PkgIterator &Pkg);
    bool MergeListVersion(ListParser &List, pkgCache::PkgIterator &Pkg,
 			 std::string const &Version, pkgCache::VerIterator* &OutVer);
+   bool UsePackage(ListParser &List, pkgCache::PkgIterator &Pkg, pkgCache::VerIterator &Ver);
 
    bool AddImplicitDepends(pkgCache::GrpIterator &G, pkgCache::PkgIterator &P,
 			   pkgCache::VerIterator &V);
@@ -7,6 +7,8 @@
    
    This uses a rotating buffer to load the package information into.
    The scanner runs over it and isolates and indexes a single section.
+   Uncompressed files opened readonly are mapped instead, so that the
+   sections can be handed out directly from the mapping.
    
    ##################################################################### */
 									/*}}}*/
@@ -17,10 +19,13 @@
 #include <apt-pkg/error.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/mmap.h>
 
 #include <string>
 #include <stdio.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -33,7 +38,7 @@ public:
    pkgTagFilePrivate(FileFd *pFd, unsigned long long Size) : Fd(*pFd), Buffer(NULL),
 							     Start(NULL), End(NULL),
 							     Done(false), iOffset(0),
-							     Size(Size)
+							     Size(Size), Map(NULL)
    {
    }
    FileFd &Fd;
@@ -43,8 +48,28 @@ public:
    bool Done;
    unsigned long long iOffset;
    unsigned long long Size;
+   // the whole file if it could be mapped, Buffer is only used for the tail then
+   MMap *Map;
 };
 
+// CanMapTagFile - Check if the file can be used directly via mmap	/*{{{*/
+// ---------------------------------------------------------------------
+/* Only plain files we read from the start and nobody writes to through
+   this descriptor are mapped - the files we usually parse (lists, status)
+   are replaced atomically, so the mapping can't be truncated below us. */
+static bool CanMapTagFile(FileFd &Fd)
+{
+   if (Fd.IsCompressed() == true)
+      return false;
+   int const Mode = fcntl(Fd.Fd(), F_GETFL);
+   if (Mode == -1 || (Mode & O_ACCMODE) != O_RDONLY)
+      return false;
+   struct stat Buf;
+   if (fstat(Fd.Fd(), &Buf) != 0 || S_ISREG(Buf.st_mode) == 0 || Buf.st_size == 0)
+      return false;
+   return lseek(Fd.Fd(), 0, SEEK_CUR) == 0;
+}
+									/*}}}*/
 // TagFile::pkgTagFile - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -59,7 +84,28 @@ pkgTagFile::pkgTagFile(FileFd *pFd,unsigned long long Size)
       d->iOffset = 0;
       return;
    }
-   
+
+   if (CanMapTagFile(d->Fd) == true)
+   {
+      _error->PushToStack();
+      d->Map = new MMap(d->Fd, MMap::ReadOnly);
+      if (_error->PendingError() == true || d->Map->validData() == false)
+      {
+	 delete d->Map;
+	 d->Map = NULL;
+      }
+      _error->RevertToStack();
+   }
+
+   if (d->Map != NULL)
+   {
+      d->Start = (char *) d->Map->Data();
+      d->End = d->Start + d->Map->Size();
+      d->Done = true;
+      d->iOffset = 0;
+      return;
+   }
+
    d->Buffer = new char[Size];
    d->Start = d->End = d->Buffer;
    d->Done = false;
@@ -73,6 +119,7 @@ pkgTagFile::pkgTagFile(FileFd *pFd,unsigned long long Size)
 pkgTagFile::~pkgTagFile()
 {
    delete [] d->Buffer;
+   delete d->Map;
    delete d;
 }
 									/*}}}*/
@@ -113,21 +160,37 @@ bool pkgTagFile::Resize()
 // ---------------------------------------------------------------------
 /* If the Section Scanner fails we refill the buffer and try again. 
  * If that fails too, double the buffer size and try again until a
- * maximum buffer is reached.
+ * maximum buffer is reached. A mapped file has no buffer to refill.
  */
 bool pkgTagFile::Step(pkgTagSection &Tag)
 {
-   while (Tag.Scan(d->Start,d->End - d->Start) == false)
+   if (d->Map != NULL)
    {
-      if (Fill() == false)
-	 return false;
-      
-      if(Tag.Scan(d->Start,d->End - d->Start))
-	 break;
+      /* The last section might not be terminated by an empty line,
+	 so Fill copies it to the buffer to be able to add the newlines */
+      if (Tag.Scan(d->Start,d->End - d->Start) == false)
+      {
+	 if (Fill() == false)
+	    return false;
+	 if (Tag.Scan(d->Start,d->End - d->Start) == false)
+	    return _error->Error(_("Unable to parse package file %s (1)"),
+				 d->Fd.Name().c_str());
+      }
+   }
+   else
+   {
+      while (Tag.Scan(d->Start,d->End - d->Start) == false)
+      {
+	 if (Fill() == false)
+	    return false;
 
-      if (Resize() == false)
-	 return _error->Error(_("Unable to parse package file %s (1)"),
-                              d->Fd.Name().c_str());
+	 if(Tag.Scan(d->Start,d->End - d->Start))
+	    break;
+
+	 if (Resize() == false)
+	    return _error->Error(_("Unable to parse package file %s (1)"),
+				 d->Fd.Name().c_str());
+      }
    }
    d->Start += Tag.size();
    d->iOffset += Tag.size();
@@ -139,12 +202,38 @@ bool pkgTagFile::Step(pkgTagSection &Tag)
 // TagFile::Fill - Top up the buffer					/*{{{*/
 // ---------------------------------------------------------------------
 /* This takes the bit at the end of the buffer and puts it at the start
-   then fills the rest from the file */
+   then fills the rest from the file. For a mapped file this copies the
+   rest of the file into the buffer once. */
 bool pkgTagFile::Fill()
 {
    unsigned long long EndSize = d->End - d->Start;
    unsigned long long Actual = 0;
-   
+
+   if (d->Map != NULL)
+   {
+      // the mapped file is complete, only the tail needs to be copied
+      if (d->Buffer != NULL)
+	 return false;
+      const char *C = d->Start;
+      for (; C < d->End && (*C == '\n' || *C == '\r'); ++C);
+      if (C == d->End)
+	 return false;
+
+      d->Size = EndSize + 2;
+      d->Buffer = new char[d->Size];
+      memcpy(d->Buffer,d->Start,EndSize);
+      d->Start = d->Buffer;
+      d->End = d->Buffer + EndSize;
+
+      unsigned int LineCount = 0;
+      for (const char *E = d->End - 1; E > d->Buffer && (*E == '\n' || *E == '\r'); E--)
+	 if (*E == '\n')
+	    LineCount++;
+      for (; LineCount < 2; LineCount++)
+	 *d->End++ = '\n';
+      return true;
+   }
+
    memmove(d->Buffer,d->Start,EndSize);
    d->Start = d->Buffer;
    d->End = d->Buffer + EndSize;
@@ -186,6 +275,19 @@ bool pkgTagFile::Fill()
    that is there */
 bool pkgTagFile::Jump(pkgTagSection &Tag,unsigned long long Offset)
 {
+   // With a mapped file this is just pointer arithmetic
+   if (d->Map != NULL)
+   {
+      if (Offset > d->Map->Size())
+	 return _error->Error(_("Unable to parse package file %s (2)"),d->Fd.Name().c_str());
+      delete [] d->Buffer;
+      d->Buffer = NULL;
+      d->Start = (char *) d->Map->Data() + Offset;
+      d->End = (char *) d->Map->Data() + d->Map->Size();
+      d->iOffset = Offset;
+      return Step(Tag);
+   }
+
    // We are within a buffer space of the next hit..
    if (Offset >= d->iOffset && d->iOffset + (d->End - d->Start) > Offset)
    {
@@ -284,28 +386,51 @@ void pkgTagSection::Trim()
 									/*}}}*/
 // TagSection::Find - Locate a tag					/*{{{*/
 // ---------------------------------------------------------------------
-/* This searches the section for a tag that matches the given string. */
+/* This searches the section for a tag that matches the given string.
+   Length and hash of the tag are computed in one go and candidates are
+   first checked for having the colon at the expected place and compared
+   case-sensitive as this is the usual case, only after that the slower
+   case-insensitive compare is tried. */
 bool pkgTagSection::Find(const char *Tag,unsigned &Pos) const
 {
-   unsigned int Length = strlen(Tag);
-   unsigned int I = AlphaIndexes[AlphaHash(Tag)];
+   unsigned long Hash = 0;
+   const char *T = Tag;
+   for (; *T != 0 && *T != ':'; ++T)
+      Hash = ((unsigned long)(*T) & 0xDF) ^ (Hash << 1);
+   unsigned int const Length = (*T == 0) ? T - Tag : strlen(Tag);
+
+   unsigned int I = AlphaIndexes[Hash & 0xFF];
    if (I == 0)
+   {
+      Pos = 0;
       return false;
+   }
    I--;
-   
-   for (unsigned int Counter = 0; Counter != TagCount; Counter++, 
-	I = (I+1)%TagCount)
+
+   for (unsigned int Counter = 0; Counter != TagCount; Counter++, I++)
    {
-      const char *St;
-      St = Section + Indexes[I];
-      if (strncasecmp(Tag,St,Length) != 0)
+      if (I == TagCount)
+	 I = 0;
+
+      // The tag needs at least a colon after the name
+      if (Indexes[I+1] - Indexes[I] <= Length)
 	 continue;
 
-      // Make sure the colon is in the right place
+      const char *St = Section + Indexes[I];
       const char *C = St + Length;
-      for (; isspace(*C) != 0; C++);
       if (*C != ':')
+      {
+	 // Make sure the colon is in the right place
+	 if (isspace(*C) == 0)
+	    continue;
+	 for (++C; isspace(*C) != 0; C++);
+	 if (*C != ':')
+	    continue;
+      }
+
+      if (memcmp(Tag, St, Length) != 0 && strncasecmp(Tag, St, Length) != 0)
 	 continue;
+
       Pos = I;
       return true;
    }
@@ -320,40 +445,23 @@ bool pkgTagSection::Find(const char *Tag,unsigned &Pos) const
 bool pkgTagSection::Find(const char *Tag,const char *&Start,
 		         const char *&End) const
 {
-   unsigned int Length = strlen(Tag);
-   unsigned int I = AlphaIndexes[AlphaHash(Tag)];
-   if (I == 0)
-      return false;
-   I--;
-   
-   for (unsigned int Counter = 0; Counter != TagCount; Counter++, 
-	I = (I+1)%TagCount)
+   unsigned int Pos;
+   if (Find(Tag, Pos) == false)
    {
-      const char *St;
-      St = Section + Indexes[I];
-      if (strncasecmp(Tag,St,Length) != 0)
-	 continue;
-      
-      // Make sure the colon is in the right place
-      const char *C = St + Length;
-      for (; isspace(*C) != 0; C++);
-      if (*C != ':')
-	 continue;
-
-      // Strip off the gunk from the start end
-      Start = C;
-      End = Section + Indexes[I+1];
-      if (Start >= End)
-	 return _error->Error("Internal parsing error");
-      
-      for (; (isspace(*Start) != 0 || *Start == ':') && Start < End; Start++);
-      for (; isspace(End[-1]) != 0 && End > Start; End--);
-      
-      return true;
+      Start = End = 0;
+      return false;
    }
-   
-   Start = End = 0;
-   return false;
+
+   // Strip off the gunk from the start end
+   Start = (const char *) memchr(Section + Indexes[Pos], ':', Indexes[Pos+1] - Indexes[Pos]);
+   End = Section + Indexes[Pos+1];
+   if (Start == 0)
+      return _error->Error("Internal parsing error");
+
+   for (; (isspace(*Start) != 0 || *Start == ':') && Start < End; Start++);
+   for (; isspace(End[-1]) != 0 && End > Start; End--);
+
+   return true;
 }
 									/*}}}*/
 // TagSection::FindS - Find a string					/*{{{*/
@@ -273,6 +273,35 @@ bool DumpPackage(CommandLine &CmdL)
    return true;
 }
 									/*}}}*/
+// ShowHashTableStats - Show the chain lengths of one hash table	/*{{{*/
+// ---------------------------------------------------------------------
+/* Next is the member linking the items of a chain together */
+template<class T>
+static void ShowHashTableStats(const char *Type, T *StartP, map_ptrloc const *Table,
+			       map_ptrloc const Size, map_ptrloc T::*Next)
+{
+   unsigned long Used = 0;
+   unsigned long Entries = 0;
+   unsigned long Longest = 0;
+   for (map_ptrloc I = 0; I != Size; ++I)
+   {
+      if (Table[I] == 0)
+	 continue;
+      ++Used;
+      unsigned long Length = 0;
+      for (T *P = StartP + Table[I]; P != StartP; P = StartP + (P->*Next))
+	 ++Length;
+      Entries += Length;
+      if (Length > Longest)
+	 Longest = Length;
+   }
+
+   cout << Type << endl;
+   cout << _("  Used buckets: ") << Used << " / " << Size << endl;
+   cout << _("  Average chain length: ") << (Used == 0 ? 0.0 : (double)Entries / Used) << endl;
+   cout << _("  Longest chain: ") << Longest << endl;
+}
+									/*}}}*/
 // Stats - Dump some nice statistics					/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -382,7 +411,13 @@ bool Stats(CommandLine &Cmd)
            Cache->Head().VerFileCount*Cache->Head().VerFileSz +
            Cache->Head().ProvidesCount*Cache->Head().ProvidesSz;
    cout << _("Total space accounted for: ") << SizeToStr(Total) << endl;
-   
+
+   // Hashtable stats
+   ShowHashTableStats(_("Package name hash table:"), Cache->GrpP, Cache->HeaderP->GrpHashTable(),
+		      Cache->HeaderP->HashTableSize, &pkgCache::Group::Next);
+   ShowHashTableStats(_("Package hash table:"), Cache->PkgP, Cache->HeaderP->PkgHashTable(),
+		      Cache->HeaderP->HashTableSize, &pkgCache::Package::NextPackage);
+
    return true;
 }
 									/*}}}*/
@@ -16,11 +16,18 @@
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/cmndline.h>
 #include <apt-pkg/strutl.h>
+#include <apt-pkg/fileutl.h>
 #include <apt-pkg/init.h>
 #include <algorithm>
 
 #include <climits>
+#include <sstream>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/select.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <regex.h>
 
 #include "apt-ftparchive.h"
@@ -742,6 +749,281 @@ bool SimpleGenRelease(CommandLine &CmdL)
    return true;
 }
 
+									/*}}}*/
+// GroupJobs - Split the maps into jobs which can run side by side	/*{{{*/
+// ---------------------------------------------------------------------
+/* Maps writing to the same cache database, the same index file or feeding
+   the same Translation master file can't be generated concurrently, so
+   they are put together into one job. The jobs keep the order of their
+   first map and each job its maps in the order they were given. */
+static void GroupJobs(vector<PackageMap *> const &Maps, bool const Sources,
+		      vector<vector<PackageMap *> > &Jobs)
+{
+   vector<unsigned int> JobOf(Maps.size());
+   for (unsigned int I = 0; I != Maps.size(); ++I)
+   {
+      JobOf[I] = I;
+      for (unsigned int J = 0; J != I; ++J)
+      {
+	 bool Shared;
+	 if (Sources == true)
+	    Shared = Maps[I]->SrcFile == Maps[J]->SrcFile;
+	 else
+	    Shared = Maps[I]->BinCacheDB == Maps[J]->BinCacheDB ||
+		     Maps[I]->PkgFile == Maps[J]->PkgFile ||
+		     (Maps[I]->TransWriter != NULL &&
+		      Maps[I]->TransWriter == Maps[J]->TransWriter);
+	 if (Shared == false || JobOf[J] == JobOf[I])
+	    continue;
+
+	 // merge the two jobs, the lower one wins
+	 unsigned int const From = max(JobOf[I], JobOf[J]);
+	 unsigned int const To = min(JobOf[I], JobOf[J]);
+	 for (unsigned int K = 0; K <= I; ++K)
+	    if (JobOf[K] == From)
+	       JobOf[K] = To;
+      }
+   }
+
+   vector<int> Index(Maps.size(), -1);
+   for (unsigned int I = 0; I != Maps.size(); ++I)
+   {
+      if (Index[JobOf[I]] == -1)
+      {
+	 Index[JobOf[I]] = Jobs.size();
+	 Jobs.push_back(vector<PackageMap *>());
+      }
+      Jobs[Index[JobOf[I]]].push_back(Maps[I]);
+   }
+}
+									/*}}}*/
+// RunJob - Generate the index files of one job in a worker process	/*{{{*/
+// ---------------------------------------------------------------------
+/* Runs in the forked worker: everything which would be printed is
+   collected and written together with the statistics and the remaining
+   messages of the error stack to the Result file for the parent. */
+static void RunJob(Configuration &Setup, vector<PackageMap *> const &Maps,
+		   bool const Sources, FILE * const Result)
+{
+   _error->Discard();
+   ostringstream Log;
+   if (c0out.rdbuf() != devnull.rdbuf())
+      c0out.rdbuf(Log.rdbuf());
+   if (c1out.rdbuf() != devnull.rdbuf())
+      c1out.rdbuf(Log.rdbuf());
+   if (c2out.rdbuf() != devnull.rdbuf())
+      c2out.rdbuf(Log.rdbuf());
+   cerr.rdbuf(Log.rdbuf());
+
+   struct CacheDB::Stats Stats;
+   for (vector<PackageMap *>::const_iterator I = Maps.begin(); I != Maps.end(); ++I)
+   {
+      bool const Res = (Sources == true) ? (*I)->GenSources(Setup,Stats) :
+					    (*I)->GenPackages(Setup,Stats);
+      if (Res == false)
+	 _error->DumpErrors();
+   }
+
+   string const Text = Log.str();
+   size_t const Length = Text.length();
+   fwrite(&Stats, sizeof(Stats), 1, Result);
+   fwrite(&Length, sizeof(Length), 1, Result);
+   fwrite(Text.c_str(), 1, Length, Result);
+   string Msg;
+   while (_error->empty(GlobalError::WARNING) == false)
+   {
+      char const Type = _error->PopMessage(Msg) == true ? 'E' : 'W';
+      size_t const MsgLength = Msg.length();
+      fwrite(&Type, 1, 1, Result);
+      fwrite(&MsgLength, sizeof(MsgLength), 1, Result);
+      fwrite(Msg.c_str(), 1, MsgLength, Result);
+   }
+}
+									/*}}}*/
+// CollectJob - Replay the output and statistics of a finished job	/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+static bool CollectJob(FILE * const Result, struct CacheDB::Stats &Stats)
+{
+   rewind(Result);
+   struct CacheDB::Stats JobStats;
+   size_t Length;
+   if (fread(&JobStats, sizeof(JobStats), 1, Result) != 1 ||
+       fread(&Length, sizeof(Length), 1, Result) != 1)
+      return _error->Error(_("Worker process returned no result"));
+   Stats.Add(JobStats);
+
+   string Text(Length, '\0');
+   if (Length != 0 && fread(&Text[0], 1, Length, Result) != Length)
+      return _error->Error(_("Worker process returned no result"));
+   clog << Text << flush;
+
+   char Type;
+   while (fread(&Type, 1, 1, Result) == 1)
+   {
+      if (fread(&Length, sizeof(Length), 1, Result) != 1)
+	 return _error->Error(_("Worker process returned no result"));
+      string Msg(Length, '\0');
+      if (Length != 0 && fread(&Msg[0], 1, Length, Result) != Length)
+	 return _error->Error(_("Worker process returned no result"));
+      _error->Insert(Type == 'E' ? GlobalError::ERROR : GlobalError::WARNING,
+		     "%s", Msg.c_str());
+   }
+   return true;
+}
+									/*}}}*/
+// GenerateMaps - Generate the Packages or Sources files of the maps	/*{{{*/
+// ---------------------------------------------------------------------
+/* Independent maps are handed out to up to Workers forked processes.
+   The output of each job is only printed once all jobs before it are
+   done, so the result looks exactly as if the maps had been generated
+   one after the other. Delinking shares its byte limit over all maps,
+   so this is done sequentially as are runs with just one worker. */
+static void GenerateMaps(Configuration &Setup, vector<PackageMap *> const &Maps,
+			 bool const Sources, struct CacheDB::Stats &Stats)
+{
+   unsigned int Workers = _config->FindI("APT::FTPArchive::Workers", 1);
+   for (vector<PackageMap *>::const_iterator I = Maps.begin(); I != Maps.end(); ++I)
+      if ((*I)->DeLinkLimit != 0)
+	 Workers = 1;
+
+   vector<PackageMap *> Todo;
+   for (vector<PackageMap *>::const_iterator I = Maps.begin(); I != Maps.end(); ++I)
+      if ((Sources == true ? (*I)->SrcFile : (*I)->PkgFile).empty() == false)
+	 Todo.push_back(*I);
+
+   vector<vector<PackageMap *> > Jobs;
+   if (Workers > 1)
+      GroupJobs(Todo, Sources, Jobs);
+   if (Jobs.size() < 2)
+   {
+      for (vector<PackageMap *>::const_iterator I = Todo.begin(); I != Todo.end(); ++I)
+      {
+	 bool const Res = (Sources == true) ? (*I)->GenSources(Setup,Stats) :
+					      (*I)->GenPackages(Setup,Stats);
+	 if (Res == false)
+	    _error->DumpErrors();
+      }
+      return;
+   }
+
+   /* Every worker holds the write end of its own pipe, so the read end
+      hits EOF once it is done - or died. We can't use waitpid(-1) as the
+      Translation writers have compressor children of their own */
+   vector<pid_t> Pids(Jobs.size(), -1);
+   vector<int> Done(Jobs.size(), -1);
+   vector<FILE *> Results(Jobs.size(), (FILE *) NULL);
+   vector<bool> Finished(Jobs.size(), false);
+   unsigned int Next = 0;
+   unsigned int Printed = 0;
+   unsigned int Running = 0;
+   while (Printed != Jobs.size())
+   {
+      for (; Running < Workers && Next != Jobs.size(); ++Next)
+      {
+	 int Pipe[2];
+	 if (pipe(Pipe) != 0)
+	 {
+	    _error->Errno("pipe",_("Failed to create IPC pipe to subprocess"));
+	    Finished[Next] = true;
+	    continue;
+	 }
+	 SetCloseExec(Pipe[0], true);
+	 SetCloseExec(Pipe[1], true);
+	 Results[Next] = tmpfile();
+	 if (Results[Next] == NULL)
+	 {
+	    _error->Errno("tmpfile",_("Unable to create a temporary file"));
+	    close(Pipe[0]);
+	    close(Pipe[1]);
+	    Finished[Next] = true;
+	    continue;
+	 }
+	 // nothing buffered may be written twice by parent and child
+	 clog << flush;
+	 fflush(NULL);
+	 Pids[Next] = fork();
+	 if (Pids[Next] == 0)
+	 {
+	    close(Pipe[0]);
+	    // share the processors with the other jobs for scanning
+	    long const Processors = sysconf(_SC_NPROCESSORS_ONLN) / min<size_t>(Workers, Jobs.size());
+	    _config->CndSet("APT::FTPArchive::ScanWorkers", max(1L, Processors));
+	    RunJob(Setup, Jobs[Next], Sources, Results[Next]);
+	    fflush(NULL);
+	    _exit(0);
+	 }
+	 close(Pipe[1]);
+	 if (Pids[Next] < 0)
+	 {
+	    _error->Errno("fork",_("Failed to fork"));
+	    close(Pipe[0]);
+	    fclose(Results[Next]);
+	    Results[Next] = NULL;
+	    Finished[Next] = true;
+	    continue;
+	 }
+	 Done[Next] = Pipe[0];
+	 ++Running;
+      }
+
+      if (Running != 0)
+      {
+	 fd_set Fds;
+	 FD_ZERO(&Fds);
+	 int Max = -1;
+	 for (unsigned int J = Printed; J != Next; ++J)
+	    if (Done[J] != -1)
+	    {
+	       FD_SET(Done[J], &Fds);
+	       Max = max(Max, Done[J]);
+	    }
+	 if (select(Max + 1, &Fds, NULL, NULL, NULL) < 0)
+	 {
+	    if (errno == EINTR)
+	       continue;
+	    _error->Errno("select",_("Worker process failed"));
+	    FD_ZERO(&Fds);
+	    for (unsigned int J = Printed; J != Next; ++J)
+	       if (Done[J] != -1)
+		  FD_SET(Done[J], &Fds);
+	 }
+	 for (unsigned int J = Printed; J != Next; ++J)
+	 {
+	    if (Done[J] == -1 || FD_ISSET(Done[J], &Fds) == 0)
+	       continue;
+	    close(Done[J]);
+	    Done[J] = -1;
+	    // a worker which failed has only written part of its results
+	    if (ExecWait(Pids[J], "apt-ftparchive", false) == false)
+	    {
+	       fclose(Results[J]);
+	       Results[J] = NULL;
+	    }
+	    Finished[J] = true;
+	    --Running;
+	 }
+      }
+
+      // print the results in order
+      for (; Printed != Next && Finished[Printed] == true; ++Printed)
+      {
+	 if (Results[Printed] != NULL)
+	 {
+	    for (vector<PackageMap *>::const_iterator I = Jobs[Printed].begin(); I != Jobs[Printed].end(); ++I)
+	       if (Sources == true)
+		  (*I)->SrcDone = true;
+	       else
+		  (*I)->PkgDone = true;
+	    CollectJob(Results[Printed], Stats);
+	    fclose(Results[Printed]);
+	    Results[Printed] = NULL;
+	 }
+	 if (_error->PendingError() == true)
+	    _error->DumpErrors();
+      }
+   }
+}
 									/*}}}*/
 // Generate - Full generate, using a config file			/*{{{*/
 // ---------------------------------------------------------------------
@@ -769,14 +1051,11 @@ bool Generate(CommandLine &CmdL)
    stable_sort(PkgList.begin(),PkgList.end(),PackageMap::DBCompare());
 		
    // Generate packages
+   vector<PackageMap *> Selected;
    if (CmdL.FileSize() <= 2)
    {
       for (vector<PackageMap>::iterator I = PkgList.begin(); I != PkgList.end(); ++I)
-	 if (I->GenPackages(Setup,Stats) == false)
-	    _error->DumpErrors();
-      for (vector<PackageMap>::iterator I = PkgList.begin(); I != PkgList.end(); ++I)
-	 if (I->GenSources(Setup,SrcStats) == false)
-	    _error->DumpErrors();
+	 Selected.push_back(&(*I));
    }
    else
    {
@@ -803,35 +1082,23 @@ bool Generate(CommandLine &CmdL)
       }
       _error->DumpErrors();
       
-      // Do the generation for Packages
-      for (End = List; End->Str != 0; End++)
-      {
-	 if (End->Hit == false)
-	    continue;
-	 
-	 PackageMap *I = (PackageMap *)End->UserData;
-	 if (I->PkgDone == true)
-	    continue;
-	 if (I->GenPackages(Setup,Stats) == false)
-	    _error->DumpErrors();
-      }
-      
-      // Do the generation for Sources
       for (End = List; End->Str != 0; End++)
       {
 	 if (End->Hit == false)
 	    continue;
 	 
 	 PackageMap *I = (PackageMap *)End->UserData;
-	 if (I->SrcDone == true)
-	    continue;
-	 if (I->GenSources(Setup,SrcStats) == false)
-	    _error->DumpErrors();
+	 if (find(Selected.begin(), Selected.end(), I) == Selected.end())
+	    Selected.push_back(I);
       }
       
       delete [] List;
    }
 
+   // Do the generation for Packages and then for Sources
+   GenerateMaps(Setup, Selected, false, Stats);
+   GenerateMaps(Setup, Selected, true, SrcStats);
+
    // close the Translation master files
    for (vector<PackageMap>::reverse_iterator I = PkgList.rbegin(); I != PkgList.rend(); ++I)
       if (I->TransWriter != NULL && I->TransWriter->DecreaseRefCounter() == 0)
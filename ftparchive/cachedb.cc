@@ -16,6 +16,7 @@
 #include <apt-pkg/md5.h>
 #include <apt-pkg/sha1.h>
 #include <apt-pkg/sha2.h>
+#include <apt-pkg/hashes.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/configuration.h>
 #include <apt-pkg/fileutl.h>
@@ -190,12 +191,15 @@ bool CacheDB::GetFileInfo(std::string const &FileName, bool const &DoControl, bo
 	Stats.Bytes += CurStat.FileSize;
 	Stats.Packages++;
 
-	if ((DoControl && LoadControl() == false)
-		|| (DoContents && LoadContents(GenContentsOnly) == false)
-		|| (DoMD5 && GetMD5(false) == false)
-		|| (DoSHA1 && GetSHA1(false) == false)
-		|| (DoSHA256 && GetSHA256(false) == false)
-		|| (DoSHA512 && GetSHA512(false) == false)
+	unsigned int Merged = 0;
+	if (PrefetchFile == FileName)
+		Merged = MergePrefetched(DoControl, DoContents, GenContentsOnly);
+	PrefetchFile.clear();
+	Prefetched.clear();
+
+	if ((DoControl && (Merged & FlControl) == 0 && LoadControl() == false)
+		|| (DoContents && (Merged & FlContents) == 0 && LoadContents(GenContentsOnly) == false)
+		|| GetHashes(false, DoMD5, DoSHA1, DoSHA256, DoSHA512) == false
            )
 	{
 		delete Fd;
@@ -213,6 +217,175 @@ bool CacheDB::GetFileInfo(std::string const &FileName, bool const &DoControl, bo
    return true;
 }
 									/*}}}*/
+// CacheDB::GetMissing - Find out which infos are not in the DB	/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns the FlagList bits GetFileInfo would have to compute from the
+   file itself with the given options, 0 if all of it is cached or the
+   file can't be looked at (GetFileInfo will report that then). */
+unsigned int CacheDB::GetMissing(std::string const &FileName, bool const &DoControl, bool const &DoContents,
+				 bool const &DoMD5, bool const &DoSHA1, bool const &DoSHA256,
+				 bool const &DoSHA512, bool const &checkMtime)
+{
+   this->FileName = FileName;
+   unsigned int Missing = 0;
+   if (GetCurStat() == true)
+   {
+      OldStat = CurStat;
+      if (GetFileStat(checkMtime) == true)
+      {
+	 if (checkMtime == true && OldStat.mtime != CurStat.mtime)
+	    CurStat.Flags = FlSize;
+	 if (DoControl == true && (CurStat.Flags & FlControl) != FlControl)
+	    Missing |= FlControl;
+	 if (DoContents == true && (CurStat.Flags & FlContents) != FlContents)
+	    Missing |= FlContents;
+	 if (DoMD5 == true && (CurStat.Flags & FlMD5) != FlMD5)
+	    Missing |= FlMD5;
+	 if (DoSHA1 == true && (CurStat.Flags & FlSHA1) != FlSHA1)
+	    Missing |= FlSHA1;
+	 if (DoSHA256 == true && (CurStat.Flags & FlSHA256) != FlSHA256)
+	    Missing |= FlSHA256;
+	 if (DoSHA512 == true && (CurStat.Flags & FlSHA512) != FlSHA512)
+	    Missing |= FlSHA512;
+      }
+   }
+   delete Fd;
+   Fd = NULL;
+   return Missing;
+}
+									/*}}}*/
+// CacheDB::Prefetch - Compute the missing infos in a worker		/*{{{*/
+// ---------------------------------------------------------------------
+/* Used in a worker process on a CacheDB without a database: The parts
+   given in Missing are read from the file and stored together with the
+   statistics in Result for TakePrefetched in the parent. */
+bool CacheDB::Prefetch(std::string const &FileName, unsigned int const &Missing, std::string &Result)
+{
+   this->FileName = FileName;
+   memset(&CurStat,0,sizeof(CurStat));
+   struct Stats const Empty;
+   Stats = Empty;
+
+   bool Res = GetFileStat(true);
+   if (Res == true && (Missing & FlControl) == FlControl)
+      Res = LoadControl();
+   if (Res == true && (Missing & FlContents) == FlContents)
+      Res = LoadContents(false);
+   if (Res == true)
+      Res = GetHashes(true, (Missing & FlMD5) == FlMD5, (Missing & FlSHA1) == FlSHA1,
+		      (Missing & FlSHA256) == FlSHA256, (Missing & FlSHA512) == FlSHA512);
+
+   delete Fd;
+   Fd = NULL;
+   delete DebFile;
+   DebFile = NULL;
+   if (Res == false)
+      return false;
+
+   Result.assign((char const *)&CurStat, sizeof(CurStat));
+   Result.append((char const *)&Stats, sizeof(Stats));
+   uint64_t Length = ((CurStat.Flags & FlControl) == FlControl) ? Control.Length : 0;
+   Result.append((char const *)&Length, sizeof(Length));
+   Result.append(Control.Control, Length);
+   Length = ((CurStat.Flags & FlContents) == FlContents) ? Contents.CurSize : 0;
+   Result.append((char const *)&Length, sizeof(Length));
+   Result.append(Contents.Data, Length);
+   return true;
+}
+									/*}}}*/
+// CacheDB::TakePrefetched - Remember the result of a worker		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void CacheDB::TakePrefetched(std::string const &FileName, std::string const &Result)
+{
+   PrefetchFile = FileName;
+   Prefetched = Result;
+}
+									/*}}}*/
+// CacheDB::MergePrefetched - Use the infos computed by a worker	/*{{{*/
+// ---------------------------------------------------------------------
+/* Everything the worker computed which isn't in CurStat already is taken
+   over and written back to the DB as if it was computed here. Returns the
+   bits of the control and contents data which are loaded now. */
+unsigned int CacheDB::MergePrefetched(bool const &DoControl, bool const &DoContents,
+				      bool const &GenContentsOnly)
+{
+   struct StatStore Stat;
+   struct Stats WorkStats;
+   uint64_t ControlLength;
+   uint64_t ContentsLength;
+   char const *Data = Prefetched.data();
+   char const * const End = Data + Prefetched.size();
+   if (End - Data < (ssize_t)(sizeof(Stat) + sizeof(WorkStats) + sizeof(ControlLength)))
+      return 0;
+   memcpy(&Stat, Data, sizeof(Stat));
+   Data += sizeof(Stat);
+   memcpy(&WorkStats, Data, sizeof(WorkStats));
+   Data += sizeof(WorkStats);
+   memcpy(&ControlLength, Data, sizeof(ControlLength));
+   Data += sizeof(ControlLength);
+   char const * const ControlData = Data;
+   if ((uint64_t)(End - Data) < ControlLength + sizeof(ContentsLength))
+      return 0;
+   Data += ControlLength;
+   memcpy(&ContentsLength, Data, sizeof(ContentsLength));
+   Data += sizeof(ContentsLength);
+   char const * const ContentsData = Data;
+   if ((uint64_t)(End - Data) < ContentsLength)
+      return 0;
+
+   // the file was changed in between, better do it again
+   if (Stat.FileSize != CurStat.FileSize || Stat.mtime != CurStat.mtime)
+      return 0;
+
+   unsigned int Merged = 0;
+   if (DoControl == true && (Stat.Flags & FlControl) == FlControl &&
+       (CurStat.Flags & FlControl) != FlControl &&
+       Control.TakeControl(ControlData, ControlLength) == true)
+   {
+      Stats.Misses += WorkStats.Misses;
+      InitQuery("cl");
+      if (Put(Control.Control,Control.Length) == true)
+	 CurStat.Flags |= FlControl;
+      Merged |= FlControl;
+   }
+   if (DoContents == true && (Stat.Flags & FlContents) == FlContents &&
+       ((CurStat.Flags & FlContents) != FlContents || GenContentsOnly == false) &&
+       Contents.TakeContents(ContentsData, ContentsLength) == true)
+   {
+      InitQuery("cn");
+      if (Put(Contents.Data,Contents.CurSize) == true)
+	 CurStat.Flags |= FlContents;
+      Merged |= FlContents;
+   }
+
+   if ((Stat.Flags & FlMD5) == FlMD5 && (CurStat.Flags & FlMD5) != FlMD5)
+   {
+      memcpy(CurStat.MD5, Stat.MD5, sizeof(CurStat.MD5));
+      Stats.MD5Bytes += WorkStats.MD5Bytes;
+      CurStat.Flags |= FlMD5;
+   }
+   if ((Stat.Flags & FlSHA1) == FlSHA1 && (CurStat.Flags & FlSHA1) != FlSHA1)
+   {
+      memcpy(CurStat.SHA1, Stat.SHA1, sizeof(CurStat.SHA1));
+      Stats.SHA1Bytes += WorkStats.SHA1Bytes;
+      CurStat.Flags |= FlSHA1;
+   }
+   if ((Stat.Flags & FlSHA256) == FlSHA256 && (CurStat.Flags & FlSHA256) != FlSHA256)
+   {
+      memcpy(CurStat.SHA256, Stat.SHA256, sizeof(CurStat.SHA256));
+      Stats.SHA256Bytes += WorkStats.SHA256Bytes;
+      CurStat.Flags |= FlSHA256;
+   }
+   if ((Stat.Flags & FlSHA512) == FlSHA512 && (CurStat.Flags & FlSHA512) != FlSHA512)
+   {
+      memcpy(CurStat.SHA512, Stat.SHA512, sizeof(CurStat.SHA512));
+      Stats.SHA512Bytes += WorkStats.SHA512Bytes;
+      CurStat.Flags |= FlSHA512;
+   }
+   return Merged;
+}
+									/*}}}*/
 // CacheDB::LoadControl - Load Control information			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -329,127 +502,70 @@ static void hex2bytes(uint8_t *bytes, const char *hex, int length) {
    } 
 }
 
-// CacheDB::GetMD5 - Get the MD5 hash					/*{{{*/
+// CacheDB::GetHashes - Get the hashes					/*{{{*/
 // ---------------------------------------------------------------------
-/* */
-bool CacheDB::GetMD5(bool const &GenOnly)
+/* The hashes stored in the DB are used, all others are computed together
+   with a single read of the file */
+bool CacheDB::GetHashes(bool const GenOnly, bool const DoMD5, bool const DoSHA1,
+			bool const DoSHA256, bool const DoSHA512)
 {
-   // Try to read the control information out of the DB.
-   if ((CurStat.Flags & FlMD5) == FlMD5)
-   {
-      if (GenOnly == true)
-	 return true;
-      
-      MD5Res = bytes2hex(CurStat.MD5, sizeof(CurStat.MD5));
-	 return true;
-      }
-   
-   Stats.MD5Bytes += CurStat.FileSize;
-	 
-   if (Fd == NULL && OpenFile() == false)
+   bool const NeedMD5 = DoMD5 && (CurStat.Flags & FlMD5) != FlMD5;
+   bool const NeedSHA1 = DoSHA1 && (CurStat.Flags & FlSHA1) != FlSHA1;
+   bool const NeedSHA256 = DoSHA256 && (CurStat.Flags & FlSHA256) != FlSHA256;
+   bool const NeedSHA512 = DoSHA512 && (CurStat.Flags & FlSHA512) != FlSHA512;
+
+   if (GenOnly == false)
    {
-      return false;
+      if (DoMD5 == true && NeedMD5 == false)
+	 MD5Res = bytes2hex(CurStat.MD5, sizeof(CurStat.MD5));
+      if (DoSHA1 == true && NeedSHA1 == false)
+	 SHA1Res = bytes2hex(CurStat.SHA1, sizeof(CurStat.SHA1));
+      if (DoSHA256 == true && NeedSHA256 == false)
+	 SHA256Res = bytes2hex(CurStat.SHA256, sizeof(CurStat.SHA256));
+      if (DoSHA512 == true && NeedSHA512 == false)
+	 SHA512Res = bytes2hex(CurStat.SHA512, sizeof(CurStat.SHA512));
    }
-   MD5Summation MD5;
-   if (Fd->Seek(0) == false || MD5.AddFD(*Fd, CurStat.FileSize) == false)
-      return false;
-   
-   MD5Res = MD5.Result();
-   hex2bytes(CurStat.MD5, MD5Res.data(), sizeof(CurStat.MD5));
-      CurStat.Flags |= FlMD5;
-   return true;
-}
-									/*}}}*/
-// CacheDB::GetSHA1 - Get the SHA1 hash					/*{{{*/
-// ---------------------------------------------------------------------
-/* */
-bool CacheDB::GetSHA1(bool const &GenOnly)
-{
-   // Try to read the control information out of the DB.
-   if ((CurStat.Flags & FlSHA1) == FlSHA1)
-   {
-      if (GenOnly == true)
-	 return true;
 
-      SHA1Res = bytes2hex(CurStat.SHA1, sizeof(CurStat.SHA1));
+   if (NeedMD5 == false && NeedSHA1 == false && NeedSHA256 == false && NeedSHA512 == false)
       return true;
-   }
-   
-   Stats.SHA1Bytes += CurStat.FileSize;
-	 
+
    if (Fd == NULL && OpenFile() == false)
    {
       return false;
    }
-   SHA1Summation SHA1;
-   if (Fd->Seek(0) == false || SHA1.AddFD(*Fd, CurStat.FileSize) == false)
+   Hashes Hash;
+   if (Fd->Seek(0) == false ||
+       Hash.AddFD(*Fd, CurStat.FileSize, NeedMD5, NeedSHA1, NeedSHA256, NeedSHA512) == false)
       return false;
-   
-   SHA1Res = SHA1.Result();
-   hex2bytes(CurStat.SHA1, SHA1Res.data(), sizeof(CurStat.SHA1));
-   CurStat.Flags |= FlSHA1;
-   return true;
-}
-									/*}}}*/
-// CacheDB::GetSHA256 - Get the SHA256 hash				/*{{{*/
-// ---------------------------------------------------------------------
-/* */
-bool CacheDB::GetSHA256(bool const &GenOnly)
-{
-   // Try to read the control information out of the DB.
-   if ((CurStat.Flags & FlSHA256) == FlSHA256)
-   {
-      if (GenOnly == true)
-	 return true;
 
-      SHA256Res = bytes2hex(CurStat.SHA256, sizeof(CurStat.SHA256));
-      return true;
+   if (NeedMD5 == true)
+   {
+      Stats.MD5Bytes += CurStat.FileSize;
+      MD5Res = Hash.MD5.Result();
+      hex2bytes(CurStat.MD5, MD5Res.data(), sizeof(CurStat.MD5));
+      CurStat.Flags |= FlMD5;
    }
-   
-   Stats.SHA256Bytes += CurStat.FileSize;
-	 
-   if (Fd == NULL && OpenFile() == false)
+   if (NeedSHA1 == true)
    {
-      return false;
+      Stats.SHA1Bytes += CurStat.FileSize;
+      SHA1Res = Hash.SHA1.Result();
+      hex2bytes(CurStat.SHA1, SHA1Res.data(), sizeof(CurStat.SHA1));
+      CurStat.Flags |= FlSHA1;
    }
-   SHA256Summation SHA256;
-   if (Fd->Seek(0) == false || SHA256.AddFD(*Fd, CurStat.FileSize) == false)
-      return false;
-   
-   SHA256Res = SHA256.Result();
-   hex2bytes(CurStat.SHA256, SHA256Res.data(), sizeof(CurStat.SHA256));
-   CurStat.Flags |= FlSHA256;
-   return true;
-}
-									/*}}}*/
-// CacheDB::GetSHA256 - Get the SHA256 hash				/*{{{*/
-// ---------------------------------------------------------------------
-/* */
-bool CacheDB::GetSHA512(bool const &GenOnly)
-{
-   // Try to read the control information out of the DB.
-   if ((CurStat.Flags & FlSHA512) == FlSHA512)
+   if (NeedSHA256 == true)
    {
-      if (GenOnly == true)
-	 return true;
-
-      SHA512Res = bytes2hex(CurStat.SHA512, sizeof(CurStat.SHA512));
-      return true;
+      Stats.SHA256Bytes += CurStat.FileSize;
+      SHA256Res = Hash.SHA256.Result();
+      hex2bytes(CurStat.SHA256, SHA256Res.data(), sizeof(CurStat.SHA256));
+      CurStat.Flags |= FlSHA256;
    }
-   
-   Stats.SHA512Bytes += CurStat.FileSize;
-	 
-   if (Fd == NULL && OpenFile() == false)
+   if (NeedSHA512 == true)
    {
-      return false;
+      Stats.SHA512Bytes += CurStat.FileSize;
+      SHA512Res = Hash.SHA512.Result();
+      hex2bytes(CurStat.SHA512, SHA512Res.data(), sizeof(CurStat.SHA512));
+      CurStat.Flags |= FlSHA512;
    }
-   SHA512Summation SHA512;
-   if (Fd->Seek(0) == false || SHA512.AddFD(*Fd, CurStat.FileSize) == false)
-      return false;
-   
-   SHA512Res = SHA512.Result();
-   hex2bytes(CurStat.SHA512, SHA512Res.data(), sizeof(CurStat.SHA512));
-   CurStat.Flags |= FlSHA512;
    return true;
 }
 									/*}}}*/
@@ -67,10 +67,8 @@ class CacheDB
    bool GetCurStat();
    bool LoadControl();
    bool LoadContents(bool const &GenOnly);
-   bool GetMD5(bool const &GenOnly);
-   bool GetSHA1(bool const &GenOnly);
-   bool GetSHA256(bool const &GenOnly);
-   bool GetSHA512(bool const &GenOnly);
+   bool GetHashes(bool const GenOnly, bool const DoMD5, bool const DoSHA1,
+		  bool const DoSHA256, bool const DoSHA512);
    
    // Stat info stored in the DB, Fixed types since it is written to disk.
    enum FlagList {FlControl = (1<<0),FlMD5=(1<<1),FlContents=(1<<2),
@@ -93,6 +91,12 @@ class CacheDB
    std::string FileName;
    FileFd *Fd;
    debDebFile *DebFile;
+
+   // Result of a worker, used by the next GetFileInfo for this file
+   std::string PrefetchFile;
+   std::string Prefetched;
+   unsigned int MergePrefetched(bool const &DoControl, bool const &DoContents,
+				bool const &GenContentsOnly);
    
    public:
 
@@ -140,6 +144,13 @@ class CacheDB
    bool GetFileInfo(std::string const &FileName, bool const &DoControl, bool const &DoContents, bool const &GenContentsOnly,
 		    bool const &DoMD5, bool const &DoSHA1, bool const &DoSHA256, bool const &DoSHA512, bool const &checkMtime = false);
    bool Finish();   
+
+   // Parallel scanning, see FTWScanner::ProcessQueue
+   unsigned int GetMissing(std::string const &FileName, bool const &DoControl, bool const &DoContents,
+			   bool const &DoMD5, bool const &DoSHA1, bool const &DoSHA256, bool const &DoSHA512,
+			   bool const &checkMtime = false);
+   bool Prefetch(std::string const &FileName, unsigned int const &Missing, std::string &Result);
+   void TakePrefetched(std::string const &FileName, std::string const &Result);
    
    bool Clean();
    
@@ -10,6 +10,12 @@
    different from the old set. It spawns off compressors in parallel
    to maximize compression throughput and has a separate task managing
    the data going into the compressors.
+
+   With more than one worker the formats which allow concatenated
+   streams (gzip, bzip2 and xz) are compressed in blocks: Each block of
+   the input is handed to a child per output and the compressed streams
+   are appended in order, so big files use all processors. Inputs smaller
+   than a block are still compressed as a single stream.
    
    ##################################################################### */
 									/*}}}*/
@@ -20,11 +26,14 @@
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/md5.h>
+#include <apt-pkg/configuration.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <utime.h>
 #include <unistd.h>
+#include <errno.h>
 #include <iostream>
 
 #include "multicompress.h"
@@ -45,6 +54,11 @@ MultiCompress::MultiCompress(string const &Output,string const &Compress,
    Outputter = -1;
    Input = 0;
    UpdateMTime = 0;
+   Running = 0;
+   Workers = _config->FindI("APT::FTPArchive::CompressWorkers", 1);
+   BlockSize = _config->FindI("APT::FTPArchive::CompressBlockSize", 8*1024*1024);
+   if (BlockSize == 0)
+      Workers = 1;
 
    /* Parse the compression string, a space separated lists of compresison
       types */
@@ -77,6 +91,8 @@ MultiCompress::MultiCompress(string const &Output,string const &Compress,
       Outputs = NewOut;
       NewOut->CompressProg = *Comp;
       NewOut->Output = Output+Comp->Extension;
+      NewOut->Blocks = Workers > 1 && (Comp->Name == "gzip" ||
+		       Comp->Name == "bzip2" || Comp->Name == "xz");
       
       struct stat St;
       if (stat(NewOut->Output.c_str(),&St) == 0)
@@ -91,7 +107,8 @@ MultiCompress::MultiCompress(string const &Output,string const &Compress,
    /* Open all the temp files now so we can report any errors. File is 
       made unreable to prevent people from touching it during creating. */
    for (Files *I = Outputs; I != 0; I = I->Next)
-      I->TmpFile.Open(I->Output + ".new", FileFd::WriteOnly | FileFd::Create | FileFd::Empty, FileFd::Extension, 0600);
+      I->TmpFile.Open(I->Output + ".new", FileFd::WriteOnly | FileFd::Create | FileFd::Empty,
+		      I->Blocks == true ? FileFd::None : FileFd::Extension, 0600);
    if (_error->PendingError() == true)
       return;
 
@@ -271,6 +288,130 @@ bool MultiCompress::OpenOld(FileFd &Fd)
    return Fd.Open(Best->Output, FileFd::ReadOnly, FileFd::Extension);
 }
 									/*}}}*/
+// MultiCompress::CompressBlock - Start compressing a block		/*{{{*/
+// ---------------------------------------------------------------------
+/* A child is forked for each output compressed in blocks which writes
+   the compressed block into a temporary file. At most Workers children
+   are running at the same time. */
+bool MultiCompress::CompressBlock(std::string const &Block)
+{
+   for (Files *I = Outputs; I != 0; I = I->Next)
+   {
+      if (I->Blocks == false)
+	 continue;
+
+      while (Running >= Workers)
+	 if (WaitBlock() == false)
+	    return false;
+
+      BlockJob Job;
+      Job.Done = false;
+      Job.Result = tmpfile();
+      if (Job.Result == NULL)
+	 return _error->Errno("tmpfile",_("Unable to create a temporary file"));
+
+      Job.Pid = fork();
+      if (Job.Pid == 0)
+      {
+	 FileFd Comp;
+	 if (Comp.OpenDescriptor(dup(fileno(Job.Result)), FileFd::WriteOnly, I->CompressProg, true) == true &&
+	     Comp.Write(Block.c_str(), Block.length()) == true)
+	    Comp.Close();
+	 if (_error->PendingError() == true)
+	 {
+	    _error->DumpErrors();
+	    _exit(100);
+	 }
+	 _exit(0);
+      }
+      if (Job.Pid < 0)
+      {
+	 fclose(Job.Result);
+	 return _error->Errno("fork",_("Failed to fork"));
+      }
+      I->Pending.push_back(Job);
+      ++Running;
+   }
+   return true;
+}
+									/*}}}*/
+// MultiCompress::WaitBlock - Wait for a block and write out the done ones/*{{{*/
+// ---------------------------------------------------------------------
+/* The first of our children to finish is taken, but as the outputs not
+   compressed in blocks can have a compressor child as well we only peek
+   and wait for the oldest block if it isn't one of ours. The compressed
+   blocks are then appended to the outputs in the order of the input. */
+bool MultiCompress::WaitBlock()
+{
+   pid_t Pid = -1;
+   siginfo_t Info;
+   Info.si_pid = 0;
+   if (waitid(P_ALL, 0, &Info, WEXITED | WNOWAIT) == 0)
+      for (Files *I = Outputs; I != 0 && Pid == -1; I = I->Next)
+	 for (std::list<BlockJob>::const_iterator J = I->Pending.begin(); J != I->Pending.end(); ++J)
+	    if (J->Done == false && J->Pid == Info.si_pid)
+	    {
+	       Pid = J->Pid;
+	       break;
+	    }
+   if (Pid == -1)
+   {
+      for (Files *I = Outputs; I != 0 && Pid == -1; I = I->Next)
+	 for (std::list<BlockJob>::const_iterator J = I->Pending.begin(); J != I->Pending.end(); ++J)
+	    if (J->Done == false)
+	    {
+	       Pid = J->Pid;
+	       break;
+	    }
+      if (Pid == -1)
+      {
+	 Running = 0;
+	 return true;
+      }
+   }
+
+   int Status;
+   while (waitpid(Pid, &Status, 0) != Pid)
+   {
+      if (errno == EINTR)
+	 continue;
+      Running = 0;
+      return _error->Errno("waitpid",_("Waited for %s but it wasn't there"),"Compress child");
+   }
+
+   bool Res = true;
+   for (Files *I = Outputs; I != 0; I = I->Next)
+   {
+      for (std::list<BlockJob>::iterator J = I->Pending.begin(); J != I->Pending.end(); ++J)
+      {
+	 if (J->Done == true || J->Pid != Pid)
+	    continue;
+	 J->Done = true;
+	 --Running;
+	 if (WIFEXITED(Status) == false || WEXITSTATUS(Status) != 0)
+	    Res = _error->Error(_("Sub-process %s returned an error code (%u)"),
+				I->CompressProg.Binary.c_str(), WEXITSTATUS(Status));
+      }
+
+      while (I->Pending.empty() == false && I->Pending.front().Done == true)
+      {
+	 FILE * const Result = I->Pending.front().Result;
+	 I->Pending.pop_front();
+	 rewind(Result);
+	 char Buffer[32*1024];
+	 size_t Len;
+	 while ((Len = fread(Buffer, 1, sizeof(Buffer), Result)) != 0)
+	    if (I->TmpFile.Write(Buffer, Len) == false)
+	    {
+	       Res = _error->Errno("write",_("IO to subprocess/file failed"));
+	       break;
+	    }
+	 fclose(Result);
+      }
+   }
+   return Res;
+}
+									/*}}}*/
 // MultiCompress::Child - The writer child				/*{{{*/
 // ---------------------------------------------------------------------
 /* The child process forks a bunch of compression children and takes 
@@ -286,6 +427,11 @@ bool MultiCompress::Child(int const &FD)
    unsigned char Buffer[32*1024];
    unsigned long long FileSize = 0;
    MD5Summation MD5;
+   bool Blocks = false;
+   for (Files *I = Outputs; I != 0; I = I->Next)
+      if (I->Blocks == true)
+	 Blocks = true;
+   std::string Block;
    while (1)
    {
       WaitFd(FD,false);
@@ -299,14 +445,34 @@ bool MultiCompress::Child(int const &FD)
       FileSize += Res;
       for (Files *I = Outputs; I != 0; I = I->Next)
       {
+	 if (I->Blocks == true)
+	    continue;
 	 if (I->TmpFile.Write(Buffer, Res) == false)
 	 {
 	    _error->Errno("write",_("IO to subprocess/file failed"));
 	    break;
 	 }
       }      
+
+      if (Blocks == true)
+      {
+	 Block.append((char const *)Buffer, Res);
+	 if (Block.length() >= BlockSize)
+	 {
+	    if (CompressBlock(Block) == false)
+	       break;
+	    Block.clear();
+	 }
+      }
    }   
 
+   // the last block, an empty input still needs a (empty) stream
+   if (Blocks == true && (Block.empty() == false || FileSize == 0))
+      CompressBlock(Block);
+   while (Running != 0)
+      if (WaitBlock() == false)
+	 break;
+
    if (_error->PendingError() == true)
       return false;
    
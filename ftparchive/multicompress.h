@@ -20,11 +20,20 @@
 #include <apt-pkg/aptconfiguration.h>
 
 #include <string>
+#include <list>
 #include <stdio.h>
 #include <sys/types.h>
     
 class MultiCompress
 {
+   // A block of the input compressed by a child into the Result file
+   struct BlockJob
+   {
+      pid_t Pid;
+      FILE *Result;
+      bool Done;
+   };
+
    // An output file
    struct Files
    {
@@ -34,15 +43,23 @@ class MultiCompress
       FileFd TmpFile;
       pid_t CompressProc;
       time_t OldMTime;
+      // compressed in independent blocks, TmpFile gets the compressed data
+      bool Blocks;
+      std::list<BlockJob> Pending;
    };
    
    Files *Outputs;
    pid_t Outputter;
    mode_t Permissions;
+   unsigned long Workers;
+   unsigned long long BlockSize;
+   unsigned long Running;
 
    bool Child(int const &Fd);
    bool Start();
    bool Die();
+   bool CompressBlock(std::string const &Block);
+   bool WaitBlock();
    
    public:
    
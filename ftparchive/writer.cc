@@ -20,9 +20,12 @@
 #include <apt-pkg/md5.h>
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/deblistparser.h>
+#include <apt-pkg/fileutl.h>
 
 #include <sys/types.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include <ctime>
 #include <ftw.h>
 #include <fnmatch.h>
@@ -61,6 +64,8 @@ FTWScanner::FTWScanner(string const &Arch): Arch(Arch)
 {
    ErrorPrinted = false;
    NoLinkAct = !_config->FindB("APT::FTPArchive::DeLinkAct",true);
+   Queueing = false;
+   ScanWorkers = 1;
 
    DoMD5 = _config->FindB("APT::FTPArchive::MD5",true);
    DoSHA1 = _config->FindB("APT::FTPArchive::SHA1",true);
@@ -116,16 +121,32 @@ int FTWScanner::ScannerFile(const char *File, bool const &ReadLink)
       name.. This works best if the directory components the scanner are
       given are not links themselves. */
    char Jnk[2];
-   Owner->OriginalPath = File;
+   string FileName = File;
    if (ReadLink &&
        readlink(File,Jnk,sizeof(Jnk)) != -1 &&
        (RealPath = realpath(File,NULL)) != 0)
    {
-      Owner->DoPackage(RealPath);
+      FileName = RealPath;
       free(RealPath);
    }
+
+   if (Owner->Queueing == true)
+   {
+      QueuedFile const Queued = {File, FileName};
+      Owner->Queue.push_back(Queued);
+   }
    else
-      Owner->DoPackage(File);
+      Owner->ProcessFile(File, FileName);
+   return 0;
+}
+									/*}}}*/
+// FTWScanner::ProcessFile - Process a single file			/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+void FTWScanner::ProcessFile(const char *File, string const &FileName)
+{
+   OriginalPath = File;
+   DoPackage(FileName);
    
    if (_error->empty() == false)
    {
@@ -134,7 +155,7 @@ int FTWScanner::ScannerFile(const char *File, bool const &ReadLink)
       bool SeenPath = false;
       while (_error->empty() == false)
       {
-	 Owner->NewLine(1);
+	 NewLine(1);
 	 
 	 bool const Type = _error->PopMessage(Err);
 	 if (Type == true)
@@ -148,10 +169,185 @@ int FTWScanner::ScannerFile(const char *File, bool const &ReadLink)
       
       if (SeenPath == false)
 	 cerr << _("E: Errors apply to file ") << "'" << File << "'" << endl;
-      return 0;
    }
-   
-   return 0;
+}
+									/*}}}*/
+// PrefetchWorker - Compute the file infos requested by the parent	/*{{{*/
+// ---------------------------------------------------------------------
+/* Runs in the forked workers of ProcessQueue: Each request is the set of
+   missing infos and the name of the file, the answer is the result of
+   CacheDB::Prefetch or an empty one if that failed. A request without a
+   name stops the worker. */
+static void PrefetchWorker(int const In, int const Out)
+{
+   FileFd Request(In, true);
+   FileFd Answer(Out, true);
+   CacheDB Work((string()));
+   while (true)
+   {
+      uint32_t Header[2];
+      unsigned long long Actual;
+      if (Request.Read(Header, sizeof(Header), &Actual) == false ||
+	  Actual != sizeof(Header) || Header[1] == 0)
+	 break;
+      string FileName(Header[1], '\0');
+      if (Request.Read(&FileName[0], Header[1], &Actual) == false || Actual != Header[1])
+	 break;
+
+      _error->Discard();
+      string Result;
+      if (Work.Prefetch(FileName, Header[0], Result) == false ||
+	  _error->PendingError() == true)
+	 Result.clear();
+      uint64_t const Length = Result.length();
+      if (Answer.Write(&Length, sizeof(Length)) == false ||
+	  Answer.Write(Result.c_str(), Length) == false)
+	 break;
+   }
+}
+									/*}}}*/
+// a forked worker of ProcessQueue and the pipes to talk to it
+struct PrefetchProcess
+{
+   pid_t Pid;
+   int Request;
+   FileFd *Answer;
+};
+// SendRequest - Write to a worker which might be gone already		/*{{{*/
+// ---------------------------------------------------------------------
+/* The requests go over a socket, so a dead worker gives us EPIPE instead
+   of killing us with a SIGPIPE and the signal handling isn't touched. */
+static bool SendRequest(int const Fd, void const *From, size_t Size)
+{
+   while (Size != 0)
+   {
+      ssize_t const Res = send(Fd, From, Size, MSG_NOSIGNAL);
+      if (Res < 0 && errno == EINTR)
+	 continue;
+      if (Res <= 0)
+	 return false;
+      From = (char const *)From + Res;
+      Size -= Res;
+   }
+   return true;
+}
+									/*}}}*/
+// FTWScanner::ProcessQueue - Process the files found by the walker	/*{{{*/
+// ---------------------------------------------------------------------
+/* The files are handed to DoPackage one after the other in the order the
+   walker found them, so the output is the same as without a queue. The
+   expensive part for files not in the cache - reading the control record,
+   the file list and the hashes - is done ahead of time by up to
+   ScanWorkers - 1 forked processes which don't touch the database. The
+   results are merged in by the CacheDB of the scanner. */
+bool FTWScanner::ProcessQueue()
+{
+   vector<QueuedFile> Files;
+   Files.swap(Queue);
+   if (Files.empty() == true)
+      return true;
+
+   vector<PrefetchProcess> Workers;
+   vector<unsigned int> Idle;
+
+   // nothing buffered may be written by the workers again
+   fflush(NULL);
+   for (unsigned int I = 1; I < ScanWorkers && I < Files.size(); ++I)
+   {
+      int Request[2];
+      int Answer[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, Request) != 0)
+	 break;
+      if (pipe(Answer) != 0)
+      {
+	 close(Request[0]);
+	 close(Request[1]);
+	 break;
+      }
+      pid_t const Pid = fork();
+      if (Pid == 0)
+      {
+	 for (vector<PrefetchProcess>::const_iterator W = Workers.begin(); W != Workers.end(); ++W)
+	 {
+	    close(W->Request);
+	    close(W->Answer->Fd());
+	 }
+	 close(Request[1]);
+	 close(Answer[0]);
+	 PrefetchWorker(Request[0], Answer[1]);
+	 _exit(0);
+      }
+      close(Request[0]);
+      close(Answer[1]);
+      if (Pid < 0)
+      {
+	 close(Request[1]);
+	 close(Answer[0]);
+	 break;
+      }
+      PrefetchProcess const W = {Pid, Request[1], new FileFd(Answer[0], true)};
+      Idle.push_back(Workers.size());
+      Workers.push_back(W);
+   }
+
+   vector<int> Assigned(Files.size(), -1);
+   size_t const Window = 4 * (Workers.size() + 1);
+   size_t Ahead = 0;
+   for (size_t I = 0; I != Files.size(); ++I)
+   {
+      // keep the workers busy with the files ahead of the current one
+      if (Ahead <= I)
+	 Ahead = I + 1;
+      _error->PushToStack();
+      for (; Idle.empty() == false && Ahead != Files.size() && Ahead < I + Window; ++Ahead)
+      {
+	 string const &FileName = Files[Ahead].FileName;
+	 uint32_t const Header[2] = {PrefetchNeeded(FileName), (uint32_t) FileName.length()};
+	 if (Header[0] == 0)
+	    continue;
+	 PrefetchProcess const &W = Workers[Idle.back()];
+	 if (SendRequest(W.Request, Header, sizeof(Header)) == true &&
+	     SendRequest(W.Request, FileName.c_str(), FileName.length()) == true)
+	    Assigned[Ahead] = Idle.back();
+	 Idle.pop_back();
+      }
+      _error->RevertToStack();
+
+      if (Assigned[I] != -1)
+      {
+	 PrefetchProcess const &W = Workers[Assigned[I]];
+	 uint64_t Length;
+	 unsigned long long Actual;
+	 _error->PushToStack();
+	 if (W.Answer->Read(&Length, sizeof(Length), &Actual) == true && Actual == sizeof(Length))
+	 {
+	    string Result(Length, '\0');
+	    if (Length == 0 ||
+		(W.Answer->Read(&Result[0], Length, &Actual) == true && Actual == Length))
+	    {
+	       Idle.push_back(Assigned[I]);
+	       if (Length != 0)
+		  PrefetchTake(Files[I].FileName, Result);
+	    }
+	 }
+	 _error->RevertToStack();
+      }
+
+      ProcessFile(Files[I].OriginalPath.c_str(), Files[I].FileName);
+   }
+
+   // stop the workers
+   _error->PushToStack();
+   for (vector<PrefetchProcess>::iterator W = Workers.begin(); W != Workers.end(); ++W)
+   {
+      uint32_t const Header[2] = {0, 0};
+      SendRequest(W->Request, Header, sizeof(Header));
+      close(W->Request);
+      delete W->Answer;
+      ExecWait(W->Pid, "apt-ftparchive", true);
+   }
+   _error->RevertToStack();
+   return true;
 }
 									/*}}}*/
 // FTWScanner::RecursiveScan - Just scan a directory tree		/*{{{*/
@@ -172,17 +368,20 @@ bool FTWScanner::RecursiveScan(string const &Dir)
    
    // Do recursive directory searching
    Owner = this;
+   Queueing = ScanWorkers > 1;
    int const Res = ftw(Dir.c_str(),ScannerFTW,30);
+   Queueing = false;
    
    // Error treewalking?
    if (Res != 0)
    {
+      Queue.clear();
       if (_error->PendingError() == false)
 	 _error->Errno("ftw",_("Tree walking failed"));
       return false;
    }
    
-   return true;
+   return ProcessQueue();
 }
 									/*}}}*/
 // FTWScanner::LoadFileList - Load the file list from a file		/*{{{*/
@@ -206,6 +405,7 @@ bool FTWScanner::LoadFileList(string const &Dir, string const &File)
    FILE *List = fopen(File.c_str(),"r");
    if (List == 0)
       return _error->Errno("fopen",_("Failed to open %s"),File.c_str());
+   Queueing = ScanWorkers > 1;
    
    /* We are a tad tricky here.. We prefix the buffer with the directory
       name, that way if we need a full path with just use line.. Sneaky and
@@ -239,9 +439,10 @@ bool FTWScanner::LoadFileList(string const &Dir, string const &File)
       if (ScannerFile(FileName, false) != 0)
 	 break;
    }
+   Queueing = false;
   
    fclose(List);
-   return true;
+   return ProcessQueue();
 }
 									/*}}}*/
 // FTWScanner::Delink - Delink symlinks					/*{{{*/
@@ -323,6 +524,7 @@ PackagesWriter::PackagesWriter(string const &DB,string const &Overrides,string c
    DoContents = _config->FindB("APT::FTPArchive::Contents",true);
    NoOverride = _config->FindB("APT::FTPArchive::NoOverrideMsg",false);
    LongDescription = _config->FindB("APT::FTPArchive::LongDescription",true);
+   ScanWorkers = _config->FindI("APT::FTPArchive::ScanWorkers",1);
 
    if (Db.Loaded() == false)
       DoContents = false;
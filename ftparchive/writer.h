@@ -41,10 +41,25 @@ class FTWScanner
    
    // Stuff for the delinker
    bool NoLinkAct;
+
+   // Files found by the walker, handled in this order by ProcessQueue
+   struct QueuedFile
+   {
+      string OriginalPath;
+      string FileName;
+   };
+   vector<QueuedFile> Queue;
+   bool Queueing;
    
    static FTWScanner *Owner;
    static int ScannerFTW(const char *File,const struct stat *sb,int Flag);
    static int ScannerFile(const char *File, bool const &ReadLink);
+   void ProcessFile(const char *File, string const &FileName);
+   bool ProcessQueue();
+
+   // Hooks for the workers of ProcessQueue
+   virtual unsigned int PrefetchNeeded(string const &/*FileName*/) {return 0;};
+   virtual void PrefetchTake(string const &/*FileName*/, string const &/*Result*/) {};
 
    bool Delink(string &FileName,const char *OriginalPath,
 	       unsigned long long &Bytes,unsigned long long const &FileSize);
@@ -65,6 +80,7 @@ class FTWScanner
    bool DoSHA512;
 
    unsigned long DeLinkLimit;
+   unsigned int ScanWorkers;
    string InternalPrefix;
 
    virtual bool DoPackage(string FileName) = 0;
@@ -104,6 +120,13 @@ class PackagesWriter : public FTWScanner
 {
    Override Over;
    CacheDB Db;
+
+   protected:
+
+   virtual unsigned int PrefetchNeeded(string const &FileName)
+      {return Db.GetMissing(FileName, true, DoContents, DoMD5, DoSHA1, DoSHA256, DoSHA512, DoAlwaysStat);};
+   virtual void PrefetchTake(string const &FileName, string const &Result)
+      {Db.TakePrefetched(FileName, Result);};
       
    public:
 
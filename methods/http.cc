@@ -34,6 +34,7 @@
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/netrc.h>
 
+#include <zlib.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <utime.h>
@@ -44,6 +45,7 @@
 #include <string.h>
 #include <iostream>
 #include <map>
+#include <vector>
 
 // Internet stuff
 #include <netdb.h>
@@ -63,6 +65,8 @@ time_t HttpMethod::FailTime = 0;
 unsigned long PipelineDepth = 10;
 unsigned long TimeOut = 120;
 bool AllowRedirect = false;
+unsigned long Segments = 1;
+unsigned long long MinSegmentSize = 4*1024*1024;
 bool Debug = false;
 URI Proxy;
 
@@ -70,11 +74,142 @@ unsigned long long CircleBuf::BwReadLimit=0;
 unsigned long long CircleBuf::BwTickReadData=0;
 struct timeval CircleBuf::BwReadTick={0,0};
 const unsigned int CircleBuf::BW_HZ=10;
+
+/* Decompresses a gzip compressed index while it is received, so that the
+   gzip method doesn't need to read it again afterwards. Errors aren't
+   reported, the item is decompressed by the gzip method as usual then. */
+class StreamInflater
+{
+   z_stream Stream;
+   FileFd Out;
+   bool Started;
+   bool Ended;
+   bool Failed;
+
+   public:
+   std::string Filename;
+   Hashes Hash;
+   unsigned long long Size;
+
+   bool Open(std::string const &File);
+   void Add(unsigned char const *Data,unsigned long long Length);
+   bool Finish(time_t const Date);
+
+   StreamInflater() : Started(false), Ended(false), Failed(false), Size(0) {};
+   ~StreamInflater();
+};
+
+// StreamInflater::Open - Start the decompression into File		/*{{{*/
+// ---------------------------------------------------------------------
+/* */
+bool StreamInflater::Open(std::string const &File)
+{
+   memset(&Stream,0,sizeof(Stream));
+   // 16 + MAX_WBITS: the data has a gzip header
+   if (inflateInit2(&Stream,16 + MAX_WBITS) != Z_OK)
+      return false;
+   Started = true;
+
+   _error->PushToStack();
+   bool const Okay = Out.Open(File,FileFd::WriteAtomic);
+   _error->RevertToStack();
+   if (Okay == false)
+      return false;
+   Out.EraseOnFailure();
+   Filename = File;
+   return true;
+}
+									/*}}}*/
+// StreamInflater::Add - Decompress the next block of data		/*{{{*/
+// ---------------------------------------------------------------------
+/* Concatenated gzip members are decompressed into one file, like the
+   gzip method (via zlib's gzread) would do it */
+void StreamInflater::Add(unsigned char const *Data,unsigned long long Length)
+{
+   if (Failed == true || Started == false)
+      return;
+   Stream.next_in = (Bytef *) Data;
+   Stream.avail_in = Length;
+   while (Stream.avail_in != 0)
+   {
+      if (Ended == true)
+      {
+	 if (inflateReset(&Stream) != Z_OK)
+	 {
+	    Failed = true;
+	    return;
+	 }
+	 Ended = false;
+      }
+
+      unsigned char Buffer[64*1024];
+      Stream.next_out = Buffer;
+      Stream.avail_out = sizeof(Buffer);
+      int const Res = inflate(&Stream,Z_NO_FLUSH);
+      if (Res != Z_OK && Res != Z_STREAM_END)
+      {
+	 Failed = true;
+	 return;
+      }
+      if (Res == Z_STREAM_END)
+	 Ended = true;
+
+      unsigned long long const Got = sizeof(Buffer) - Stream.avail_out;
+      if (Got == 0)
+	 continue;
+      Hash.Add(Buffer,Got);
+      Size += Got;
+      _error->PushToStack();
+      if (Out.Write(Buffer,Got) == false)
+	 Failed = true;
+      _error->RevertToStack();
+      if (Failed == true)
+	 return;
+   }
+}
+									/*}}}*/
+// StreamInflater::Finish - Close the decompressed file			/*{{{*/
+// ---------------------------------------------------------------------
+/* Returns true if the complete stream was decompressed */
+bool StreamInflater::Finish(time_t const Date)
+{
+   if (Failed == true || Ended == false || Started == false)
+      return false;
+
+   _error->PushToStack();
+   bool const Okay = Out.Close();
+   _error->RevertToStack();
+   if (Okay == false)
+      return false;
+
+   struct utimbuf UBuf;
+   UBuf.actime = Date;
+   UBuf.modtime = Date;
+   utime(Filename.c_str(),&UBuf);
+   return true;
+}
+									/*}}}*/
+// StreamInflater::~StreamInflater - Destructor				/*{{{*/
+// ---------------------------------------------------------------------
+/* An unfinished file is removed again */
+StreamInflater::~StreamInflater()
+{
+   if (Started == true)
+      inflateEnd(&Stream);
+   if (Out.IsOpen() == true)
+   {
+      Out.OpFail();
+      _error->PushToStack();
+      Out.Close();
+      _error->RevertToStack();
+   }
+}
+									/*}}}*/
  
 // CircleBuf::CircleBuf - Circular input buffer				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-CircleBuf::CircleBuf(unsigned long long Size) : Size(Size), Hash(0)
+CircleBuf::CircleBuf(unsigned long long Size) : Size(Size), Hash(0), Inflate(0)
 {
    Buf = new unsigned char[Size];
    Reset();
@@ -232,11 +367,52 @@ bool CircleBuf::Write(int Fd)
       
       if (Hash != 0)
 	 Hash->Add(Buf + (OutP%Size),Res);
+      if (Inflate != 0)
+	 Inflate->Add(Buf + (OutP%Size),Res);
       
       OutP += Res;
    }
 }
 									/*}}}*/
+// CircleBuf::WriteAt - Write from the buffer into a FD at Pos		/*{{{*/
+// ---------------------------------------------------------------------
+/* This empties the buffer into the FD with pwrite, so a file can be
+   written at multiple places at once. Pos is advanced. */
+bool CircleBuf::WriteAt(int Fd,unsigned long long &Pos)
+{
+   while (1)
+   {
+      FillOut();
+      
+      // Woops, buffer is empty
+      if (OutP == InP)
+	 return true;
+      
+      if (OutP == MaxGet)
+	 return true;
+      
+      // Write the buffer segment
+      ssize_t Res;
+      Res = pwrite(Fd,Buf + (OutP%Size),LeftWrite(),Pos);
+
+      if (Res == 0)
+	 return false;
+      if (Res < 0)
+      {
+	 if (errno == EAGAIN || errno == EINTR)
+	    return true;
+	 
+	 return false;
+      }
+      
+      if (Hash != 0)
+	 Hash->Add(Buf + (OutP%Size),Res);
+      
+      OutP += Res;
+      Pos += Res;
+   }
+}
+									/*}}}*/
 // CircleBuf::WriteTillEl - Write from the buffer to a string		/*{{{*/
 // ---------------------------------------------------------------------
 /* This copies till the first empty line */
@@ -293,6 +469,7 @@ CircleBuf::~CircleBuf()
 {
    delete [] Buf;
    delete Hash;
+   delete Inflate;
 }
 
 // ServerState::ServerState - Constructor				/*{{{*/
@@ -377,6 +554,8 @@ bool ServerState::Open()
 /* */
 bool ServerState::Close()
 {
+   // a new connection is likely to get the same fd
+   Owner->Poller.Forget(ServerFd);
    close(ServerFd);
    ServerFd = -1;
    return true;
@@ -397,6 +576,7 @@ ServerState::RunHeadersResult ServerState::RunHeaders()
    Result = 0; 
    Size = 0; 
    StartPos = 0;
+   EndPos = 0;
    Encoding = Closes;
    HaveContent = false;
    time(&Date);
@@ -619,7 +799,7 @@ bool ServerState::HeaderLine(string Line)
    {
       HaveContent = true;
       
-      if (sscanf(Val.c_str(),"bytes %llu-%*u/%llu",&StartPos,&Size) != 2)
+      if (sscanf(Val.c_str(),"bytes %llu-%llu/%llu",&StartPos,&EndPos,&Size) != 3)
 	 return _error->Error(_("The HTTP server sent an invalid Content-Range header"));
       if ((unsigned long long)StartPos > Size)
 	 return _error->Error(_("This HTTP server has broken range support"));
@@ -663,7 +843,7 @@ bool ServerState::HeaderLine(string Line)
 // HttpMethod::SendReq - Send the HTTP request				/*{{{*/
 // ---------------------------------------------------------------------
 /* This places the http request in the outbound buffer */
-void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out)
+void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out,string const &Range)
 {
    URI Uri = Itm->Uri;
 
@@ -733,7 +913,9 @@ void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out)
 
    // Check for a partial file
    struct stat SBuf;
-   if (stat(Itm->DestFile.c_str(),&SBuf) >= 0 && SBuf.st_size > 0)
+   if (Range.empty() == false)
+      Req += "Range: bytes=" + Range + "\r\n";
+   else if (stat(Itm->DestFile.c_str(),&SBuf) >= 0 && SBuf.st_size > 0)
    {
       // In this case we send an if-range query with a range header
       sprintf(Buf,"Range: bytes=%lli-\r\nIf-Range: %s\r\n",(long long)SBuf.st_size - 1,
@@ -770,7 +952,7 @@ void HttpMethod::SendReq(FetchItem *Itm,CircleBuf &Out)
 									/*}}}*/
 // HttpMethod::Go - Run a single loop					/*{{{*/
 // ---------------------------------------------------------------------
-/* This runs the select loop over the server FDs, Output file FDs and
+/* This runs the poll loop over the server FDs, Output file FDs and
    stdin. */
 bool HttpMethod::Go(bool ToFile,ServerState *Srv)
 {
@@ -779,62 +961,45 @@ bool HttpMethod::Go(bool ToFile,ServerState *Srv)
 			       ToFile == false))
       return false;
    
-   fd_set rfds,wfds;
-   FD_ZERO(&rfds);
-   FD_ZERO(&wfds);
-   
    /* Add the server. We only send more requests if the connection will 
       be persisting */
    if (Srv->Out.WriteSpace() == true && Srv->ServerFd != -1 
        && Srv->Persistent == true)
-      FD_SET(Srv->ServerFd,&wfds);
+      Poller.Watch(Srv->ServerFd,FdPoller::Write);
    if (Srv->In.ReadSpace() == true && Srv->ServerFd != -1)
-      FD_SET(Srv->ServerFd,&rfds);
+      Poller.Watch(Srv->ServerFd,FdPoller::Read);
    
-   // Add the file
+   /* Add the file - it is either a regular file or /dev/null, so it is
+      always ready and we just don't wait if there is something to write */
    int FileFD = -1;
    if (File != 0)
       FileFD = File->Fd();
-   
-   if (Srv->In.WriteSpace() == true && ToFile == true && FileFD != -1)
-      FD_SET(FileFD,&wfds);
+   bool const WriteFile = (Srv->In.WriteSpace() == true && ToFile == true && FileFD != -1);
 
    // Add stdin
    if (_config->FindB("Acquire::http::DependOnSTDIN", true) == true)
-      FD_SET(STDIN_FILENO,&rfds);
-	  
-   // Figure out the max fd
-   int MaxFd = FileFD;
-   if (MaxFd < Srv->ServerFd)
-      MaxFd = Srv->ServerFd;
-
-   // Select
-   struct timeval tv;
-   tv.tv_sec = TimeOut;
-   tv.tv_usec = 0;
-   int Res = 0;
-   if ((Res = select(MaxFd+1,&rfds,&wfds,0,&tv)) < 0)
-   {
-      if (errno == EINTR)
-	 return true;
-      return _error->Errno("select",_("Select failed"));
-   }
+      Poller.Watch(STDIN_FILENO,FdPoller::Read);
+
+   // Poll
+   int Res = Poller.Wait(WriteFile == true ? 0 : TimeOut * 1000);
+   if (Res < 0)
+      return _error->Errno("poll",_("Select failed"));
    
-   if (Res == 0)
+   if (Res == 0 && WriteFile == false)
    {
       _error->Error(_("Connection timed out"));
       return ServerDie(Srv);
    }
    
    // Handle server IO
-   if (Srv->ServerFd != -1 && FD_ISSET(Srv->ServerFd,&rfds))
+   if (Srv->ServerFd != -1 && (Poller.Ready(Srv->ServerFd) & FdPoller::Read) != 0)
    {
       errno = 0;
       if (Srv->In.Read(Srv->ServerFd) == false)
 	 return ServerDie(Srv);
    }
 	 
-   if (Srv->ServerFd != -1 && FD_ISSET(Srv->ServerFd,&wfds))
+   if (Srv->ServerFd != -1 && (Poller.Ready(Srv->ServerFd) & FdPoller::Write) != 0)
    {
       errno = 0;
       if (Srv->Out.Write(Srv->ServerFd) == false)
@@ -842,14 +1007,14 @@ bool HttpMethod::Go(bool ToFile,ServerState *Srv)
    }
 
    // Send data to the file
-   if (FileFD != -1 && FD_ISSET(FileFD,&wfds))
+   if (WriteFile == true)
    {
       if (Srv->In.Write(FileFD) == false)
 	 return _error->Errno("write",_("Error writing to output file"));
    }
 
    // Handle commands from APT
-   if (FD_ISSET(STDIN_FILENO,&rfds))
+   if ((Poller.Ready(STDIN_FILENO) & FdPoller::Read) != 0)
    {
       if (Run(true) != -1)
 	 exit(100);
@@ -1023,6 +1188,19 @@ HttpMethod::DealWithHeaders(FetchResult &Res,ServerState *Srv)
    delete Srv->In.Hash;
    Srv->In.Hash = new Hashes;
 
+   // decompress the file on the fly if asked to, but not if it is resumed
+   delete Srv->In.Inflate;
+   Srv->In.Inflate = 0;
+   if (Queue->DecompressFilename.empty() == false && Srv->StartPos <= 0)
+   {
+      Srv->In.Inflate = new StreamInflater;
+      if (Srv->In.Inflate->Open(Queue->DecompressFilename) == false)
+      {
+	 delete Srv->In.Inflate;
+	 Srv->In.Inflate = 0;
+      }
+   }
+
    // Set the expected size and read file for the hashes
    if (Srv->StartPos >= 0)
    {
@@ -1080,6 +1258,9 @@ bool HttpMethod::Fetch(FetchItem *)
       // Make sure we stick with the same server
       if (Server->Comp(I->Uri) == false)
 	 break;
+      // Large files are fetched by Loop() over connections of their own
+      if (Segmentable(I) == true)
+	 break;
       if (QueueBack == I)
       {
 	 QueueBack = I->Next;
@@ -1091,6 +1272,205 @@ bool HttpMethod::Fetch(FetchItem *)
    return true;
 };
 									/*}}}*/
+// HttpMethod::Segmentable - Should the item be fetched in segments	/*{{{*/
+// ---------------------------------------------------------------------
+/* Only files we know the size of and which are large enough to be split
+   into at least two segments are. A partial file is resumed as usual. */
+bool HttpMethod::Segmentable(FetchItem const * const Itm) const
+{
+   if (Segments < 2 || MinSegmentSize == 0 || Itm->IndexFile == true ||
+       Itm->ExpectedSize / MinSegmentSize < 2 || Itm->DestFile == NoSegments)
+      return false;
+
+   struct stat Buf;
+   if (stat(Itm->DestFile.c_str(),&Buf) == 0 && Buf.st_size > 0)
+      return false;
+   return true;
+}
+									/*}}}*/
+// HttpMethod::FetchSegmented - Fetch the first item in segments	/*{{{*/
+// ---------------------------------------------------------------------
+/* The file is split into ranges, each of them is requested over a
+   connection of its own and written with pwrite to its place in the file.
+   The hashes are calculated once over the complete file. If the server
+   doesn't answer a range as asked for (or anything else goes wrong) we
+   give up and the item is fetched the usual way. An interrupted download
+   leaves a file with holes behind, but as its mtime is not the one of the
+   server the If-Range request for resuming it fetches the whole file. */
+bool HttpMethod::FetchSegmented()
+{
+   FetchItem * const Itm = Queue;
+   unsigned long long const FileSize = Itm->ExpectedSize;
+   unsigned long long Count = FileSize / MinSegmentSize;
+   if (Count > Segments)
+      Count = Segments;
+
+   FileFd Target(Itm->DestFile,FileFd::WriteAny);
+   if (_error->PendingError() == true || Target.Truncate(0) == false)
+   {
+      _error->Discard();
+      return false;
+   }
+
+   vector<RangeSegment> Parts;
+   bool Okay = true;
+   for (unsigned long long I = 0; I < Count; ++I)
+   {
+      RangeSegment Part;
+      Part.Start = FileSize / Count * I;
+      Part.End = (I + 1 == Count) ? FileSize - 1 : FileSize / Count * (I + 1) - 1;
+      Part.Pos = Part.Start;
+      Part.HaveHeaders = false;
+      Part.Srv = new ServerState(Itm->Uri,this);
+      Parts.push_back(Part);
+      if (Part.Srv->Open() == false)
+      {
+	 Okay = false;
+	 break;
+      }
+
+      char Range[100];
+      snprintf(Range,sizeof(Range),"%llu-%llu",Part.Start,Part.End);
+      SendReq(Itm,Part.Srv->Out,Range);
+   }
+
+   FetchResult Res;
+   Res.Filename = Itm->DestFile;
+   Res.Size = FileSize;
+   if (Okay == true)
+      URIStart(Res);
+
+   unsigned long long Done = 0;
+   while (Okay == true && Done < Parts.size())
+   {
+      for (vector<RangeSegment>::const_iterator P = Parts.begin(); P != Parts.end(); ++P)
+      {
+	 if (P->Srv->ServerFd == -1)
+	    continue;
+	 if (P->Srv->Out.WriteSpace() == true)
+	    Poller.Watch(P->Srv->ServerFd,FdPoller::Write);
+	 Poller.Watch(P->Srv->ServerFd,FdPoller::Read);
+      }
+      if (_config->FindB("Acquire::http::DependOnSTDIN", true) == true)
+	 Poller.Watch(STDIN_FILENO,FdPoller::Read);
+
+      int const Ready = Poller.Wait(TimeOut * 1000);
+      if (Ready < 0)
+      {
+	 Okay = _error->Errno("poll",_("Select failed"));
+	 break;
+      }
+      if (Ready == 0)
+      {
+	 Okay = _error->Error(_("Connection timed out"));
+	 break;
+      }
+
+      for (vector<RangeSegment>::iterator P = Parts.begin();
+	   Okay == true && P != Parts.end(); ++P)
+      {
+	 ServerState * const Srv = P->Srv;
+	 if (Srv->ServerFd == -1)
+	    continue;
+	 unsigned int const Events = Poller.Ready(Srv->ServerFd);
+	 if ((Events & FdPoller::Write) != 0 && Srv->Out.Write(Srv->ServerFd) == false)
+	 {
+	    Okay = _error->Errno("write",_("Error writing to server"));
+	    break;
+	 }
+	 bool const Closed = ((Events & FdPoller::Read) != 0 &&
+			      Srv->In.Read(Srv->ServerFd) == false);
+
+	 string Data;
+	 while (P->HaveHeaders == false && Srv->In.WriteTillEl(Data) == true)
+	 {
+	    if (Debug == true)
+	       clog << Data;
+	    for (string::const_iterator I = Data.begin(); Okay == true && I < Data.end(); ++I)
+	    {
+	       string::const_iterator J = I;
+	       for (; J != Data.end() && *J != '\n' && *J != '\r'; ++J);
+	       Okay = Srv->HeaderLine(string(I,J));
+	       I = J;
+	    }
+	    if (Okay == false || Srv->Result == 100)
+	       continue;
+
+	    // only the exact range we asked for is any good for us
+	    if (Srv->Result != 206 || Srv->Encoding == ServerState::Chunked ||
+		(unsigned long long) Srv->StartPos != P->Start || Srv->EndPos != P->End)
+	    {
+	       Okay = _error->Error("Range %llu-%llu is not supported by the server",
+				    P->Start,P->End);
+	       break;
+	    }
+	    if (P == Parts.begin())
+	       Res.LastModified = Srv->Date;
+	    Srv->In.Limit(P->End - P->Start + 1);
+	    P->HaveHeaders = true;
+	 }
+	 if (Okay == false)
+	    break;
+
+	 if (P->HaveHeaders == true && Srv->In.WriteAt(Target.Fd(),P->Pos) == false)
+	 {
+	    Okay = _error->Errno("write",_("Error writing to output file"));
+	    break;
+	 }
+
+	 if (P->HaveHeaders == true && Srv->In.IsLimit() == true)
+	 {
+	    Srv->Close();
+	    ++Done;
+	 }
+	 else if (Closed == true)
+	    Okay = _error->Error(_("Error reading from server. Remote end closed connection"));
+      }
+
+      // Handle commands from APT
+      if ((Poller.Ready(STDIN_FILENO) & FdPoller::Read) != 0)
+      {
+	 if (Run(true) != -1)
+	    exit(100);
+      }
+   }
+
+   for (vector<RangeSegment>::const_iterator P = Parts.begin(); P != Parts.end(); ++P)
+      delete P->Srv;
+
+   if (Okay == true)
+   {
+      Hashes Hash;
+      if (Target.Seek(0) == false || Hash.AddFD(Target,FileSize) == false)
+	 Okay = _error->Errno("read",_("Problem hashing file"));
+      else
+	 Res.TakeHashes(Hash);
+   }
+
+   if (Okay == false)
+   {
+      if (Debug == true)
+      {
+	 clog << "Fetching " << Itm->Uri << " in segments failed:" << endl;
+	 _error->DumpErrors();
+      }
+      _error->Discard();
+      Target.Close();
+      unlink(Itm->DestFile.c_str());
+      return false;
+   }
+   Target.Close();
+
+   // Timestamp
+   struct utimbuf UBuf;
+   UBuf.actime = Res.LastModified;
+   UBuf.modtime = Res.LastModified;
+   utime(Itm->DestFile.c_str(),&UBuf);
+
+   URIDone(Res);
+   return true;
+}
+									/*}}}*/
 // HttpMethod::Configuration - Handle a configuration message		/*{{{*/
 // ---------------------------------------------------------------------
 /* We stash the desired pipeline depth */
@@ -1103,6 +1483,11 @@ bool HttpMethod::Configuration(string Message)
    TimeOut = _config->FindI("Acquire::http::Timeout",TimeOut);
    PipelineDepth = _config->FindI("Acquire::http::Pipeline-Depth",
 				  PipelineDepth);
+   Segments = _config->FindI("Acquire::http::Segments",Segments);
+   MinSegmentSize = _config->FindI("Acquire::http::Min-Segment-Size",MinSegmentSize);
+   // the bandwidth limit is per connection
+   if (_config->FindI("Acquire::http::Dl-Limit",0) > 0)
+      Segments = 1;
    Debug = _config->FindB("Debug::Acquire::http",false);
    AutoDetectProxyCmd = _config->Find("Acquire::http::ProxyAutoDetect");
 
@@ -1150,6 +1535,14 @@ int HttpMethod::Loop()
 
       if (Queue == 0)
 	 continue;
+
+      // Fetch large files in ranges over multiple connections
+      if (QueueBack == Queue && Segmentable(Queue) == true)
+      {
+	 if (FetchSegmented() == false)
+	    NoSegments = Queue->DestFile;
+	 continue;
+      }
       
       // Connect to the server
       if (Server == 0 || Server->Comp(Queue->Uri) == false)
@@ -1247,10 +1640,22 @@ int HttpMethod::Loop()
 	    utime(Queue->DestFile.c_str(),&UBuf);
 
 	    // Send status to APT
+	    StreamInflater * const Inflate = Server->In.Inflate;
+	    Server->In.Inflate = 0;
 	    if (Result == true)
 	    {
 	       Res.TakeHashes(*Server->In.Hash);
-	       URIDone(Res);
+	       if (Inflate != 0 && Inflate->Finish(Server->Date) == true)
+	       {
+		  FetchResult Decompressed;
+		  Decompressed.Filename = Inflate->Filename;
+		  Decompressed.Size = Inflate->Size;
+		  Decompressed.LastModified = Server->Date;
+		  Decompressed.TakeHashes(Inflate->Hash);
+		  URIDoneDecompressed(Res,Decompressed);
+	       }
+	       else
+		  URIDone(Res);
 	    }
 	    else
 	    {
@@ -1271,6 +1676,7 @@ int HttpMethod::Loop()
 	       else
 		  Fail(true);
 	    }
+	    delete Inflate;
 	    break;
 	 }
 	 
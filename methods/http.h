@@ -14,6 +14,7 @@
 #define MAXLEN 360
 
 #include <apt-pkg/strutl.h>
+#include <apt-pkg/fdpoller.h>
 
 #include <string>
 
@@ -22,6 +23,7 @@ using std::endl;
 
 class HttpMethod;
 class Hashes;
+class StreamInflater;
 
 class CircleBuf
 {
@@ -60,6 +62,7 @@ class CircleBuf
    public:
    
    Hashes *Hash;
+   StreamInflater *Inflate;
    
    // Read data in
    bool Read(int Fd);
@@ -67,6 +70,7 @@ class CircleBuf
    
    // Write data out
    bool Write(int Fd);
+   bool WriteAt(int Fd,unsigned long long &Pos);
    bool WriteTillEl(std::string &Data,bool Single = false);
    
    // Control the write limit
@@ -97,6 +101,7 @@ struct ServerState
    // These are some statistics from the last parsed header lines
    unsigned long long Size;
    signed long long StartPos;
+   unsigned long long EndPos;
    time_t Date;
    bool HaveContent;
    enum {Chunked,Stream,Closes} Encoding;
@@ -118,7 +123,7 @@ struct ServerState
    bool HeaderLine(std::string Line);
    bool Comp(URI Other) const {return Other.Host == ServerName.Host && Other.Port == ServerName.Port;};
    void Reset() {Major = 0; Minor = 0; Result = 0; Code[0] = '\0'; Size = 0;
-		 StartPos = 0; Encoding = Closes; time(&Date); HaveContent = false;
+		 StartPos = 0; EndPos = 0; Encoding = Closes; time(&Date); HaveContent = false;
 		 State = Header; Persistent = false; ServerFd = -1;
 		 Pipeline = true;};
 
@@ -143,9 +148,19 @@ struct ServerState
    ~ServerState() {Close();};
 };
 
+/** \brief A range of a file fetched over a connection of its own */
+struct RangeSegment
+{
+   ServerState *Srv;
+   unsigned long long Start;
+   unsigned long long End;
+   unsigned long long Pos;
+   bool HaveHeaders;
+};
+
 class HttpMethod : public pkgAcqMethod
 {
-   void SendReq(FetchItem *Itm,CircleBuf &Out);
+   void SendReq(FetchItem *Itm,CircleBuf &Out,std::string const &Range = "");
    bool Go(bool ToFile,ServerState *Srv);
    bool Flush(ServerState *Srv);
    bool ServerDie(ServerState *Srv);
@@ -168,6 +183,15 @@ class HttpMethod : public pkgAcqMethod
    /** \brief Handle the retrieved header data */
    DealWithHeadersResult DealWithHeaders(FetchResult &Res,ServerState *Srv);
 
+   /** \brief Should the item be fetched in segments */
+   bool Segmentable(FetchItem const * const Itm) const;
+   /** \brief Fetch the first item in parallel ranges
+    *
+    *  \return \b true if the item was fetched, \b false if it has
+    *  to be fetched the usual way instead
+    */
+   bool FetchSegmented();
+
    /** \brief Try to AutoDetect the proxy */
    bool AutoDetectProxy();
 
@@ -184,12 +208,15 @@ class HttpMethod : public pkgAcqMethod
    
    std::string NextURI;
    std::string AutoDetectProxyCmd;
+   // The file for which segments have failed, it is fetched normally
+   std::string NoSegments;
 
    public:
    friend struct ServerState;
 
    FileFd *File;
    ServerState *Server;
+   FdPoller Poller;
    
    int Loop();
    
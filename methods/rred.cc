@@ -9,8 +9,12 @@
 #include <apt-pkg/hashes.h>
 #include <apt-pkg/configuration.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <utime.h>
 #include <stdio.h>
@@ -27,6 +31,12 @@
  *  "<em>d</em>elete" (diff doesn't output any other).
  *  Additionally the records must be reverse sorted by line number and
  *  may not overlap (diff *seems* to produce this kind of output).
+ *
+ *  If no single patch "File.ed" exists the method looks for a chain of
+ *  patches named "File.ed.<n>.gz" which are applied in the sort order of
+ *  their names, so <n> is expected to be zero-padded. The chain is
+ *  composed in memory, so the result is written only once instead of
+ *  once for each patch.
  * */
 class RredMethod : public pkgAcqMethod {
 	bool Debug;
@@ -45,6 +55,8 @@ class RredMethod : public pkgAcqMethod {
 
 	State patchFile(FileFd &Patch, FileFd &From, FileFd &out_file, Hashes *hash) const;
 	State patchMMap(FileFd &Patch, FileFd &From, FileFd &out_file, Hashes *hash) const;
+	State patchChain(std::vector<std::string> const &Patches, FileFd &From,
+	                 FileFd &out_file, Hashes *hash) const;
 
 protected:
 	// the methods main method
@@ -437,6 +449,273 @@ RredMethod::State RredMethod::patchMMap(FileFd &Patch, FileFd &From,		/*{{{*/
 #endif
 }
 										/*}}}*/
+/* struct EdSegment, EdChange						{{{*/
+#ifdef _POSIX_MAPPED_FILES
+/* A run of complete lines either in the file to patch or in one of the
+   patches of a chain. The composed result is just a list of them. */
+struct EdSegment {
+  const char *data;
+  size_t size;
+  size_t lines;
+};
+struct EdChange {
+  size_t first_line;
+  size_t last_line;
+  char type;
+  EdSegment text;
+};
+										/*}}}*/
+// countLines - number of lines in the given data			/*{{{*/
+static size_t countLines(const char *data, size_t const size)
+{
+	size_t lines = 0;
+	const char *end = data + size;
+	for (const char *p = data; p != end; ++p) {
+		++lines;
+		p = (const char*) memchr(p, '\n', end - p);
+		if (p == NULL)
+			break;
+	}
+	return lines;
+}
+									/*}}}*/
+// parseEdScript - collect the commands of one patch of a chain		/*{{{*/
+// ---------------------------------------------------------------------
+/* The commands are returned in ascending order (= the reverse of the patch)
+   with the text for add/change pointing into the patch data */
+static bool parseEdScript(const char *data, size_t const size,
+			  std::vector<EdChange> &changes)
+{
+	changes.clear();
+	const char *p = data;
+	const char *end = data + size;
+	while (p != end) {
+		if (*p == '\n') {
+			++p;
+			continue;
+		}
+		const char *eol = (const char*) memchr(p, '\n', end - p);
+		if (eol == NULL)
+			eol = end;
+		std::string const command(p, eol);
+		p = (eol == end) ? end : eol + 1;
+
+		EdChange change;
+		char *idx;
+		errno = 0;
+		change.first_line = strtoul(command.c_str(), &idx, 10);
+		change.last_line = change.first_line;
+		if (errno == 0 && idx != command.c_str() && *idx == ',')
+			change.last_line = strtoul(idx + 1, &idx, 10);
+		if (errno != 0 || idx == command.c_str() || idx[0] == '\0' || idx[1] != '\0' ||
+		    change.last_line < change.first_line)
+			return _error->Error("rred: Can't parse the ed command '%s'", command.c_str());
+		change.type = *idx;
+		if (change.type != 'a' && change.type != 'c' && change.type != 'd')
+			return _error->Error("rred: Unknown ed command '%c'. Abort.", change.type);
+		if (change.type != 'a' && change.first_line == 0)
+			return _error->Error("rred: The ed command '%s' refers to line 0", command.c_str());
+		if (changes.empty() == false && change.first_line > changes.back().first_line)
+			return _error->Error("rred: The start line (%lu) of the next command is higher than the last line (%lu). This is not allowed.",
+					     (unsigned long) change.first_line, (unsigned long) changes.back().first_line);
+
+		change.text.data = p;
+		change.text.size = 0;
+		change.text.lines = 0;
+		if (change.type != 'd') {
+			// the text ends with a line containing only a dot
+			for (;;) {
+				if (p == end)
+					return _error->Error("rred: The text of the ed command '%s' isn't terminated", command.c_str());
+				const char *next = (const char*) memchr(p, '\n', end - p);
+				next = (next == NULL) ? end : next + 1;
+				if (p[0] == '.' && (next - p == 1 || p[1] == '\n')) {
+					change.text.size = p - change.text.data;
+					p = next;
+					break;
+				}
+				++change.text.lines;
+				p = next;
+			}
+		}
+		changes.push_back(change);
+	}
+	std::reverse(changes.begin(), changes.end());
+	return true;
+}
+									/*}}}*/
+// moveLines - pass lines from one segment list to another		/*{{{*/
+// ---------------------------------------------------------------------
+/* Cur is the not yet handled part of the segment before In[I]. The lines
+   are appended to Out, or dropped if Out is NULL. */
+static bool moveLines(std::vector<EdSegment> const &In, size_t &I, EdSegment &Cur,
+		      size_t count, std::vector<EdSegment> *Out)
+{
+	while (count != 0) {
+		if (Cur.lines == 0) {
+			if (I == In.size())
+				return false;
+			Cur = In[I++];
+			continue;
+		}
+		EdSegment head = Cur;
+		if (Cur.lines > count) {
+			// there are at least count newlines as Cur has more lines
+			const char *p = Cur.data;
+			for (size_t n = count; n != 0; --n)
+				p = (const char*) memchr(p, '\n', Cur.data + Cur.size - p) + 1;
+			head.size = p - Cur.data;
+			head.lines = count;
+		}
+		if (Out != NULL)
+			Out->push_back(head);
+		Cur.data += head.size;
+		Cur.size -= head.size;
+		Cur.lines -= head.lines;
+		count -= head.lines;
+	}
+	return true;
+}
+									/*}}}*/
+// applyChanges - compose one patch onto the current segment list	/*{{{*/
+static bool applyChanges(std::vector<EdSegment> const &In,
+			 std::vector<EdChange> const &changes,
+			 std::vector<EdSegment> &Out)
+{
+	Out.clear();
+	Out.reserve(In.size() + 2 * changes.size() + 1);
+	size_t I = 0;
+	EdSegment Cur = { NULL, 0, 0 };
+	size_t line = 1; // the next line of In we haven't handled yet
+	for (std::vector<EdChange>::const_iterator c = changes.begin();
+	     c != changes.end(); ++c) {
+		size_t const keep = (c->type == 'a') ? c->first_line : c->first_line - 1;
+		if (keep + 1 < line)
+			return _error->Error("rred: The ed commands for line %lu overlap", (unsigned long) c->first_line);
+		if (moveLines(In, I, Cur, keep + 1 - line, &Out) == false)
+			return _error->Error("rred: The ed command for line %lu is behind the end of the file", (unsigned long) c->first_line);
+		line = keep + 1;
+		if (c->type != 'a') {
+			size_t const drop = c->last_line - c->first_line + 1;
+			if (moveLines(In, I, Cur, drop, NULL) == false)
+				return _error->Error("rred: The ed command for line %lu is behind the end of the file", (unsigned long) c->first_line);
+			line += drop;
+		}
+		if (c->type != 'd' && c->text.size != 0)
+			Out.push_back(c->text);
+	}
+	if (Cur.size != 0)
+		Out.push_back(Cur);
+	Out.insert(Out.end(), In.begin() + I, In.end());
+	return true;
+}
+									/*}}}*/
+// writeSegments - write the composed file with writev			/*{{{*/
+static bool writeSegments(int const fd, std::vector<EdSegment> const &Segments,
+			  Hashes *hash)
+{
+	struct iovec iov[IOV_COUNT];
+	for (std::vector<EdSegment>::const_iterator S = Segments.begin();
+	     S != Segments.end();) {
+		size_t count = 0;
+		for (; count != IOV_COUNT && S != Segments.end(); ++S, ++count) {
+			iov[count].iov_base = (void*) S->data;
+			iov[count].iov_len = S->size;
+			hash->Add((const unsigned char*) S->data, S->size);
+		}
+		struct iovec *v = iov;
+		while (count != 0) {
+			ssize_t const written = writev(fd, v, count);
+			if (written < 0) {
+				if (errno == EINTR)
+					continue;
+				return _error->Errno("writev", "rred: Failed to write the patched file");
+			}
+			size_t done = written;
+			for (; count != 0 && done >= v->iov_len; ++v, --count)
+				done -= v->iov_len;
+			if (count != 0) {
+				v->iov_base = (char*) v->iov_base + done;
+				v->iov_len -= done;
+			}
+		}
+	}
+	return true;
+}
+#endif
+									/*}}}*/
+/** \brief patchChain - apply a chain of patches with a single write	{{{
+ *
+ *  Each patch is parsed and composed onto a list of segments which refer to
+ *  the lines of the (mapped) input file and the texts of the patches, so the
+ *  input is neither copied nor rewritten for the intermediate states. Only
+ *  the final list is written out and hashed.
+ *
+ *  \param Patches the ed-style patches in the order they have to be applied
+ *  \param From base file we want to patch
+ *  \param out_file file to write the patched result to
+ *  \param hash the created file for correctness
+ *  \return the success State of the ed command executor
+ */
+RredMethod::State RredMethod::patchChain(std::vector<std::string> const &Patches,
+					FileFd &From, FileFd &out_file, Hashes *hash) const {
+#ifdef _POSIX_MAPPED_FILES
+	std::vector<EdSegment> Segments, Next;
+	std::vector<EdChange> Changes;
+	// the texts of the patches are referenced until the end
+	std::vector<char*> Buffers;
+	State result = ED_OK;
+
+	MMap *in_file = NULL;
+	if (From.Size() != 0) {
+		in_file = new MMap(From, MMap::ReadOnly);
+		if (in_file->validData() == false)
+			result = MMAP_FAILED;
+		else {
+			EdSegment const all = { (const char*) in_file->Data(), (size_t) in_file->Size(),
+				countLines((const char*) in_file->Data(), in_file->Size()) };
+			Segments.push_back(all);
+		}
+	}
+
+	for (std::vector<std::string>::const_iterator P = Patches.begin();
+	     result == ED_OK && P != Patches.end(); ++P) {
+		FileFd Patch(*P, FileFd::ReadOnly, FileFd::Gzip);
+		if (Patch.IsOpen() == false) {
+			result = ED_FAILURE;
+			break;
+		}
+		unsigned long long const ed_size = Patch.Size();
+		if (ed_size == 0)
+			continue;
+		char * const ed_cmds = new char[ed_size];
+		Buffers.push_back(ed_cmds);
+		if (Patch.Read(ed_cmds, ed_size) == false)
+			result = ED_FAILURE;
+		else if (parseEdScript(ed_cmds, ed_size, Changes) == false)
+			result = ED_PARSER;
+		else if (applyChanges(Segments, Changes, Next) == false)
+			result = ED_FAILURE;
+		else {
+			Segments.swap(Next);
+			if (Debug == true)
+				std::clog << "rred: composed " << *P << " with " << Changes.size()
+					<< " commands into " << Segments.size() << " segments" << std::endl;
+		}
+	}
+
+	if (result == ED_OK && writeSegments(out_file.Fd(), Segments, hash) == false)
+		result = ED_FAILURE;
+
+	for (std::vector<char*>::const_iterator B = Buffers.begin(); B != Buffers.end(); ++B)
+		delete [] *B;
+	delete in_file;
+	return result;
+#else
+	return MMAP_FAILED;
+#endif
+}
+									/*}}}*/
 bool RredMethod::Fetch(FetchItem *Itm)						/*{{{*/
 {
    Debug = _config->FindB("Debug::pkgAcquire::RRed", false);
@@ -451,50 +730,85 @@ bool RredMethod::Fetch(FetchItem *Itm)						/*{{{*/
    } else
       URIStart(Res);
 
-   if (Debug == true) 
-      std::clog << "Patching " << Path << " with " << Path 
-         << ".ed and putting result into " << Itm->DestFile << std::endl;
-   // Open the source and destination files (the d'tor of FileFd will do 
-   // the cleanup/closing of the fds)
-   FileFd From(Path,FileFd::ReadOnly);
-   FileFd Patch(Path+".ed",FileFd::ReadOnly, FileFd::Gzip);
-   FileFd To(Itm->DestFile,FileFd::WriteAtomic);   
-   To.EraseOnFailure();
-   if (_error->PendingError() == true)
-      return false;
-   
+   // a single patch or a chain of patches which is applied in one go
+   std::vector<std::string> Patches;
+   if (FileExists(Path + ".ed") == false) {
+      // not GetListOfFilesInDir as it rejects the ':' used in list names
+      std::string const Dir = flNotFile(Path);
+      std::string const ChainBase = flNotDir(Path) + ".ed.";
+      DIR *D = opendir(Dir.empty() ? "." : Dir.c_str());
+      for (struct dirent *Ent = (D == NULL) ? NULL : readdir(D); Ent != NULL; Ent = readdir(D))
+	 if (strncmp(Ent->d_name, ChainBase.c_str(), ChainBase.length()) == 0 &&
+	     flExtension(Ent->d_name) == "gz")
+	    Patches.push_back(Dir + Ent->d_name);
+      if (D != NULL)
+	 closedir(D);
+      std::sort(Patches.begin(), Patches.end());
+   }
+   std::string const LastPatch = Patches.empty() ? Path + ".ed" : Patches.back();
+
    Hashes Hash;
-   // now do the actual patching
-   State const result = patchMMap(Patch, From, To, &Hash);
-   if (result == MMAP_FAILED) {
-      // retry with patchFile
-      Patch.Seek(0);
-      From.Seek(0);
-      To.Open(Itm->DestFile,FileFd::WriteAtomic);
+   if (Patches.empty() == false) {
+      if (Debug == true)
+	 std::clog << "Patching " << Path << " with a chain of " << Patches.size()
+	    << " patches and putting result into " << Itm->DestFile << std::endl;
+      FileFd From(Path,FileFd::ReadOnly);
+      FileFd To(Itm->DestFile,FileFd::WriteAtomic);
+      To.EraseOnFailure();
       if (_error->PendingError() == true)
-         return false;
-      if (patchFile(Patch, From, To, &Hash) != ED_OK) {
-	 return _error->WarningE("rred", _("Could not patch %s with mmap and with file operation usage - the patch seems to be corrupt."), Path.c_str());
+	 return false;
+      if (patchChain(Patches, From, To, &Hash) != ED_OK)
+	 return _error->Error(_("Could not patch %s with the chain of %lu patches - a patch seems to be corrupt."),
+			      Path.c_str(), (unsigned long) Patches.size());
+      else if (Debug == true)
+	 std::clog << "rred: finished chain patching of " << Path << std::endl;
+      From.Close();
+      To.Close();
+   } else {
+      if (Debug == true) 
+	 std::clog << "Patching " << Path << " with " << Path 
+	    << ".ed and putting result into " << Itm->DestFile << std::endl;
+      // Open the source and destination files (the d'tor of FileFd will do 
+      // the cleanup/closing of the fds)
+      FileFd From(Path,FileFd::ReadOnly);
+      FileFd Patch(Path+".ed",FileFd::ReadOnly, FileFd::Gzip);
+      FileFd To(Itm->DestFile,FileFd::WriteAtomic);   
+      To.EraseOnFailure();
+      if (_error->PendingError() == true)
+	 return false;
+   
+      // now do the actual patching
+      State const result = patchMMap(Patch, From, To, &Hash);
+      if (result == MMAP_FAILED) {
+	 // retry with patchFile
+	 Patch.Seek(0);
+	 From.Seek(0);
+	 To.Open(Itm->DestFile,FileFd::WriteAtomic);
+	 if (_error->PendingError() == true)
+	    return false;
+	 if (patchFile(Patch, From, To, &Hash) != ED_OK) {
+	    return _error->WarningE("rred", _("Could not patch %s with mmap and with file operation usage - the patch seems to be corrupt."), Path.c_str());
+	 } else if (Debug == true) {
+	    std::clog << "rred: finished file patching of " << Path  << " after mmap failed." << std::endl;
+	 }
+      } else if (result != ED_OK) {
+	 return _error->Errno("rred", _("Could not patch %s with mmap (but no mmap specific fail) - the patch seems to be corrupt."), Path.c_str());
       } else if (Debug == true) {
-	 std::clog << "rred: finished file patching of " << Path  << " after mmap failed." << std::endl;
+	 std::clog << "rred: finished mmap patching of " << Path << std::endl;
       }
-   } else if (result != ED_OK) {
-      return _error->Errno("rred", _("Could not patch %s with mmap (but no mmap specific fail) - the patch seems to be corrupt."), Path.c_str());
-   } else if (Debug == true) {
-      std::clog << "rred: finished mmap patching of " << Path << std::endl;
-   }
 
-   // write out the result
-   From.Close();
-   Patch.Close();
-   To.Close();
+      // write out the result
+      From.Close();
+      Patch.Close();
+      To.Close();
+   }
 
    /* Transfer the modification times from the patch file
       to be able to see in which state the file should be
       and use the access time from the "old" file */
    struct stat BufBase, BufPatch;
    if (stat(Path.c_str(),&BufBase) != 0 ||
-       stat(std::string(Path+".ed").c_str(),&BufPatch) != 0)
+       stat(LastPatch.c_str(),&BufPatch) != 0)
       return _error->Errno("stat",_("Failed to stat"));
 
    struct utimbuf TimeBuf;
@@ -541,7 +855,8 @@ public:
  *  accepts one parameter which will switch it directly to debug test mode:
  *  The test mode expects that if "Testfile" is given as parameter
  *  the file "Testfile" should be ed-style patched with "Testfile.ed"
- *  and will write the result to "Testfile.result".
+ *  and will write the result to "Testfile.result". Without a "Testfile.ed"
+ *  the chain of patches "Testfile.ed.*.gz" is applied instead.
  */
 int main(int argc, char *argv[]) {
 	if (argc <= 1) {
@@ -0,0 +1,139 @@
+#include <apt-pkg/acquire.h>
+#include <apt-pkg/acquire-item.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* Benchmark for the protocol between the acquire system and its methods:
+   Thousands of small files are fetched with the file method, so that the
+   time is spent in talking to the method rather than in transferring the
+   data. Each file costs (at least) a 600 URI Acquire and a 201 URI Done
+   message. The files are fetched once with text messages, once with
+   binary frames (Acquire::Binary-Framing) and once without a method
+   process at all (Acquire::In-Process). Each of them is done with the
+   file method (which symlinks the files) and the copy method. */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool FetchAll(unsigned long const Count, std::string const &Served,
+		     std::string const &Fetched, std::vector<std::string> const &Sums)
+{
+   pkgAcquire Fetcher;
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Name[30];
+      snprintf(Name, sizeof(Name), "file-%05lu", I);
+      unlink((Fetched + Name).c_str());
+      new pkgAcqFile(&Fetcher, "file:" + Served + Name, "MD5Sum:" + Sums[I], 0,
+		     Name, Name, "", Fetched + Name);
+   }
+
+   double const Start = Now();
+   pkgAcquire::RunResult const Res = Fetcher.Run();
+   double const Time = Now() - Start;
+
+   unsigned long Done = 0;
+   for (pkgAcquire::ItemIterator I = Fetcher.ItemsBegin(); I != Fetcher.ItemsEnd(); ++I)
+   {
+      if ((*I)->Status == pkgAcquire::Item::StatDone)
+	 ++Done;
+      else
+	 std::cerr << (*I)->DescURI() << ": " << (*I)->ErrorText << std::endl;
+   }
+   std::cout << "Fetched " << Done << " of " << Count << " files in " << Time << " s, "
+	     << (unsigned long) (2 * Count / Time) << " messages/s"
+	     << (Res == pkgAcquire::Continue ? "" : " (FAILED)") << std::endl;
+   return Done == Count && Res == pkgAcquire::Continue;
+}
+
+int main(int argc, char *argv[])
+{
+   if (argc < 2)
+   {
+      std::cerr << "Usage: " << argv[0] << " <path to the methods> [files] [runs]" << std::endl;
+      return 1;
+   }
+   unsigned long const Count = (argc > 2) ? strtoul(argv[2], NULL, 10) : 5000;
+   unsigned long const Runs = (argc > 3) ? strtoul(argv[3], NULL, 10) : 3;
+
+   char Dir[] = "/tmp/acquire-method-bench.XXXXXX";
+   if (mkdtemp(Dir) == NULL)
+   {
+      perror("mkdtemp");
+      return 1;
+   }
+   std::string const Served = std::string(Dir) + "/served/";
+   std::string const Fetched = std::string(Dir) + "/fetched/";
+   mkdir(Served.c_str(), 0755);
+   mkdir(Fetched.c_str(), 0755);
+
+   srand(42);
+   std::vector<std::string> Sums;
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      std::string Content(64 + rand() % 512, '\0');
+      for (std::string::iterator C = Content.begin(); C != Content.end(); ++C)
+	 *C = 'a' + rand() % 26;
+      char Name[30];
+      snprintf(Name, sizeof(Name), "file-%05lu", I);
+      FileFd Fd(Served + Name, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+      Fd.Write(Content.c_str(), Content.size());
+      MD5Summation MD5;
+      MD5.Add(Content.c_str());
+      Sums.push_back(MD5.Result());
+   }
+
+   pkgInitConfig(*_config);
+   _config->Set("Dir::Bin::Methods", argv[1]);
+
+   bool Okay = true;
+   for (int Copy = 0; Copy < 2; ++Copy)
+   {
+      _config->Set("Acquire::Source-Symlinks", Copy == 0 ? "true" : "false");
+      for (int Mode = 0; Mode < 3; ++Mode)
+      {
+	 _config->Set("Acquire::Binary-Framing", Mode == 1 ? "true" : "false");
+	 _config->Set("Acquire::In-Process", Mode == 2 ? "true" : "false");
+	 static char const * const Modes[] = { "text messages", "binary frames", "in-process" };
+	 std::cout << (Copy == 0 ? "Symlinked" : "Copied") << " with " << Modes[Mode] << ":" << std::endl;
+	 for (unsigned long R = 0; R < Runs; ++R)
+	    Okay &= FetchAll(Count, Served, Fetched, Sums);
+      }
+   }
+
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Name[30];
+      snprintf(Name, sizeof(Name), "file-%05lu", I);
+      unlink((Served + Name).c_str());
+      unlink((Fetched + Name).c_str());
+   }
+   rmdir(Served.c_str());
+   rmdir((Fetched + "partial").c_str());
+   rmdir(Fetched.c_str());
+   rmdir(Dir);
+
+   if (_error->PendingError() == true)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   return Okay == true ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+#include <apt-pkg/acquire.h>
+#include <apt-pkg/acquire-item.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* Stress test for the acquire system: A small HTTP server is started and
+   the given number of files is fetched from it, each one via another
+   loopback address (127.0.x.y), so that with the default Queue-Mode=host
+   each file gets its own queue and http method. With enough files the
+   descriptors of the workers go beyond FD_SETSIZE, which a select() loop
+   can't handle. All files are verified after the run.
+   With more than one run the files are fetched again with new pkgAcquire
+   objects, once starting new methods for each run and once keeping the
+   idle methods (and their connections) alive with Acquire::Idle-Methods. */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool WriteAll(int const Fd, char const *Data, size_t Size)
+{
+   while (Size != 0)
+   {
+      ssize_t const Res = write(Fd, Data, Size);
+      if (Res < 0 && errno == EINTR)
+	 continue;
+      if (Res <= 0)
+	 return false;
+      Data += Res;
+      Size -= Res;
+   }
+   return true;
+}
+
+/* serves GET requests on a keep-alive connection with the files in Dir,
+   all other headers the http method sends are ignored */
+static void ServeConnection(int const Fd, std::string const &Dir)
+{
+   std::string Buffer;
+   while (true)
+   {
+      std::string::size_type const End = Buffer.find("\r\n\r\n");
+      if (End == std::string::npos)
+      {
+	 char Data[4096];
+	 ssize_t const Res = read(Fd, Data, sizeof(Data));
+	 if (Res < 0 && errno == EINTR)
+	    continue;
+	 if (Res <= 0)
+	    return;
+	 Buffer.append(Data, Res);
+	 continue;
+      }
+      std::string const Request = Buffer.substr(0, Buffer.find("\r\n"));
+      Buffer.erase(0, End + 4);
+
+      std::string::size_type const Start = Request.find(' ');
+      std::string const Path = Request.substr(Start + 1, Request.find(' ', Start + 1) - Start - 1);
+      std::string Content;
+      FileFd File;
+      if (Path.find("..") == std::string::npos && FileExists(Dir + Path) == true &&
+	  File.Open(Dir + Path, FileFd::ReadOnly) == true)
+      {
+	 Content.resize(File.Size());
+	 if (File.Read(&Content[0], Content.size()) == false)
+	    return;
+      }
+      _error->Discard();
+
+      char Header[200];
+      snprintf(Header, sizeof(Header), "HTTP/1.1 %s\r\nContent-Length: %lu\r\n"
+	       "Connection: keep-alive\r\n\r\n", File.IsOpen() ? "200 OK" : "404 Not Found",
+	       (unsigned long) Content.size());
+      if (WriteAll(Fd, Header, strlen(Header)) == false ||
+	  WriteAll(Fd, Content.c_str(), Content.size()) == false)
+	 return;
+   }
+}
+
+static pid_t StartServer(std::string const &Dir, unsigned short &Port)
+{
+   int const Listen = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_in Addr;
+   memset(&Addr, 0, sizeof(Addr));
+   Addr.sin_family = AF_INET;
+   Addr.sin_addr.s_addr = htonl(INADDR_ANY);
+   socklen_t Len = sizeof(Addr);
+   if (Listen < 0 || bind(Listen, (struct sockaddr *) &Addr, sizeof(Addr)) != 0 ||
+       listen(Listen, 1024) != 0 || getsockname(Listen, (struct sockaddr *) &Addr, &Len) != 0)
+   {
+      _error->Errno("socket", "Failed to start the webserver");
+      return -1;
+   }
+   Port = ntohs(Addr.sin_port);
+
+   pid_t const Server = fork();
+   if (Server != 0)
+   {
+      close(Listen);
+      return Server;
+   }
+
+   // each connection is served by its own process
+   setpgid(0, 0);
+   signal(SIGCHLD, SIG_IGN);
+   while (true)
+   {
+      int const Fd = accept(Listen, NULL, NULL);
+      if (Fd < 0)
+      {
+	 if (errno == EINTR || errno == ECONNABORTED)
+	    continue;
+	 _exit(1);
+      }
+      if (fork() == 0)
+      {
+	 close(Listen);
+	 ServeConnection(Fd, Dir);
+	 _exit(0);
+      }
+      close(Fd);
+   }
+}
+
+static bool FetchAll(unsigned long const Count, unsigned short const Port,
+		     std::string const &Fetched, std::vector<std::string> const &Sums)
+{
+   pkgAcquire Fetcher;
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Name[30];
+      snprintf(Name, sizeof(Name), "file-%05lu", I);
+      unlink((Fetched + Name).c_str());
+      char URI[100];
+      snprintf(URI, sizeof(URI), "http://127.0.%lu.%lu:%u/%s", I / 250, I % 250 + 1, Port, Name);
+      new pkgAcqFile(&Fetcher, URI, "MD5Sum:" + Sums[I], 0, Name, Name, "", Fetched + Name);
+   }
+
+   double const Start = Now();
+   pkgAcquire::RunResult const Res = Fetcher.Run();
+   double const Time = Now() - Start;
+
+   unsigned long Done = 0;
+   for (pkgAcquire::ItemIterator I = Fetcher.ItemsBegin(); I != Fetcher.ItemsEnd(); ++I)
+   {
+      if ((*I)->Status == pkgAcquire::Item::StatDone)
+	 ++Done;
+      else
+	 std::cerr << (*I)->DescURI() << ": " << (*I)->ErrorText << std::endl;
+   }
+   std::cout << "Fetched " << Done << " of " << Count << " files from as many hosts in "
+	     << Time << " s" << (Res == pkgAcquire::Continue ? "" : " (FAILED)") << std::endl;
+   return Done == Count && Res == pkgAcquire::Continue;
+}
+
+int main(int argc, char *argv[])
+{
+   if (argc < 2)
+   {
+      std::cerr << "Usage: " << argv[0] << " <path to the methods> [files] [runs]" << std::endl;
+      return 1;
+   }
+   unsigned long const Count = (argc > 2) ? strtoul(argv[2], NULL, 10) : 300;
+   unsigned long const Runs = (argc > 3) ? strtoul(argv[3], NULL, 10) : 1;
+
+   // the workers need two descriptors each
+   struct rlimit Limit;
+   if (getrlimit(RLIMIT_NOFILE, &Limit) == 0 && Limit.rlim_cur < Limit.rlim_max)
+   {
+      Limit.rlim_cur = Limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &Limit);
+   }
+
+   char Dir[] = "/tmp/acquire-stress.XXXXXX";
+   if (mkdtemp(Dir) == NULL)
+   {
+      perror("mkdtemp");
+      return 1;
+   }
+   std::string const Served = std::string(Dir) + "/served/";
+   std::string const Fetched = std::string(Dir) + "/fetched/";
+   mkdir(Served.c_str(), 0755);
+   mkdir(Fetched.c_str(), 0755);
+
+   srand(42);
+   std::vector<std::string> Sums;
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      std::string Content(4096 + rand() % 65536, '\0');
+      for (std::string::iterator C = Content.begin(); C != Content.end(); ++C)
+	 *C = 'a' + rand() % 26;
+      char Name[30];
+      snprintf(Name, sizeof(Name), "file-%05lu", I);
+      FileFd Fd(Served + Name, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+      Fd.Write(Content.c_str(), Content.size());
+      MD5Summation MD5;
+      MD5.Add(Content.c_str());
+      Sums.push_back(MD5.Result());
+   }
+
+   unsigned short Port;
+   pid_t const Server = StartServer(Served, Port);
+   if (Server < 0)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+
+   pkgInitConfig(*_config);
+   _config->Set("Dir::Bin::Methods", argv[1]);
+   _config->Set("Acquire::Queue-Mode", "host");
+   unsetenv("http_proxy");
+   unsetenv("no_proxy");
+
+   bool Okay = FetchAll(Count, Port, Fetched, Sums);
+   if (Runs > 1)
+   {
+      for (int Idle = 0; Idle < 2; ++Idle)
+      {
+	 _config->Set("Acquire::Idle-Methods", Idle == 0 ? 0 : Count);
+	 std::cout << (Idle == 0 ? "New methods for each run:" : "Idle methods kept between runs:") << std::endl;
+	 double const Start = Now();
+	 for (unsigned long R = 0; R < Runs; ++R)
+	    Okay &= FetchAll(Count, Port, Fetched, Sums);
+	 std::cout << Runs << " runs in " << Now() - Start << " s" << std::endl;
+      }
+      pkgAcquire::StopIdleWorkers();
+   }
+
+   kill(-Server, SIGTERM);
+   kill(Server, SIGTERM);
+   ExecWait(Server, "webserver", true);
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Name[30];
+      snprintf(Name, sizeof(Name), "file-%05lu", I);
+      unlink((Served + Name).c_str());
+      unlink((Fetched + Name).c_str());
+   }
+   rmdir(Served.c_str());
+   rmdir((Fetched + "partial").c_str());
+   rmdir(Fetched.c_str());
+   rmdir(Dir);
+
+   if (_error->PendingError() == true)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   return Okay == true ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/strutl.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* Benchmark for pkgDepCache::Update: A Packages file and a status file
+   with the given number of packages are generated, every second package
+   is installed in an older version, every 256th package provides and
+   every 16th depends on virtual-common. The dependency cache is built and
+   its Update() is timed with different numbers of APT::DepCache::Workers.
+   The states of all packages and dependencies are compared with those of
+   the first (sequential) run. Afterwards all packages are marked for
+   install and every third for removal in one ActionGroup and the states
+   updated along the way are compared with those of a full Update(). */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool Generate(std::string const &Packages, std::string const &Status,
+		     unsigned long const Count)
+{
+   FileFd P(Packages, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+   FileFd S(Status, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Buffer[1024];
+      int Len = snprintf(Buffer, sizeof(Buffer),
+	    "Package: package-%lu\n"
+	    "Architecture: i386\n"
+	    "Version: 1.%lu-1\n"
+	    "Provides: virtual-%lu%s\n"
+	    "Depends: package-%lu (>= 1.0), package-%lu (>= 1.%lu) | package-%lu, virtual-%lu%s\n"
+	    "Recommends: package-%lu\n"
+	    "Conflicts: package-%lu (<< 1.0)\n"
+	    "Breaks: package-%lu (<< 1.%lu~)\n"
+	    "Filename: pool/package-%lu_1.%lu-1_i386.deb\n"
+	    "Size: 1000\n\n",
+	    I, I, I / 4, (I % 256 == 0) ? ", virtual-common" : "",
+	    (I / 64 * 64 + (I + 1) % 64) % Count, (I + 7) % Count, (I + 7) % Count, (I + 13) % Count,
+	    ((I + 3) % Count) / 4, (I % 16 == 1) ? ", virtual-common" : "",
+	    (I + 5) % Count, (I + 11) % Count,
+	    (I + 2) % Count, (I + 2) % Count, I, I);
+      if (P.Write(Buffer, Len) == false)
+	 return false;
+      if (I % 2 != 0)
+	 continue;
+      Len = snprintf(Buffer, sizeof(Buffer),
+	    "Package: package-%lu\n"
+	    "Status: install ok installed\n"
+	    "Architecture: i386\n"
+	    "Version: 1.%lu-0\n"
+	    "Depends: package-%lu (>= 1.0)\n\n",
+	    I, I / 2, (I + 2) % Count);
+      if (S.Write(Buffer, Len) == false)
+	 return false;
+   }
+   return P.Close() && S.Close();
+}
+
+/* all the states the depcache computes in Update() */
+static void Snapshot(pkgDepCache &Cache, std::vector<unsigned long> &States)
+{
+   States.clear();
+   States.push_back(Cache.InstCount());
+   States.push_back(Cache.DelCount());
+   States.push_back(Cache.KeepCount());
+   States.push_back(Cache.BrokenCount());
+   States.push_back(Cache.PolicyBrokenCount());
+   States.push_back(Cache.BadCount());
+   States.push_back(Cache.UsrSize());
+   States.push_back(Cache.DebSize());
+   for (pkgCache::PkgIterator P = Cache.PkgBegin(); P.end() == false; ++P)
+   {
+      pkgDepCache::StateCache const &S = Cache[P];
+      States.push_back(S.DepState);
+      States.push_back(S.Flags);
+      for (pkgCache::VerIterator V = P.VersionList(); V.end() == false; ++V)
+	 for (pkgCache::DepIterator D = V.DependsList(); D.end() == false; ++D)
+	    States.push_back(Cache[D]);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long const Count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 40000;
+   unsigned long const Runs = (argc > 2) ? strtoul(argv[2], NULL, 10) : 5;
+
+   char Dir[] = "/tmp/depcache-bench.XXXXXX";
+   if (mkdtemp(Dir) == NULL)
+   {
+      perror("mkdtemp");
+      return 1;
+   }
+   std::string const Lists = std::string(Dir) + "/lists/";
+   std::string const Archive = std::string(Dir) + "/archive";
+   std::string const Index = Lists + URItoFileName("file:" + Archive + "/dists/stable/main/binary-i386/Packages");
+   mkdir(Lists.c_str(), 0755);
+   mkdir((Lists + "partial").c_str(), 0755);
+   {
+      FileFd Sources(std::string(Dir) + "/sources.list", FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+      std::string const Line = "deb file:" + Archive + " stable main\n";
+      Sources.Write(Line.c_str(), Line.length());
+   }
+   if (Generate(Index, std::string(Dir) + "/status", Count) == false)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+
+   pkgInitConfig(*_config);
+   _config->Set("APT::Architecture", "i386");
+   _config->Set("Dir::State::lists", Lists);
+   _config->Set("Dir::State::status", std::string(Dir) + "/status");
+   _config->Set("Dir::State::extended_states", std::string(Dir) + "/extended_states");
+   _config->Set("Dir::Etc::sourcelist", std::string(Dir) + "/sources.list");
+   _config->Set("Dir::Etc::sourceparts", "/dev/null");
+   _config->Set("Dir::Cache::pkgcache", "");
+   _config->Set("Dir::Cache::srcpkgcache", "");
+   pkgInitSystem(*_config, _system);
+
+   pkgCacheFile CacheFile;
+   if (CacheFile.Open(NULL, false) == false)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   pkgDepCache * const Cache = CacheFile.GetDepCache();
+   std::cout << Cache->Head().PackageCount << " packages with "
+	     << Cache->Head().DependsCount << " dependencies, "
+	     << Cache->BrokenCount() << " broken" << std::endl;
+
+   static char const * const Workers[] = { "1", "2", "4", "8", 0 };
+   std::vector<unsigned long> Expected, Got;
+   bool Okay = true;
+   for (char const * const *W = Workers; *W != 0; ++W)
+   {
+      _config->Set("APT::DepCache::Workers", *W);
+      double const Start = Now();
+      for (unsigned long R = 0; R < Runs; ++R)
+	 Cache->Update();
+      double const Time = (Now() - Start) / Runs;
+      Snapshot(*Cache, Got);
+      if (Expected.empty() == true)
+	 Expected = Got;
+      bool const Same = (Got == Expected);
+      Okay &= Same;
+      std::cout << "Update() with " << *W << " workers: " << Time * 1000 << " ms"
+		<< (Same ? "" : " (DIFFERENT STATES)") << std::endl;
+   }
+
+   double const Start = Now();
+   {
+      pkgDepCache::ActionGroup group(*Cache);
+      for (pkgCache::PkgIterator P = Cache->PkgBegin(); P.end() == false; ++P)
+	 Cache->MarkInstall(P, true, 0, true);
+      for (pkgCache::PkgIterator P = Cache->PkgBegin(); P.end() == false; ++P)
+	 if (P->ID % 3 == 0)
+	    Cache->MarkDelete(P, false, 0, true);
+   }
+   double const Time = Now() - Start;
+   Snapshot(*Cache, Got);
+   Cache->Update();
+   Snapshot(*Cache, Expected);
+   bool const Same = (Got == Expected);
+   Okay &= Same;
+   std::cout << "Marking: " << Time * 1000 << " ms"
+	     << (Same ? "" : " (DIFFERENT STATES)") << std::endl;
+
+   unlink(Index.c_str());
+   unlink((std::string(Dir) + "/status").c_str());
+   unlink((std::string(Dir) + "/sources.list").c_str());
+   rmdir((Lists + "partial").c_str());
+   rmdir(Lists.c_str());
+   rmdir(Dir);
+
+   if (_error->PendingError() == true)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   return Okay == true ? 0 : 1;
+}
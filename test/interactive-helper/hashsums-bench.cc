@@ -0,0 +1,89 @@
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* Benchmark for Hashes::AddFD: A file of the given size in MiB is hashed
+   with each digest on its own and with all of them together, once in
+   sequence and once with the digests computed in parallel. */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double Run(std::string const &Name, unsigned long const Runs, bool const addMD5,
+		  bool const addSHA1, bool const addSHA256, bool const addSHA512)
+{
+   double Best = 0;
+   for (unsigned long R = 0; R < Runs; ++R)
+   {
+      FileFd Fd(Name, FileFd::ReadOnly);
+      Hashes Hash;
+      double const Start = Now();
+      if (Hash.AddFD(Fd, 0, addMD5, addSHA1, addSHA256, addSHA512) == false)
+	 _error->Error("Hashing of %s failed", Name.c_str());
+      double const Time = Now() - Start;
+      if (R == 0 || Time < Best)
+	 Best = Time;
+   }
+   return Best;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long const MiB = (argc > 1) ? strtoul(argv[1], NULL, 10) : 256;
+   unsigned long const Runs = (argc > 2) ? strtoul(argv[2], NULL, 10) : 3;
+
+   char Name[] = "/tmp/hashsums-bench.XXXXXX";
+   int const TmpFd = mkstemp(Name);
+   if (TmpFd < 0)
+   {
+      perror("mkstemp");
+      return 1;
+   }
+   {
+      FileFd Out(TmpFd, true);
+      unsigned char Buffer[1024*1024];
+      for (unsigned long I = 0; I < sizeof(Buffer); ++I)
+	 Buffer[I] = rand();
+      for (unsigned long I = 0; I < MiB; ++I)
+	 if (Out.Write(Buffer, sizeof(Buffer)) == false)
+	    break;
+   }
+
+   struct { const char *Name; bool MD5, SHA1, SHA256, SHA512, Parallel; } const Tests[] = {
+      { "MD5:         ", true, false, false, false, false },
+      { "SHA1:        ", false, true, false, false, false },
+      { "SHA256:      ", false, false, true, false, false },
+      { "SHA512:      ", false, false, false, true, false },
+      { "Sequential:  ", true, true, true, true, false },
+      { "Parallel:    ", true, true, true, true, true },
+      { 0, false, false, false, false, false }
+   };
+   for (unsigned int I = 0; Tests[I].Name != 0 && _error->PendingError() == false; ++I)
+   {
+      _config->Set("APT::Hashes::Parallel", Tests[I].Parallel);
+      double const Time = Run(Name, Runs, Tests[I].MD5, Tests[I].SHA1, Tests[I].SHA256, Tests[I].SHA512);
+      std::cout << Tests[I].Name << MiB << " MiB in " << Time << " s ("
+		<< MiB / Time << " MB/s)" << std::endl;
+   }
+
+   unlink(Name);
+   if (_error->PendingError() == true)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,166 @@
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* Benchmark for pkgProblemResolver::Resolve: An EDSP scenario with the
+   given number of libraries is generated. Each library is installed with
+   an application and a tool using it. The new version of a library breaks
+   the old version of its application, two thirds of the applications have
+   a new version working with it, the others have not. The tools form
+   chains of ten, each needing the one before. Every given library (by
+   default every tenth) is upgraded without installing anything else,
+   which breaks the packages around it, and the resolver has to sort it
+   out by upgrading, holding back and removing. The time of Resolve() and
+   a fingerprint of its solution are printed. */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool Stanza(FileFd &Out, unsigned long &ID, char const * const Name,
+		   unsigned long const I, char const * const Version,
+		   bool const Installed, std::string const &Relations)
+{
+   char Buffer[1024];
+   int const Len = snprintf(Buffer, sizeof(Buffer),
+	 "Package: %s-%lu\n"
+	 "Architecture: amd64\n"
+	 "Version: %s\n"
+	 "APT-ID: %lu\n"
+	 "Priority: optional\n"
+	 "Section: misc\n"
+	 "%s"
+	 "%s\n",
+	 Name, I, Version, ID++, Installed ? "Installed: yes\n" : "",
+	 Relations.c_str());
+   return Out.Write(Buffer, Len);
+}
+
+static bool Generate(std::string const &Scenario, unsigned long const Count)
+{
+   FileFd S(Scenario, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+   unsigned long ID = 0;
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Rel[512];
+      snprintf(Rel, sizeof(Rel), "Breaks: app-%lu (<< 2)\n", I);
+      if (Stanza(S, ID, "lib", I, "1", true, "") == false ||
+	  Stanza(S, ID, "lib", I, "2", false, Rel) == false)
+	 return false;
+
+      snprintf(Rel, sizeof(Rel), "Depends: lib-%lu (<< 2)\n", I);
+      if (Stanza(S, ID, "app", I, "1", true, Rel) == false)
+	 return false;
+      if (I % 3 != 0)
+      {
+	 snprintf(Rel, sizeof(Rel), "Depends: lib-%lu (>= 2)\n", I);
+	 if (Stanza(S, ID, "app", I, "2", false, Rel) == false)
+	    return false;
+      }
+
+      if (I % 10 != 0)
+	 snprintf(Rel, sizeof(Rel), "Depends: app-%lu, tool-%lu\n", I, I - 1);
+      else
+	 snprintf(Rel, sizeof(Rel), "Depends: app-%lu\n", I);
+      if (Stanza(S, ID, "tool", I, "1", true, Rel) == false)
+	 return false;
+   }
+   return S.Close();
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long const Count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+   unsigned long const Every = (argc > 2) ? strtoul(argv[2], NULL, 10) : 10;
+
+   char Scenario[] = "/tmp/resolver-bench.XXXXXX";
+   int const Fd = mkstemp(Scenario);
+   if (Fd == -1)
+   {
+      perror("mkstemp");
+      return 1;
+   }
+   close(Fd);
+   if (Generate(Scenario, Count) == false)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+
+   pkgInitConfig(*_config);
+   _config->Set("APT::Architecture", "amd64");
+   _config->Set("edsp::scenario", Scenario);
+   _config->Set("Dir::Cache::pkgcache", "");
+   _config->Set("Dir::Cache::srcpkgcache", "");
+   pkgInitSystem(*_config, _system);
+
+   pkgCacheFile CacheFile;
+   if (CacheFile.Open(NULL, false) == false)
+   {
+      _error->DumpErrors();
+      unlink(Scenario);
+      return 1;
+   }
+   unlink(Scenario);
+   pkgDepCache * const Cache = CacheFile.GetDepCache();
+
+   pkgProblemResolver Fix(Cache);
+   {
+      pkgDepCache::ActionGroup group(*Cache);
+      for (pkgCache::PkgIterator P = Cache->PkgBegin(); P.end() == false; ++P)
+      {
+	 if (strncmp(P.Name(), "lib-", 4) != 0 ||
+	     strtoul(P.Name() + 4, NULL, 10) % Every != 0)
+	    continue;
+	 Cache->MarkInstall(P, false, 0, false);
+	 Fix.Clear(P);
+	 Fix.Protect(P);
+      }
+   }
+   std::cout << Cache->Head().PackageCount << " packages, "
+	     << Cache->BrokenCount() << " broken" << std::endl;
+
+   double const Start = Now();
+   bool const Resolved = Fix.Resolve(true);
+   double const Time = Now() - Start;
+
+   // a cheap fingerprint of the solution to compare it between builds
+   unsigned long Upgrade = 0, Keep = 0, Remove = 0;
+   unsigned long Hash = 0;
+   for (pkgCache::PkgIterator P = Cache->PkgBegin(); P.end() == false; ++P)
+   {
+      pkgDepCache::StateCache const &S = (*Cache)[P];
+      if (S.Upgrade() == true)
+	 ++Upgrade;
+      else if (S.Delete() == true)
+	 ++Remove;
+      else
+	 ++Keep;
+      Hash = Hash * 31 + S.Mode * 7 + S.InstBroken();
+   }
+   std::cout << "Resolve(): " << Time * 1000 << " ms, "
+	     << (Resolved ? "resolved" : "failed") << ": "
+	     << Upgrade << " upgraded, " << Keep << " kept, " << Remove << " removed, "
+	     << Cache->BrokenCount() << " broken (solution " << std::hex << Hash << std::dec << ")"
+	     << std::endl;
+
+   _error->DumpErrors();
+   return Resolved == true ? 0 : 1;
+}
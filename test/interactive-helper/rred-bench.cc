@@ -0,0 +1,291 @@
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* Benchmark for the rred method: A Packages file and chains of 1, 10 and
+   50 ed-style patches are generated. Each chain is applied once patch by
+   patch (as the acquire system did it) and once as a complete chain; both
+   results are checked against the expected file. The given rred method is
+   talked to via the usual method protocol. */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static std::vector<std::string> Generate(unsigned long const Count)
+{
+   std::vector<std::string> Lines;
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Buffer[2048];
+      snprintf(Buffer, sizeof(Buffer),
+	    "Package: package-%lu\n"
+	    "Priority: optional\n"
+	    "Section: libs\n"
+	    "Installed-Size: %lu\n"
+	    "Maintainer: APT Development Team <deity@lists.debian.org>\n"
+	    "Architecture: i386\n"
+	    "Version: 1.%lu-1\n"
+	    "Depends: libc6 (>= 2.7), libstdc++6 (>= 4.6), package-%lu (= 1.%lu-1) | package-%lu\n"
+	    "Filename: pool/main/p/package-%lu/package-%lu_1.%lu-1_i386.deb\n"
+	    "Size: %lu\n"
+	    "MD5sum: 0123456789abcdef0123456789abcdef\n"
+	    "SHA1: 0123456789abcdef0123456789abcdef01234567\n"
+	    "SHA256: 0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\n"
+	    "Description: fast scanner for RFC-822 type header information\n"
+	    " This parser handles Debian package files (and others).\n"
+	    "\n",
+	    I, I % 1000, I, I + 1, I + 1, I + 2, I, I, I, I * 7);
+      for (char *L = Buffer; *L != '\0';)
+      {
+	 char *E = strchr(L, '\n') + 1;
+	 Lines.push_back(std::string(L, E));
+	 L = E;
+      }
+   }
+   return Lines;
+}
+
+/* creates a patch with Edits non-overlapping commands and applies it
+   to Lines, so that they contain the expected result afterwards */
+static bool CreatePatch(std::string const &File, std::vector<std::string> &Lines,
+			unsigned long const Patch, unsigned int const Edits)
+{
+   std::string Script;
+   unsigned long const Step = Lines.size() / (Edits + 1);
+   for (unsigned int E = Edits; E > 0; --E)
+   {
+      unsigned long const Line = E * Step + rand() % (Step / 2);
+      char Buffer[300];
+      std::vector<std::string> Text;
+      unsigned long Pos = Line;
+      switch (rand() % 3)
+      {
+	 case 0:
+	    snprintf(Buffer, sizeof(Buffer), "%luc\n", Line);
+	    Script.append(Buffer);
+	    snprintf(Buffer, sizeof(Buffer), "Version: %lu.%u-1\n", Patch, E);
+	    Text.push_back(Buffer);
+	    Lines.erase(Lines.begin() + Line - 1);
+	    Pos = Line - 1;
+	    break;
+	 case 1:
+	    snprintf(Buffer, sizeof(Buffer), "%lu,%lud\n", Line, Line + 1);
+	    Script.append(Buffer);
+	    Lines.erase(Lines.begin() + Line - 1, Lines.begin() + Line + 1);
+	    break;
+	 case 2:
+	    snprintf(Buffer, sizeof(Buffer), "%lua\n", Line);
+	    Script.append(Buffer);
+	    snprintf(Buffer, sizeof(Buffer), "Breaks: package-%lu (<< %u)\n", Patch, E);
+	    Text.push_back(Buffer);
+	    Text.push_back("Replaces: package-old\n");
+	    break;
+      }
+      if (Text.empty() == true)
+	 continue;
+      Lines.insert(Lines.begin() + Pos, Text.begin(), Text.end());
+      for (std::vector<std::string>::const_iterator T = Text.begin(); T != Text.end(); ++T)
+	 Script.append(*T);
+      Script.append(".\n");
+   }
+   FileFd Fd(File, FileFd::WriteOnly | FileFd::Create | FileFd::Empty, FileFd::Gzip);
+   return Fd.Write(Script.c_str(), Script.length()) && Fd.Close();
+}
+
+static bool WriteLines(std::string const &File, std::vector<std::string> const &Lines)
+{
+   FileFd Fd(File, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+   for (std::vector<std::string>::const_iterator L = Lines.begin(); L != Lines.end(); ++L)
+      if (Fd.Write(L->c_str(), L->length()) == false)
+	 return false;
+   return Fd.Close();
+}
+
+static bool Copy(std::string const &From, std::string const &To)
+{
+   FileFd In(From, FileFd::ReadOnly);
+   FileFd Out(To, FileFd::WriteOnly | FileFd::Create | FileFd::Empty);
+   return CopyFile(In, Out) && Out.Close();
+}
+
+static std::string FileMD5(std::string const &File)
+{
+   FileFd Fd(File, FileFd::ReadOnly);
+   MD5Summation MD5;
+   MD5.AddFD(Fd);
+   return MD5.Result();
+}
+
+class Method
+{
+   pid_t Pid;
+   int ToMethod;
+   FILE *FromMethod;
+
+   public:
+   bool Start(char const * const Binary)
+   {
+      int In[2], Out[2];
+      if (pipe(In) != 0 || pipe(Out) != 0)
+	 return _error->Errno("pipe", "Failed to create pipes");
+      Pid = ExecFork();
+      if (Pid == 0)
+      {
+	 dup2(In[0], STDIN_FILENO);
+	 dup2(Out[1], STDOUT_FILENO);
+	 execl(Binary, Binary, (char *) NULL);
+	 _exit(100);
+      }
+      close(In[0]);
+      close(Out[1]);
+      ToMethod = In[1];
+      FromMethod = fdopen(Out[0], "r");
+      std::string Reply;
+      return Read(Reply);
+   }
+   bool Read(std::string &Reply)
+   {
+      char Buffer[1024];
+      Reply.clear();
+      while (fgets(Buffer, sizeof(Buffer), FromMethod) != NULL)
+      {
+	 if (Buffer[0] == '\n' && Reply.empty() == false)
+	    return true;
+	 Reply.append(Buffer);
+      }
+      return _error->Error("The method exited unexpectedly");
+   }
+   bool Patch(std::string const &File, std::string const &Result)
+   {
+      std::string const Msg = "600 URI Acquire\nURI: rred:" + File + "\nFilename: " + Result + "\n\n";
+      if (write(ToMethod, Msg.c_str(), Msg.length()) != (ssize_t) Msg.length())
+	 return _error->Errno("write", "Failed to talk to the method");
+      std::string Reply;
+      do {
+	 if (Read(Reply) == false)
+	    return false;
+      } while (Reply.compare(0, 3, "102") == 0 || Reply.compare(0, 3, "200") == 0);
+      if (Reply.compare(0, 3, "201") != 0)
+	 return _error->Error("rred failed: %s", Reply.c_str());
+      return true;
+   }
+   void Stop()
+   {
+      close(ToMethod);
+      fclose(FromMethod);
+      ExecWait(Pid, "rred");
+   }
+};
+
+int main(int argc, char *argv[])
+{
+   if (argc < 2)
+   {
+      std::cerr << "Usage: " << argv[0] << " <path to the rred method> [stanzas]" << std::endl;
+      return 1;
+   }
+   unsigned long const Count = (argc > 2) ? strtoul(argv[2], NULL, 10) : 20000;
+   unsigned int const Edits = 20;
+   static unsigned long const Chains[] = { 1, 10, 50, 0 };
+
+   char Dir[] = "/tmp/rred-bench.XXXXXX";
+   if (mkdtemp(Dir) == NULL)
+   {
+      perror("mkdtemp");
+      return 1;
+   }
+   std::string const Base = std::string(Dir) + "/Packages";
+
+   Method rred;
+   if (rred.Start(argv[1]) == false)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+
+   srand(42);
+   for (unsigned long const *Length = Chains; *Length != 0; ++Length)
+   {
+      std::vector<std::string> Lines = Generate(Count);
+      std::vector<std::string> Patches;
+      for (unsigned long P = 1; P <= *Length; ++P)
+      {
+	 char Name[20];
+	 snprintf(Name, sizeof(Name), "%04lu", P);
+	 Patches.push_back(Base + ".patch." + Name + ".gz");
+      }
+      if (WriteLines(Base + ".orig", Lines) == false)
+	 break;
+      for (unsigned long P = 0; P < *Length; ++P)
+	 if (CreatePatch(Patches[P], Lines, P + 1, Edits) == false)
+	    break;
+      if (WriteLines(Base + ".expected", Lines) == false)
+	 break;
+      std::string const Expected = FileMD5(Base + ".expected");
+      unsigned long long const Size = FileFd(Base + ".orig", FileFd::ReadOnly).Size();
+
+      // patch by patch
+      if (Copy(Base + ".orig", Base) == false)
+	 break;
+      double Start = Now();
+      for (std::vector<std::string>::const_iterator P = Patches.begin(); P != Patches.end(); ++P)
+      {
+	 if (link(P->c_str(), (Base + ".ed").c_str()) != 0 ||
+	     rred.Patch(Base, Base + ".result") == false ||
+	     rename((Base + ".result").c_str(), Base.c_str()) != 0)
+	    break;
+	 unlink((Base + ".ed").c_str());
+      }
+      double const Single = Now() - Start;
+      bool const SingleOkay = (FileMD5(Base) == Expected);
+
+      // the chain in one go
+      if (Copy(Base + ".orig", Base) == false)
+	 break;
+      for (unsigned long P = 0; P < *Length; ++P)
+	 link(Patches[P].c_str(), (Base + ".ed." + Patches[P].substr(Base.length() + 7)).c_str());
+      Start = Now();
+      bool const Chained = rred.Patch(Base, Base + ".result");
+      double const Chain = Now() - Start;
+      bool const ChainOkay = Chained && (FileMD5(Base + ".result") == Expected);
+
+      std::cout << "Chain of " << *Length << " patches on "
+		<< Size / 1024 << " KiB: "
+		<< "one by one " << Single << " s" << (SingleOkay ? "" : " (WRONG RESULT)")
+		<< ", composed " << Chain << " s" << (ChainOkay ? "" : " (WRONG RESULT)")
+		<< std::endl;
+
+      for (unsigned long P = 0; P < *Length; ++P)
+      {
+	 unlink((Base + ".ed." + Patches[P].substr(Base.length() + 7)).c_str());
+	 unlink(Patches[P].c_str());
+      }
+      unlink((Base + ".result").c_str());
+      unlink((Base + ".orig").c_str());
+      unlink((Base + ".expected").c_str());
+      unlink(Base.c_str());
+   }
+   rred.Stop();
+   rmdir(Dir);
+
+   if (_error->PendingError() == true)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   return 0;
+}
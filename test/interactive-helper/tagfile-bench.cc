@@ -0,0 +1,136 @@
+#include <apt-pkg/tagfile.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/error.h>
+
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* Benchmark for the pkgTagFile/pkgTagSection scanner: A Packages file
+   with the given number of stanzas is generated and scanned a few times,
+   once only stepping over the sections and once also looking up the
+   fields the cache generator is interested in. */
+
+static double Now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool Generate(FileFd &Fd, unsigned long const Count)
+{
+   std::string const Description = "Description: fast scanner for RFC-822 type header information\n"
+      " This parser handles Debian package files (and others). Their form is\n"
+      " RFC-822 type header fields in groups separated by a blank line.\n"
+      " .\n"
+      " The parser reads the file and provides methods to step linearly\n"
+      " over it or to jump to a pre-recorded start point and read that record.\n";
+   for (unsigned long I = 0; I < Count; ++I)
+   {
+      char Buffer[2048];
+      int const Len = snprintf(Buffer, sizeof(Buffer),
+	    "Package: package-%lu\n"
+	    "Priority: optional\n"
+	    "Section: libs\n"
+	    "Installed-Size: %lu\n"
+	    "Maintainer: APT Development Team <deity@lists.debian.org>\n"
+	    "Architecture: i386\n"
+	    "Multi-Arch: same\n"
+	    "Source: source-%lu\n"
+	    "Version: 1.%lu-1\n"
+	    "Replaces: package-%lu (<< 1.0)\n"
+	    "Provides: virtual-%lu\n"
+	    "Depends: libc6 (>= 2.7), libstdc++6 (>= 4.6), package-%lu (= 1.%lu-1) | package-%lu\n"
+	    "Pre-Depends: multiarch-support\n"
+	    "Recommends: package-%lu\n"
+	    "Suggests: package-%lu-doc\n"
+	    "Conflicts: package-%lu-old\n"
+	    "Breaks: package-%lu (<< 1.0)\n"
+	    "Filename: pool/main/p/package-%lu/package-%lu_1.%lu-1_i386.deb\n"
+	    "Size: %lu\n"
+	    "MD5sum: 0123456789abcdef0123456789abcdef\n"
+	    "SHA1: 0123456789abcdef0123456789abcdef01234567\n"
+	    "SHA256: 0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef\n",
+	    I, I % 1000, I, I, I, I, I + 1, I + 1, I + 2, I + 3, I, I, I, I, I, I, I * 7);
+      if (Fd.Write(Buffer, Len) == false ||
+	  Fd.Write(Description.c_str(), Description.length()) == false ||
+	  Fd.Write("\n", 1) == false)
+	 return false;
+   }
+   return true;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long const Count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 50000;
+   unsigned long const Runs = (argc > 2) ? strtoul(argv[2], NULL, 10) : 5;
+
+   char Name[] = "/tmp/tagfile-bench.XXXXXX";
+   int const TmpFd = mkstemp(Name);
+   if (TmpFd < 0)
+   {
+      perror("mkstemp");
+      return 1;
+   }
+   FileFd Out(TmpFd, true);
+   if (Generate(Out, Count) == false)
+   {
+      _error->DumpErrors();
+      unlink(Name);
+      return 1;
+   }
+   unsigned long long const Size = Out.Size();
+   Out.Close();
+
+   static const char *Fields[] = { "Package", "Architecture", "Version", "Multi-Arch",
+      "Essential", "Important", "Priority", "Section", "Depends", "Pre-Depends",
+      "Suggests", "Recommends", "Conflicts", "Breaks", "Replaces", "Provides",
+      "Description", "Description-md5", "Installed-Size", "Size", "Filename",
+      "MD5sum", 0 };
+
+   for (unsigned int Lookup = 0; Lookup < 2; ++Lookup)
+   {
+      double Best = 0;
+      unsigned long Sections = 0;
+      unsigned long Found = 0;
+      for (unsigned long R = 0; R < Runs; ++R)
+      {
+	 FileFd Fd(Name, FileFd::ReadOnly);
+	 pkgTagFile Tags(&Fd);
+	 pkgTagSection Section;
+	 Sections = Found = 0;
+	 double const Start = Now();
+	 while (Tags.Step(Section) == true)
+	 {
+	    ++Sections;
+	    if (Lookup == 0)
+	       continue;
+	    for (const char **F = Fields; *F != 0; ++F)
+	    {
+	       const char *S, *E;
+	       if (Section.Find(*F, S, E) == true)
+		  ++Found;
+	    }
+	 }
+	 double const Time = Now() - Start;
+	 if (R == 0 || Time < Best)
+	    Best = Time;
+      }
+      std::cout << (Lookup == 0 ? "Step:        " : "Step+Find:   ")
+		<< Sections << " sections, " << Found << " fields in "
+		<< Best << " s (" << (Size / 1024.0 / 1024.0) / Best << " MB/s)" << std::endl;
+   }
+
+   unlink(Name);
+   if (_error->PendingError() == true)
+   {
+      _error->DumpErrors();
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,129 @@
+#include <apt-pkg/fdpoller.h>
+
+#include "assert.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+void testPoller(bool const UseEpoll)
+{
+	FdPoller Poller(UseEpoll);
+	int A[2], B[2];
+	equals(pipe(A), 0);
+	equals(pipe(B), 0);
+
+	// nothing to read, but the write ends are ready
+	Poller.Watch(A[0], FdPoller::Read, 1);
+	Poller.Watch(B[0], FdPoller::Read, 2);
+	Poller.Watch(B[1], FdPoller::Write, 2);
+	equals(Poller.Wait(0), 1);
+	equals(Poller.Ready(A[0]), 0);
+	equals(Poller.Ready(B[0]), 0);
+	equals(Poller.Ready(B[1]), FdPoller::Write);
+
+	// data arrives - level triggered, so reported until it is read
+	equals(write(A[1], "x", 1), 1);
+	for (int i = 0; i < 2; ++i)
+	{
+		Poller.Watch(A[0], FdPoller::Read, 1);
+		Poller.Watch(B[0], FdPoller::Read, 2);
+		equals(Poller.Wait(0), 1);
+		equals(Poller.Ready(A[0]), FdPoller::Read);
+		equals(Poller.Ready(B[0]), 0);
+		equals(Poller.Ready(B[1]), 0);
+	}
+
+	// descriptors not watched again are dropped
+	Poller.Watch(B[0], FdPoller::Read, 2);
+	equals(Poller.Wait(0), 0);
+	equals(Poller.Ready(A[0]), 0);
+
+	// a closed write end is a hangup, which is reported as readable
+	close(B[1]);
+	Poller.Watch(B[0], FdPoller::Read, 2);
+	equals(Poller.Wait(0), 1);
+	equals(Poller.Ready(B[0]), FdPoller::Read);
+
+	/* close and reuse the descriptor numbers for new pipes; with the old
+	   Id the poller wouldn't know that it has to register them again */
+	int const OldB0 = B[0];
+	close(B[0]);
+	equals(pipe(B), 0);
+	equals(B[0], OldB0);
+	Poller.Watch(A[0], FdPoller::Read, 1);
+	Poller.Watch(B[0], FdPoller::Read, 3);
+	equals(Poller.Wait(0), 1);
+	equals(Poller.Ready(A[0]), FdPoller::Read);
+	equals(Poller.Ready(B[0]), 0);
+	equals(write(B[1], "x", 1), 1);
+	Poller.Watch(B[0], FdPoller::Read, 3);
+	equals(Poller.Wait(1000), 1);
+	equals(Poller.Ready(B[0]), FdPoller::Read);
+
+	// regular files are always ready
+	char Name[] = "/tmp/fdpoller-test.XXXXXX";
+	int const File = mkstemp(Name);
+	unlink(Name);
+	Poller.Watch(File, FdPoller::Write, 4);
+	Poller.Watch(A[0], FdPoller::Read, 1);
+	equals(Poller.Wait(-1), 2);
+	equals(Poller.Ready(File), FdPoller::Write);
+	equals(Poller.Ready(A[0]), FdPoller::Read);
+
+	// the timeout is honored
+	Poller.Forget(A[0]);
+	close(A[0]);
+	close(A[1]);
+	int C[2];
+	equals(pipe(C), 0);
+	Poller.Watch(C[0], FdPoller::Read, 5);
+	equals(Poller.Wait(10), 0);
+	equals(Poller.Ready(C[0]), 0);
+
+	close(C[0]);
+	close(C[1]);
+	close(File);
+	close(B[0]);
+	close(B[1]);
+}
+
+int main(int argc,char *argv[])
+{
+	testPoller(true);
+	testPoller(false);
+	equals(FdPoller().UsesEpoll(), true);
+	equals(FdPoller(false).UsesEpoll(), false);
+
+	// more descriptors than select() could ever handle
+	struct rlimit Limit;
+	if (getrlimit(RLIMIT_NOFILE, &Limit) == 0 && Limit.rlim_cur < 2500 && Limit.rlim_max >= 2500)
+	{
+		Limit.rlim_cur = 2500;
+		setrlimit(RLIMIT_NOFILE, &Limit);
+	}
+	FdPoller Poller;
+	int Pipes[1200][2];
+	int Created = 0;
+	for (; Created < 1200; ++Created)
+		if (pipe(Pipes[Created]) != 0)
+			break;
+	if (Created != 1200)
+	{
+		std::cerr << "Skip FD_SETSIZE test as only " << Created << " pipes could be created" << std::endl;
+		for (int i = 0; i < Created; ++i)
+			close(Pipes[i][0]), close(Pipes[i][1]);
+		return 0;
+	}
+	equals(write(Pipes[1100][1], "x", 1), 1);
+	for (int i = 0; i < 1200; ++i)
+		Poller.Watch(Pipes[i][0], FdPoller::Read, i);
+	equals(Poller.Wait(0), 1);
+	equals(Poller.Ready(Pipes[1100][0]), FdPoller::Read);
+	equals(Poller.Ready(Pipes[1099][0]), 0);
+	for (int i = 0; i < 1200; ++i)
+		close(Pipes[i][0]), close(Pipes[i][1]);
+
+	return 0;
+}
@@ -3,9 +3,14 @@
 #include <apt-pkg/sha2.h>
 #include <apt-pkg/strutl.h>
 #include <apt-pkg/hashes.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
 #include <iostream>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "assert.h"
 
@@ -16,18 +21,19 @@ template <class T> void Test(const char *In,const char *Out)
    equals(Sum.Result().Value(), Out);
 }
 
-template <class T> void TestMill(const char *Out)
+template <class T> void TestMill(const char *Out, unsigned int const Chunk = 64)
 {
    T Sum;
 
-   const unsigned char As[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+   std::string const A(Chunk, 'a');
+   const unsigned char * const As = (const unsigned char *) A.c_str();
    unsigned Count = 1000000;
    for (; Count != 0;)
    {
-      if (Count >= 64)
+      if (Count >= Chunk)
       {
-	 Sum.Add(As,64);
-	 Count -= 64;
+	 Sum.Add(As,Chunk);
+	 Count -= Chunk;
       }
       else
       {
@@ -64,6 +70,10 @@ int main(int argc, char** argv)
    Test<SHA256Summation>("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
    Test<SHA256Summation>("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
 			 "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+   // feed the blocks one by one, unaligned and many at once to the (hardware) transforms
+   TestMill<SHA256Summation>("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+   TestMill<SHA256Summation>("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", 61);
+   TestMill<SHA256Summation>("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", 1000);
 
    // SHA-512
    Test<SHA512Summation>("",
@@ -73,6 +83,8 @@ int main(int argc, char** argv)
       "abc",
       "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
       "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f");
+   TestMill<SHA512Summation>("e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+			     "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b", 1000);
 
 
    Test<MD5Summation>("The quick brown fox jumps over the lazy dog", "9e107d9d372bb6826bd81d3542a419d6");
@@ -150,6 +162,60 @@ int main(int argc, char** argv)
    equals(sha2.VerifyFile(argv[1]), true);
    }
 
+   // big files are hashed by child processes, which should give the same
+   char Name[] = "/tmp/hashsums_test.XXXXXX";
+   int const TmpFd = mkstemp(Name);
+   if (TmpFd < 0) {
+      std::cerr << "Can't create a big file for testing" << std::endl;
+      return 1;
+   }
+   {
+   FileFd Big(TmpFd, true);
+   unsigned char Block[1000];
+   for (unsigned int I = 0; I < sizeof(Block); ++I)
+      Block[I] = I * 7;
+   for (unsigned int I = 0; I < 5000; ++I)
+      Big.Write(Block, sizeof(Block) - (I % 3));
+   }
+   Hashes Expected;
+   _config->Set("APT::Hashes::Parallel", false);
+   {
+   FileFd Big(Name, FileFd::ReadOnly);
+   Expected.Add("prefix");
+   Expected.AddFD(Big);
+   }
+   _config->Set("APT::Hashes::Parallel", true);
+   {
+   FileFd Big(Name, FileFd::ReadOnly);
+   Hashes hashes;
+   hashes.Add("prefix");
+   hashes.AddFD(Big);
+   equals(Expected.MD5.Result().Value(), hashes.MD5.Result().Value());
+   equals(Expected.SHA1.Result().Value(), hashes.SHA1.Result().Value());
+   equals(Expected.SHA256.Result().Value(), hashes.SHA256.Result().Value());
+   equals(Expected.SHA512.Result().Value(), hashes.SHA512.Result().Value());
+   }
+   {
+   FileFd Big(Name, FileFd::ReadOnly);
+   Hashes hashes;
+   hashes.Add("prefix");
+   hashes.AddFD(Big.Fd(), Big.Size(), false, true, false, true);
+   equals(Expected.SHA1.Result().Value(), hashes.SHA1.Result().Value());
+   equals(Expected.SHA512.Result().Value(), hashes.SHA512.Result().Value());
+   }
+   // the children can't be waited for if SIGCHLD is ignored
+   signal(SIGCHLD, SIG_IGN);
+   {
+   FileFd Big(Name, FileFd::ReadOnly);
+   Hashes hashes;
+   hashes.Add("prefix");
+   equals(hashes.AddFD(Big), true);
+   equals(Expected.SHA256.Result().Value(), hashes.SHA256.Result().Value());
+   equals(Expected.SHA512.Result().Value(), hashes.SHA512.Result().Value());
+   }
+   signal(SIGCHLD, SIG_DFL);
+   unlink(Name);
+
    return 0;
 }
 
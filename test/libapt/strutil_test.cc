@@ -1,6 +1,8 @@
 #include <apt-pkg/strutl.h>
 
 #include "assert.h"
+#include <unistd.h>
+#include <fcntl.h>
 
 int main(int argc,char *argv[])
 {
@@ -42,5 +44,42 @@ int main(int argc,char *argv[])
    output = DeEscapeString(input);
    equals(output, expected);
 
+   // text messages and binary frames mixed on the same descriptor
+   int Pipe[2];
+   equals(pipe(Pipe), 0);
+   fcntl(Pipe[0], F_SETFL, O_NONBLOCK);
+   std::string const Text = "201 URI Done\nURI: file:/foo\nSize: 42";
+   std::string const Multi = "601 Configuration\nConfig-Item: A::B=c\nList:\n one\n two";
+   std::string Stream = Text + "\n\n\n" + FrameMessage(Text) + FrameMessage(Multi + "\n\n");
+   equals(Stream[Text.length() + 3], '\x1e');
+   equals(write(Pipe[1], Stream.c_str(), Stream.length()), (ssize_t) Stream.length());
+   std::vector<std::string> Messages;
+   bool Framed;
+   equals(ReadMessages(Pipe[0], Messages, Framed), true);
+   equals(Framed, true);
+   equals(Messages.size(), 3);
+   equals(Messages[0], Text);
+   equals(Messages[1], Text);
+   equals(Messages[2], Multi);
+
+   // nothing (complete) to read
+   Messages.clear();
+   equals(ReadMessages(Pipe[0], Messages, Framed), true);
+   equals(Framed, false);
+   equals(Messages.size(), 0);
+
+   // a message filling the read buffer exactly, followed by another one
+   std::string const Long = "200 URI Start\nMessage: " + std::string(64000 - 25, 'x');
+   Stream = Long + "\n\n" + Text + "\n\n";
+   equals(write(Pipe[1], Stream.c_str(), Stream.length()), (ssize_t) Stream.length());
+   equals(ReadMessages(Pipe[0], Messages, Framed), true);
+   equals(Messages.size(), 1);
+   equals(ReadMessages(Pipe[0], Messages, Framed), true);
+   equals(Messages.size(), 2);
+   equals(Messages[0], Long);
+   equals(Messages[1], Text);
+
+   close(Pipe[0]);
+   close(Pipe[1]);
    return 0;
 }
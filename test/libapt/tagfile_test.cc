@@ -0,0 +1,125 @@
+#include <apt-pkg/tagfile.h>
+#include <apt-pkg/fileutl.h>
+
+#include <iostream>
+#include <string>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "assert.h"
+
+// read the file with Step and Jump, the last section ends with Tail
+static bool TestTagFile(std::string const &Tail, FileFd::OpenMode const Mode)
+{
+   std::string const Content = "Package: a\n"
+      "Version: 1\n"
+      "\n"
+      "Package: b\n"
+      "Version: 2\n"
+      "Description: second\n"
+      " package\n"
+      "\n"
+      "Package: c\n"
+      "Version: 3" + Tail;
+
+   char Name[] = "/tmp/tagfile_test.XXXXXX";
+   int const TmpFd = mkstemp(Name);
+   if (TmpFd < 0) {
+      std::cerr << "Can't create a file for testing" << std::endl;
+      return false;
+   }
+   {
+   FileFd File(TmpFd, true);
+   File.Write(Content.c_str(), Content.length());
+   }
+
+   {
+   FileFd Fd(Name, Mode);
+   pkgTagFile Tags(&Fd);
+   pkgTagSection Section;
+   char const * const Versions[] = { "1", "2", "3" };
+   unsigned long Offsets[3];
+   for (unsigned int I = 0; I < 3; ++I)
+   {
+      Offsets[I] = Tags.Offset();
+      equals(Tags.Step(Section), true);
+      equals(Section.FindS("Version"), Versions[I]);
+   }
+   equals(Offsets[0], 0);
+   equals(Offsets[1], 23);
+   equals(Offsets[2], 75);
+   equals(Section.FindS("Package"), "c");
+   equals(Section.Count(), 2);
+   equals(Tags.Step(Section), false);
+
+   // back from the end into the middle and to the last section again
+   equals(Tags.Jump(Section, Offsets[1]), true);
+   equals(Section.FindS("Package"), "b");
+   equals(Section.FindS("Description"), "second\n package");
+   equals(Tags.Jump(Section, Offsets[2]), true);
+   equals(Section.FindS("Package"), "c");
+   equals(Section.FindS("Version"), "3");
+   equals(Tags.Jump(Section, Offsets[0]), true);
+   equals(Section.FindS("Package"), "a");
+   equals(Section.Count(), 2);
+   }
+
+   unlink(Name);
+   return true;
+}
+
+int main(int argc,char *argv[])
+{
+   char const * const Record = "Package: apt\n"
+      "Version: 0.8.16\n"
+      "installed-size: 42\n"
+      "Depends: libc6 (>= 2.7)\n"
+      "Provides:\tfoo\n"
+      "Description: commandline package manager\n"
+      " This package provides commandline tools.\n"
+      "Status: install ok installed\n"
+      "\n";
+
+   pkgTagSection Section;
+   equals(Section.Scan(Record, strlen(Record)), true);
+   equals(Section.Count(), 7);
+
+   equals(Section.FindS("Package"), "apt");
+   equals(Section.FindS("package"), "apt");
+   equals(Section.FindS("PACKAGE"), "apt");
+   equals(Section.FindS("Version"), "0.8.16");
+   equals(Section.FindI("Installed-Size"), 42);
+   equals(Section.FindS("Depends"), "libc6 (>= 2.7)");
+   equals(Section.FindS("Provides"), "foo");
+   equals(Section.FindS("Description"), "commandline package manager\n This package provides commandline tools.");
+   // Provides and Status have the same hash
+   equals(Section.FindS("Status"), "install ok installed");
+
+   // prefixes and missing tags are not found
+   const char *Start, *End;
+   equals(Section.Find("Pack", Start, End), false);
+   equals(Section.Find("Packages", Start, End), false);
+   equals(Section.Find("Description-md5", Start, End), false);
+   equals(Section.Find("Essential", Start, End), false);
+
+   unsigned int Pos;
+   equals(Section.Find("Depends", Pos), true);
+   equals(Pos, 3);
+   equals(Section.Find("Status", Pos), true);
+   equals(Pos, 6);
+
+   /* Files opened readonly are mapped, the last section is copied to a
+      buffer if it isn't terminated by an empty line. Other files are read
+      into the buffer and have to give the same results. */
+   char const * const Tails[] = { "", "\n", "\n\n", "\n\n\n" };
+   for (unsigned int I = 0; I < sizeof(Tails) / sizeof(Tails[0]); ++I)
+   {
+      if (TestTagFile(Tails[I], FileFd::ReadOnly) == false ||
+	  TestTagFile(Tails[I], FileFd::ReadWrite) == false)
+	 return 1;
+   }
+
+   return 0;
+}